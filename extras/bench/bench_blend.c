@@ -0,0 +1,89 @@
+/*
+  bench_blend.c - WS2812FX_color_blend() and WS2812FX_blendSpan() against
+  the byte-at-a-time blend they replaced
+
+  Host program, from the library's root directory:
+    cc -O2 -Isrc -o bench_blend extras/bench/bench_blend.c src/*.c
+    ./bench_blend
+
+  Timings are in ns per color for color_blend and ns per byte for the span
+  blend over 1k RGB pixels. Also counts the channels where the new rounding
+  (down) differs from the old truncation (towards color1).
+*/
+#include <stdio.h>
+#include <time.h>
+#include "WS2812FX.h"
+
+#define N     20000000
+#define BYTES (1024 * 3)
+
+// declared by WS2812FX.h but left to the application
+void WS2812FX_setLength(WS2812FX_Ctx *ctx, uint16_t b) { (void)ctx; (void)b; }
+
+// the implementation before the packed 16-bit lanes
+static uint8_t* old_blend(uint8_t *dest, uint8_t *src1, uint8_t *src2, uint16_t cnt, uint8_t blendAmt) {
+  if(blendAmt == 0) {
+    Adafruit_NeoPixel_memmove(dest, src1, cnt);
+  } else if(blendAmt == 255) {
+    Adafruit_NeoPixel_memmove(dest, src2, cnt);
+  } else {
+    for(uint16_t i=0; i<cnt; i++) {
+      dest[i] = blendAmt * ((int)src2[i] - (int)src1[i]) / 256 + src1[i];
+    }
+  }
+  return dest;
+}
+
+static uint32_t old_color_blend(uint32_t color1, uint32_t color2, uint8_t blendAmt) {
+  uint32_t blendedColor;
+  old_blend((uint8_t*)&blendedColor, (uint8_t*)&color1, (uint8_t*)&color2, sizeof(uint32_t), blendAmt);
+  return blendedColor;
+}
+
+static uint8_t a[BYTES], b[BYTES], out[BYTES];
+static volatile uint32_t sink;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void) {
+  uint32_t x = 12345, diff = 0;
+  for(uint16_t i=0; i<BYTES; i++) {
+    x = x * 1103515245 + 12345;
+    a[i] = (uint8_t)(x >> 16);
+    b[i] = (uint8_t)(x >> 24);
+  }
+
+  int maxDiff = 0;
+  for(uint32_t i=0; i<1000000; i++) {
+    x = x * 1103515245 + 12345;
+    uint32_t c1 = x, c2 = x * 2654435761U;
+    uint32_t o = old_color_blend(c1, c2, (uint8_t)(x >> 8)), n = WS2812FX_color_blend(c1, c2, (uint8_t)(x >> 8));
+    for(uint8_t k=0; k<32; k+=8) {
+      int d = (int)((o >> k) & 0xFF) - (int)((n >> k) & 0xFF);
+      if(d) diff++;
+      if(d < 0) d = -d;
+      if(d > maxDiff) maxDiff = d;
+    }
+  }
+  printf("color_blend channels differing from the old version: %.1f%%, by at most %d\n", diff / 40000.0, maxDiff);
+
+  double t = now();
+  for(uint32_t i=0; i<N; i++) sink += old_color_blend(i * 2654435761U, ~i, (uint8_t)(i | 1));
+  printf("color_blend  old %5.2f ns", (now() - t) / N * 1e9);
+  t = now();
+  for(uint32_t i=0; i<N; i++) sink += WS2812FX_color_blend(i * 2654435761U, ~i, (uint8_t)(i | 1));
+  printf("   new %5.2f ns\n", (now() - t) / N * 1e9);
+
+  long reps = N / 1000;
+  t = now();
+  for(long r=0; r<reps; r++) sink += old_blend(out, a, b, BYTES, (uint8_t)(r | 1))[r % BYTES];
+  printf("blend span   old %5.2f ns", (now() - t) / ((double)reps * BYTES) * 1e9);
+  t = now();
+  for(long r=0; r<reps; r++) sink += WS2812FX_blendSpan(out, a, b, BYTES, (uint8_t)(r | 1))[r % BYTES];
+  printf("   new %5.2f ns\n", (now() - t) / ((double)reps * BYTES) * 1e9);
+  return 0;
+}
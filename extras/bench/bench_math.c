@@ -0,0 +1,129 @@
+/*
+  bench_math.c - accuracy and speed of WS2812FX_math against libm floats
+
+  Host program, from the library's root directory:
+    cc -O2 -Isrc -o bench_math extras/bench/bench_math.c src/WS2812FX_math.c -lm
+    ./bench_math
+
+  Errors are in lsb of the fixed point result (relative to the value for
+  results above 1.0), timings in ns per call. On a host with an FPU the
+  float versions win for everything but sine; the fixed point versions
+  are for the MCUs without one, where every float call goes through
+  soft-float.
+*/
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+#include "WS2812FX_math.h"
+
+#define PI 3.14159265358979323846
+#define N  2000000
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double rel(double err, double ref) {
+  return ref > 65536 ? err / (ref / 65536) : err;
+}
+
+static void accuracy(void) {
+  double e, max;
+
+  max = 0;
+  for(long a=0; a<65536; a++) {
+    e = fabs(WS2812FX_sin16(a) - 32768.0 * sin(a * 2 * PI / 65536));
+    if(e > max) max = e;
+  }
+  printf("sin16     max err %.3f lsb\n", max);
+
+  max = 0;
+  for(long a=0; a<65536; a++) {
+    e = fabs(WS2812FX_cos16(a) - 32768.0 * cos(a * 2 * PI / 65536));
+    if(e > max) max = e;
+  }
+  printf("cos16     max err %.3f lsb\n", max);
+
+  max = 0;
+  for(long x=1; x<0x7FFFFFFF; x+=12345) {
+    e = fabs(WS2812FX_q16_sqrt(x) - sqrt(x / 65536.0) * 65536);
+    if(e > max) max = e;
+  }
+  printf("q16_sqrt  max err %.3f lsb\n", max);
+
+  max = 0;
+  for(long x=1; x<0x7FFFFFFF; x+=12345) {
+    e = fabs(WS2812FX_q16_log2(x) - log2(x / 65536.0) * 65536);
+    if(e > max) max = e;
+  }
+  printf("q16_log2  max err %.3f lsb\n", max);
+
+  max = 0;
+  for(long x=-16*65536; x<15*65536; x+=37) {
+    double r = exp2(x / 65536.0) * 65536;
+    e = rel(fabs(WS2812FX_q16_exp2(x) - r), r);
+    if(e > max) max = e;
+  }
+  printf("q16_exp2  max err %.3f lsb\n", max);
+
+  max = 0;
+  for(long x=-12*65536; x<10*65536; x+=37) {
+    double r = exp(x / 65536.0) * 65536;
+    e = rel(fabs(WS2812FX_q16_exp(x) - r), r);
+    if(e > max) max = e;
+  }
+  printf("q16_exp   max err %.3f lsb\n", max);
+
+  max = 0;
+  for(long b=100; b<1000*65536L; b+=4321) {
+    for(int k=0; k<8; k++) {
+      long x = (k - 3) * 30000L + 777;
+      double r = pow(b / 65536.0, x / 65536.0) * 65536;
+      if(r > 2e9) continue; // saturated
+      e = rel(fabs(WS2812FX_q16_pow(b, x) - r), r);
+      if(e > max) max = e;
+    }
+  }
+  printf("q16_pow   max err %.3f lsb\n", max);
+
+  int mismatches = 0;
+  for(int g=1; g<=50; g++) {
+    for(int i=0; i<256; i++) {
+      if((long)WS2812FX_pow_ratio(i, 255, g, 10, 255) != lround(255 * pow(i / 255.0, g / 10.0))) mismatches++;
+    }
+  }
+  printf("pow_ratio gamma 0.1-5.0 tables: %d of %d entries differ from round(255*pow())\n", mismatches, 50 * 256);
+}
+
+static void speed(void) {
+  volatile int32_t sink = 0;
+  double t;
+
+  t = now(); for(long i=0; i<N; i++) sink += WS2812FX_sin16(i * 7);
+  printf("sin16    %6.1f ns   ", (now() - t) / N * 1e9);
+  t = now(); for(long i=0; i<N; i++) sink += (int32_t)(32767 * sinf(i * 7 * (float)(2 * PI / 65536)));
+  printf("sinf  %6.1f ns\n", (now() - t) / N * 1e9);
+
+  t = now(); for(long i=0; i<N; i++) sink += WS2812FX_q16_sqrt(i * 1000 + 1);
+  printf("q16_sqrt %6.1f ns   ", (now() - t) / N * 1e9);
+  t = now(); for(long i=0; i<N; i++) sink += (int32_t)(sqrtf((i * 1000 + 1) / 65536.0f) * 65536);
+  printf("sqrtf %6.1f ns\n", (now() - t) / N * 1e9);
+
+  t = now(); for(long i=0; i<N; i++) sink += WS2812FX_q16_exp(i % (20 << 16) - (10 << 16));
+  printf("q16_exp  %6.1f ns   ", (now() - t) / N * 1e9);
+  t = now(); for(long i=0; i<N; i++) sink += (int32_t)(expf((i % (20 << 16) - (10 << 16)) / 65536.0f) * 65536);
+  printf("expf  %6.1f ns\n", (now() - t) / N * 1e9);
+
+  t = now(); for(long i=0; i<N; i++) sink += WS2812FX_q16_pow(i * 100 + 1, Q16(0.5223));
+  printf("q16_pow  %6.1f ns   ", (now() - t) / N * 1e9);
+  t = now(); for(long i=0; i<N; i++) sink += (int32_t)(powf((i * 100 + 1) / 65536.0f, 0.5223f) * 65536);
+  printf("powf  %6.1f ns\n", (now() - t) / N * 1e9);
+}
+
+int main(void) {
+  accuracy();
+  speed();
+  return 0;
+}
@@ -0,0 +1,112 @@
+/*
+  bench_mem.c - pixel buffer memmove/memset/memchr against the byte loops
+  they replaced and the C library's
+
+  Host program, from the library's root directory:
+    cc -O2 -fno-tree-loop-distribute-patterns -DUSE_LIBC_MEM=0 -Isrc -o bench_mem extras/bench/bench_mem.c src/Adafruit_NeoPixel_funcs.c
+    ./bench_mem
+
+  USE_LIBC_MEM=0 builds the word/SIMD routines, which hosted builds otherwise
+  replace with the C library's. The -fno-tree-loop-distribute-patterns keeps
+  GCC from turning the old byte loops into libc calls (clang doesn't need
+  it). Buffers are 3 bytes per LED, 1k to 64k LEDs; moves are overlapping by
+  one pixel in both directions, as the effects shift pixels, and memchr scans
+  the whole buffer. Timings are in ns per kB.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "Adafruit_NeoPixel_defines.h"
+
+#define BYTES_PER_LED 3
+#define MAX_LEDS      65536
+#define TOTAL_BYTES   (256L << 20) // per measurement, whatever the buffer size
+
+// the implementations before the word/vector versions
+static void* byte_memmove(void* dest, const void* src, size_t num) {
+  unsigned char* d = dest;
+  const unsigned char* s = src;
+  if(d < s) {
+    while(num--) *d++ = *s++;
+  } else {
+    d += num;
+    s += num;
+    while(num--) *(--d) = *(--s);
+  }
+  return dest;
+}
+
+static void* byte_memset(void* dest, int value, size_t num) {
+  unsigned char* p = dest;
+  for(size_t i=0; i<num; i++) p[i] = (unsigned char)value;
+  return dest;
+}
+
+static void* byte_memchr(const void* ptr, int value, size_t num) {
+  const unsigned char* p = ptr;
+  for(size_t i=0; i<num; i++) {
+    if(p[i] == (unsigned char)value) return (void*)(p + i);
+  }
+  return 0;
+}
+
+typedef void* (*move_fn)(void*, const void*, size_t);
+typedef void* (*set_fn)(void*, int, size_t);
+typedef void* (*chr_fn)(const void*, int, size_t);
+
+static unsigned char buf[MAX_LEDS * BYTES_PER_LED + 64];
+static volatile size_t sink;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double per_kb(double t0, size_t len, long reps) {
+  return (now() - t0) / ((double)len * reps / 1024) * 1e9;
+}
+
+static double bench_move(move_fn f, size_t len) {
+  long reps = TOTAL_BYTES / len / 2;
+  double t0 = now();
+  for(long r=0; r<reps; r++) {
+    f(buf + BYTES_PER_LED, buf, len); // towards the end
+    f(buf, buf + BYTES_PER_LED, len); // and back
+  }
+  sink += buf[len / 2];
+  return per_kb(t0, len, reps * 2);
+}
+
+static double bench_set(set_fn f, size_t len) {
+  long reps = TOTAL_BYTES / len;
+  double t0 = now();
+  for(long r=0; r<reps; r++) f(buf + 1, (int)r, len); // unaligned start
+  sink += buf[len / 2];
+  return per_kb(t0, len, reps);
+}
+
+static double bench_chr(chr_fn f, size_t len) {
+  long reps = TOTAL_BYTES / len;
+  double t0 = now();
+  for(long r=0; r<reps; r++) sink += (size_t)f(buf + 1, 0xAB, len); // no match, full scan
+  return per_kb(t0, len, reps);
+}
+
+int main(void) {
+  memset(buf, 0x11, sizeof(buf));
+
+  printf("%6s  %-8s %9s %9s %9s\n", "LEDs", "", "bytewise", "neopixel", "libc");
+  for(long leds=1024; leds<=MAX_LEDS; leds*=4) {
+    size_t len = leds * BYTES_PER_LED;
+    printf("%6ld  %-8s %9.1f %9.1f %9.1f\n", leds, "memmove",
+      bench_move(byte_memmove, len), bench_move(Adafruit_NeoPixel_memmove, len), bench_move(memmove, len));
+    printf("%6s  %-8s %9.1f %9.1f %9.1f\n", "", "memset",
+      bench_set(byte_memset, len), bench_set(Adafruit_NeoPixel_memset, len), bench_set(memset, len));
+    memset(buf, 0x11, sizeof(buf));
+    printf("%6s  %-8s %9.1f %9.1f %9.1f\n", "", "memchr",
+      bench_chr(byte_memchr, len), bench_chr(Adafruit_NeoPixel_memchr, len), bench_chr((chr_fn)memchr, len));
+  }
+  return 0;
+}
@@ -46,17 +46,6 @@
 #include "Adafruit_NeoPixel.h"
 #include "ws2812_user_def.h"
 
-static bool begun;         ///< true if begin() previously called
-uint16_t Adafruit_NeoPixel_numLEDs;   ///< Number of RGB LEDs in strip
-uint16_t Adafruit_NeoPixel_numBytes;  ///< Size of 'pixels' buffer below
-static int16_t pin;        ///< Output pin number (-1 if not yet set)
-uint8_t Adafruit_NeoPixel_brightness; ///< Strip brightness 0-255 (stored as +1)
-uint8_t *Adafruit_NeoPixel_pixels;    ///< Holds LED color values (3 or 4 bytes each)
-uint8_t Adafruit_NeoPixel_rOffset;    ///< Red index within each 3- or 4-byte pixel
-uint8_t Adafruit_NeoPixel_gOffset;    ///< Index of green byte
-uint8_t Adafruit_NeoPixel_bOffset;    ///< Index of blue byte
-uint8_t Adafruit_NeoPixel_wOffset;    ///< Index of white (==rOffset if no white)
-static uint32_t endTime;   ///< Latch timing reference
 
 /*!
   @brief   NeoPixel constructor when length, pin and pixel type are known
@@ -70,90 +59,302 @@ static uint32_t endTime;   ///< Latch timing reference
               pixel.
   @return  Adafruit_NeoPixel object. Call the begin() function before use.
 */
-void Adafruit_NeoPixel_init(uint8_t *new_pixels, uint16_t length, neoPixelType t) {
-  begun = false;
-  Adafruit_NeoPixel_brightness = 0;
-  endTime = 0 ;
-  Adafruit_NeoPixel_wOffset = (t >> 6) & 0b11; // See notes in header file
-  Adafruit_NeoPixel_rOffset = (t >> 4) & 0b11; // regarding R/G/B/W offsets
-  Adafruit_NeoPixel_gOffset = (t >> 2) & 0b11;
-  Adafruit_NeoPixel_bOffset = t & 0b11;
-  Adafruit_NeoPixel_numBytes = length * ((Adafruit_NeoPixel_wOffset == Adafruit_NeoPixel_rOffset) ? 3 : 4);
-  Adafruit_NeoPixel_pixels = new_pixels;
-  Adafruit_NeoPixel_memset(Adafruit_NeoPixel_pixels, 0, Adafruit_NeoPixel_numBytes);
-  Adafruit_NeoPixel_numLEDs = length;
+void Adafruit_NeoPixel_init(Adafruit_NeoPixel *strip, uint8_t *new_pixels, uint16_t length, neoPixelType t) {
+  strip->begun = false;
+  strip->brightness = 0;
+  strip->endTime = 0 ;
+  strip->micros = NULL;
+#ifdef NEO_FIXED_TYPE
+  t = NEO_FIXED_TYPE;
+#endif
+  strip->wOffset = (t >> 6) & 0b11; // See notes in header file
+  strip->rOffset = (t >> 4) & 0b11; // regarding R/G/B/W offsets
+  strip->gOffset = (t >> 2) & 0b11;
+  strip->bOffset = t & 0b11;
+  strip->numBytes = length * NEO_BYTES_PER_PIXEL(strip);
+  strip->pixels = new_pixels;
+  strip->txPixels = NULL;
+  strip->txFront = NULL;
+  strip->transport = NULL;
+  strip->txBusy = false;
+  strip->staleFirst = 0xFFFF;
+  strip->staleLast = 0;
+  strip->limit = 256;
+  Adafruit_NeoPixel_memset(strip->pixels, 0, strip->numBytes);
+  Adafruit_NeoPixel_memset(strip->sums, 0, sizeof(strip->sums));
+  strip->numLEDs = length;
+  // the LEDs' state is unknown until the first frame went out
+  Adafruit_NeoPixel_clearDirty(strip);
+  Adafruit_NeoPixel_markAllDirty(strip);
 }
 
 /*!
   @brief   Deallocate Adafruit_NeoPixel object, set data pin back to INPUT.
 */
-void Adafruit_NeoPixel_deinit() {
-#if SUPPORT_MALLOC
-  free(pixels);
-#endif
+void Adafruit_NeoPixel_deinit(Adafruit_NeoPixel *strip) {
+  // the pixel buffer is owned by the caller (e.g. the WS2812FX arena)
+  strip->pixels = NULL;
+  strip->txPixels = NULL;
+  strip->txFront = NULL;
+  strip->numLEDs = 0;
+  strip->numBytes = 0;
+  strip->begun = false;
 }
 
-bool Adafruit_NeoPixel_canShow(void) {
-  // It's normal and possible for endTime to exceed micros() if the
-  // 32-bit clock counter has rolled over (about every 70 minutes).
-  // Since both are uint32_t, a negative delta correctly maps back to
-  // positive space, and it would seem like the subtraction below would
-  // suffice. But a problem arises if code invokes show() very
-  // infrequently...the micros() counter may roll over MULTIPLE times in
-  // that interval, the delta calculation is no longer correct and the
-  // next update may stall for a very long time. The check below resets
-  // the latch counter if a rollover has occurred. This can cause an
-  // extra delay of up to 300 microseconds in the rare case where a
-  // show() call happens precisely around the rollover, but that's
-  // neither likely nor especially harmful, vs. other code that might
-  // stall for 30+ minutes, or having to document and frequently remind
-  // and/or provide tech support explaining an unintuitive need for
-  // show() calls at least once an hour.
-  uint32_t now = micros();
-  if (endTime > now) {
-    endTime = now;
-  }
-  return (now - endTime) >= 300L;
+bool Adafruit_NeoPixel_canShow(Adafruit_NeoPixel *strip) {
+  // The clock is a 64-bit microsecond counter, which doesn't roll over
+  // in any realistic uptime, so the old 32-bit micros() rollover
+  // workaround isn't needed anymore. Without a clock the latch can't be
+  // tracked and it's up to the caller to space out show() calls.
+  if (strip->txBusy)
+    return false; // still sending the previous frame
+  if (strip->micros == NULL)
+    return true;
+  return (strip->micros() - strip->endTime) >= 300L;
 }
 
-uint8_t *Adafruit_NeoPixel_getPixels(void) { 
-  return Adafruit_NeoPixel_pixels;
+uint8_t *Adafruit_NeoPixel_getPixels(Adafruit_NeoPixel *strip) { 
+  return strip->pixels;
 }
 
-uint16_t Adafruit_NeoPixel_numPixels(void) { 
-  return Adafruit_NeoPixel_numLEDs; 
+/*!
+  @brief   Hand over a second buffer, numBytes long, that show() sends to
+           the LEDs instead of the pixel buffer. With DEFERRED_BRIGHTNESS
+           the pixel buffer keeps the colors at full scale and brightness
+           is only applied when copying them into this buffer, so reading
+           pixels back is exact and brightness changes are lossless.
+  @param   tx_pixels  Transmit buffer, or NULL to send the pixel buffer.
+*/
+void Adafruit_NeoPixel_setTxBuffer(Adafruit_NeoPixel *strip, uint8_t *tx_pixels) {
+  strip->txPixels = tx_pixels;
+  Adafruit_NeoPixel_markAllDirty(strip);
 }
 
-static uint8_t Adafruit_NeoPixel_sine8(uint8_t x) {
-  return _NeoPixelSineTable[x]; // 0-255 in, 0-255 out
+/*!
+  @brief   Double buffer the output: txPixels is composed while the
+           transport is still sending this buffer, then the two swap.
+           Needs a transmit buffer (setTxBuffer()) of the same size.
+  @param   front  Second transmit buffer, or NULL to single buffer.
+*/
+void Adafruit_NeoPixel_setFrontBuffer(Adafruit_NeoPixel *strip, uint8_t *front) {
+  strip->txFront = front;
+  strip->staleFirst = 0xFFFF;
+  strip->staleLast = 0;
+  Adafruit_NeoPixel_markAllDirty(strip);
 }
 
-static uint8_t Adafruit_NeoPixel_gamma8(uint8_t x) {
-  return _NeoPixelGammaTable[x]; // 0-255 in, 0-255 out
+/*!
+  @brief   Send frames through an asynchronous transport (DMA, a worker
+           thread, ...) instead of port_write(). The transport is handed
+           the front buffer and must call txDone() once it is sent; until
+           then the buffer must not be touched and canShow() is false.
+*/
+void Adafruit_NeoPixel_setTransport(Adafruit_NeoPixel *strip,
+    void (*transport)(Adafruit_NeoPixel *strip, const uint8_t *data, uint16_t len)) {
+  strip->transport = transport;
 }
 
-static uint32_t Adafruit_NeoPixel_Color_rgb(uint8_t r, uint8_t g, uint8_t b) {
-  return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+/*!
+  @brief   Called by the transport (possibly from an interrupt or another
+           thread) when the last byte went out. Starts the latch time.
+*/
+void Adafruit_NeoPixel_txDone(Adafruit_NeoPixel *strip) {
+  if (strip->micros != NULL)
+    strip->endTime = strip->micros();
+  strip->txBusy = false;
+}
+
+/*!
+  @brief   Range of pixels (inclusive) that has to be composed into the
+           transmit buffer before the next frame goes out: the dirty
+           pixels plus, when double buffering, those the back buffer
+           missed while it was the front one. Empty if last < first.
+*/
+void Adafruit_NeoPixel_txRange(Adafruit_NeoPixel *strip, uint16_t *first, uint16_t *last) {
+  *first = strip->dirtyFirst;
+  *last = strip->dirtyLast;
+  if (strip->txFront && strip->staleFirst <= strip->staleLast) {
+    *first = min(*first, strip->staleFirst);
+    *last = max(*last, strip->staleLast);
+  }
+}
+
+/*!
+  @brief   Copy pixels first..last (inclusive) into the transmit buffer,
+           scaling every channel by scale/256.
+  @param   scale  0 (off) to 256 (unchanged).
+*/
+void Adafruit_NeoPixel_scaleSpan(Adafruit_NeoPixel *strip, uint16_t first, uint16_t last, uint16_t scale) {
+  if (first > last)
+    return;
+  Adafruit_NeoPixel_scaleCopy(strip, first, first, last - first + 1, scale);
+}
+
+/*!
+  @brief   Like scaleSpan(), but pixel src goes to transmit buffer pixel
+           dst, so a rotated span can be put back in order on the way out.
+  @param   count  Number of pixels.
+*/
+void Adafruit_NeoPixel_scaleCopy(Adafruit_NeoPixel *strip, uint16_t dst_first, uint16_t src_first, uint16_t count, uint16_t scale) {
+  if (!strip->txPixels || count == 0 ||
+      (uint32_t)dst_first + count > strip->numLEDs ||
+      (uint32_t)src_first + count > strip->numLEDs)
+    return;
+  uint8_t bytesPerPixel = NEO_BYTES_PER_PIXEL(strip);
+  const uint8_t *src = strip->pixels + src_first * bytesPerPixel;
+  uint8_t *dst = strip->txPixels + dst_first * bytesPerPixel;
+  uint16_t len = count * bytesPerPixel;
+
+  if (scale >= 256) {
+    Adafruit_NeoPixel_memmove(dst, src, len);
+    return;
+  }
+  // four channels per 32-bit word: the even and odd bytes are spread into
+  // 16-bit lanes, so each multiply scales two channels at once
+  uint16_t i = 0;
+  for (; i + 4 <= len; i += 4) {
+    uint32_t v = (uint32_t)src[i] | ((uint32_t)src[i + 1] << 8) |
+                 ((uint32_t)src[i + 2] << 16) | ((uint32_t)src[i + 3] << 24);
+    uint32_t even = (((v & 0x00FF00FF) * scale) >> 8) & 0x00FF00FF;
+    uint32_t odd = (((v >> 8) & 0x00FF00FF) * scale) & 0xFF00FF00;
+    v = even | odd;
+    dst[i] = (uint8_t)v;
+    dst[i + 1] = (uint8_t)(v >> 8);
+    dst[i + 2] = (uint8_t)(v >> 16);
+    dst[i + 3] = (uint8_t)(v >> 24);
+  }
+  for (; i < len; i++)
+    dst[i] = (src[i] * scale) >> 8;
 }
 
-static uint32_t Adafruit_NeoPixel_Color_rgbw(uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
-  return ((uint32_t)w << 24) | ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+uint16_t Adafruit_NeoPixel_numPixels(Adafruit_NeoPixel *strip) { 
+  return strip->numLEDs; 
 }
 
-void Adafruit_NeoPixel_port_init() {
+void Adafruit_NeoPixel_port_init(Adafruit_NeoPixel *strip) {
+  (void)strip;
   // #error "delete this comment and write your port init code."
 }
 
+/*!
+  @brief   Clock len bytes of pixel data out to the strip.
+*/
+void Adafruit_NeoPixel_port_write(Adafruit_NeoPixel *strip, const uint8_t *data, uint16_t len) {
+  (void)strip; (void)data; (void)len;
+  // #error "delete this comment and write your port transmit code."
+}
+
 /*!
   @brief   Configure NeoPixel pin for output.
 */
-void Adafruit_NeoPixel_begin(void) {
-  Adafruit_NeoPixel_port_init();
-  begun = true;
+void Adafruit_NeoPixel_begin(Adafruit_NeoPixel *strip) {
+  Adafruit_NeoPixel_port_init(strip);
+  strip->begun = true;
+}
+
+static void Adafruit_NeoPixel_compose(Adafruit_NeoPixel *strip) {
+  uint16_t first, last;
+  if (!strip->txPixels || !Adafruit_NeoPixel_isDirty(strip))
+    return;
+  Adafruit_NeoPixel_txRange(strip, &first, &last);
+#if DEFERRED_BRIGHTNESS
+  uint16_t scale = strip->brightness ? strip->brightness : 256;
+#else
+  uint16_t scale = 256; // brightness was applied when the pixels were set
+#endif
+  Adafruit_NeoPixel_scaleSpan(strip, first, min(last, strip->numLEDs - 1),
+                              (uint16_t)(((uint32_t)scale * strip->limit) >> 8));
+}
+
+/*!
+  @brief   Transmit pixel data in RAM to NeoPixels, applying the strip
+           brightness first if a transmit buffer is set (see
+           setTxBuffer()).
+*/
+void Adafruit_NeoPixel_show(Adafruit_NeoPixel *strip) {
+  if (!strip->txFront)
+    while (strip->txBusy) // don't compose into the buffer that's going out
+      ;
+  Adafruit_NeoPixel_compose(strip);
+  Adafruit_NeoPixel_transmit(strip);
+}
+
+/*!
+  @brief   Non-blocking show(): if the transport and the latch are ready,
+           compose the frame and start sending it, otherwise return right
+           away and leave the frame pending. With a front buffer and an
+           asynchronous transport, rendering the next frame overlaps
+           sending this one.
+  @return  true if the frame went out (or there was nothing to send),
+           false if it has to be retried.
+*/
+bool Adafruit_NeoPixel_showAsync(Adafruit_NeoPixel *strip) {
+  if (!Adafruit_NeoPixel_isDirty(strip))
+    return true;
+  if (!Adafruit_NeoPixel_canShow(strip))
+    return false;
+  Adafruit_NeoPixel_compose(strip);
+  return Adafruit_NeoPixel_transmitAsync(strip);
+}
+
+static void Adafruit_NeoPixel_send(Adafruit_NeoPixel *strip) {
+  // Data is shifted along the chain, so a frame always starts at the first
+  // pixel, but it can stop after the last changed one: the pixels past it
+  // don't receive anything and keep what they latched last time.
+  const uint8_t *data = strip->txPixels ? strip->txPixels : strip->pixels;
+  uint16_t len = (strip->dirtyLast + 1) * NEO_BYTES_PER_PIXEL(strip);
+
+  if (strip->txFront && strip->txPixels) {
+    // the composed frame becomes the front buffer, the old front one is
+    // behind on whatever changed in this frame
+    uint8_t *tmp = strip->txFront;
+    strip->txFront = strip->txPixels;
+    strip->txPixels = tmp;
+    data = strip->txFront;
+    strip->staleFirst = strip->dirtyFirst;
+    strip->staleLast = strip->dirtyLast;
+  }
+  Adafruit_NeoPixel_clearDirty(strip);
+
+  if (strip->transport) {
+    strip->txBusy = true;
+    strip->transport(strip, data, len); // calls txDone() when finished
+    return;
+  }
+
+  // NRF52 may use PWM + DMA (if available), may not need to disable interrupt
+  // ESP32 may not disable interrupts because espShow() uses RMT which tries to acquire locks
+#if INTERRUPT_WHEN_SHOWING
+  noInterrupts(); // Need 100% focus on instruction timing
+#endif
+
+  Adafruit_NeoPixel_port_write(strip, data, len);
+
+#if INTERRUPT_WHEN_SHOWING
+  interrupts();
+#endif
+
+  if (strip->micros != NULL)
+    strip->endTime = strip->micros(); // Save EOD time for latch on next call
+}
+
+/*!
+  @brief   Non-blocking transmit(): start sending the composed frame if
+           the transport and the latch are ready.
+  @return  false if the frame has to be retried.
+*/
+bool Adafruit_NeoPixel_transmitAsync(Adafruit_NeoPixel *strip) {
+  if (!strip->pixels || !Adafruit_NeoPixel_isDirty(strip))
+    return true;
+  if (!Adafruit_NeoPixel_canShow(strip))
+    return false;
+  Adafruit_NeoPixel_send(strip);
+  return true;
 }
 
 /*!
-  @brief   Transmit pixel data in RAM to NeoPixels.
+  @brief   Send the transmit buffer (or the pixel buffer if there is none)
+           to the NeoPixels as is.
   @note    On most architectures, interrupts are temporarily disabled in
            order to achieve the correct NeoPixel signal timing. This means
            that the Arduino millis() and micros() functions, which require
@@ -163,9 +364,10 @@ void Adafruit_NeoPixel_begin(void) {
            specialized alternative or companion libraries exist that use
            very device-specific peripherals to work around it.
 */
-void Adafruit_NeoPixel_show(void) {
+void Adafruit_NeoPixel_transmit(Adafruit_NeoPixel *strip) {
 
-  if (!Adafruit_NeoPixel_pixels)
+  // Nothing changed since the last frame, the LEDs already show this.
+  if (!strip->pixels || !Adafruit_NeoPixel_isDirty(strip))
     return;
 
   // Data latch = 300+ microsecond pause in the output stream. Rather than
@@ -174,7 +376,7 @@ void Adafruit_NeoPixel_show(void) {
   // subsequent round of data until the latch time has elapsed. This
   // allows the mainline code to start generating the next frame of data
   // rather than stalling for the latch.
-  while (!Adafruit_NeoPixel_canShow())
+  while (!Adafruit_NeoPixel_canShow(strip))
     ;
     // endTime is a private member (rather than global var) so that multiple
     // instances on different pins can be quickly issued in succession (each
@@ -190,18 +392,7 @@ void Adafruit_NeoPixel_show(void) {
     // state, computes 'pin high' and 'pin low' values, and writes these back
     // to the PORT register as needed.
 
-    // NRF52 may use PWM + DMA (if available), may not need to disable interrupt
-    // ESP32 may not disable interrupts because espShow() uses RMT which tries to acquire locks
-#if INTERRUPT_WHEN_SHOWING
-  noInterrupts(); // Need 100% focus on instruction timing
-#endif
-
-
-#if INTERRUPT_WHEN_SHOWING
-  interrupts();
-#endif
-
-  endTime = micros(); // Save EOD time for latch on next call
+  Adafruit_NeoPixel_send(strip);
 }
 
 /*!
@@ -212,25 +403,28 @@ void Adafruit_NeoPixel_show(void) {
   @param   g  Green brightness, 0 = minimum (off), 255 = maximum.
   @param   b  Blue brightness, 0 = minimum (off), 255 = maximum.
 */
-void Adafruit_NeoPixel_setPixelColor_nrgb(uint16_t n, uint8_t r, uint8_t g,
+void Adafruit_NeoPixel_setPixelColor_nrgb(Adafruit_NeoPixel *strip, uint16_t n, uint8_t r, uint8_t g,
                                       uint8_t b) {
 
-  if (n < Adafruit_NeoPixel_numLEDs) {
-    if (Adafruit_NeoPixel_brightness) { // See notes in setBrightness()
-      r = (r * Adafruit_NeoPixel_brightness) >> 8;
-      g = (g * Adafruit_NeoPixel_brightness) >> 8;
-      b = (b * Adafruit_NeoPixel_brightness) >> 8;
+  if (n < strip->numLEDs) {
+#if !DEFERRED_BRIGHTNESS
+    if (strip->brightness) { // See notes in setBrightness()
+      r = (r * strip->brightness) >> 8;
+      g = (g * strip->brightness) >> 8;
+      b = (b * strip->brightness) >> 8;
     }
-    uint8_t *p;
-    if (Adafruit_NeoPixel_wOffset == Adafruit_NeoPixel_rOffset) { // Is an RGB-type strip
-      p = &Adafruit_NeoPixel_pixels[n * 3];     // 3 bytes per pixel
+#endif
+    uint8_t *p, changed = 0;
+    if (NEO_IS_RGB(strip)) { // Is an RGB-type strip
+      p = &strip->pixels[n * 3];     // 3 bytes per pixel
     } else {                  // Is a WRGB-type strip
-      p = &Adafruit_NeoPixel_pixels[n * 4];     // 4 bytes per pixel
-      p[Adafruit_NeoPixel_wOffset] = 0;         // But only R,G,B passed -- set W to 0
+      p = &strip->pixels[n * 4];     // 4 bytes per pixel
+      changed = Adafruit_NeoPixel_storeChannel(strip, p, NEO_W_OFFSET(strip), 0); // But only R,G,B passed -- set W to 0
     }
-    p[Adafruit_NeoPixel_rOffset] = r; // R,G,B always stored
-    p[Adafruit_NeoPixel_gOffset] = g;
-    p[Adafruit_NeoPixel_bOffset] = b;
+    changed |= Adafruit_NeoPixel_storeChannel(strip, p, NEO_R_OFFSET(strip), r); // R,G,B always stored
+    changed |= Adafruit_NeoPixel_storeChannel(strip, p, NEO_G_OFFSET(strip), g);
+    changed |= Adafruit_NeoPixel_storeChannel(strip, p, NEO_B_OFFSET(strip), b);
+    if (changed) Adafruit_NeoPixel_markDirty(strip, n, n);
   }
 }
 
@@ -244,26 +438,29 @@ void Adafruit_NeoPixel_setPixelColor_nrgb(uint16_t n, uint8_t r, uint8_t g,
   @param   w  White brightness, 0 = minimum (off), 255 = maximum, ignored
               if using RGB pixels.
 */
-void Adafruit_NeoPixel_setPixelColor_nrgbw(uint16_t n, uint8_t r, uint8_t g,
+void Adafruit_NeoPixel_setPixelColor_nrgbw(Adafruit_NeoPixel *strip, uint16_t n, uint8_t r, uint8_t g,
                                       uint8_t b, uint8_t w) {
 
-  if (n < Adafruit_NeoPixel_numLEDs) {
-    if (Adafruit_NeoPixel_brightness) { // See notes in setBrightness()
-      r = (r * Adafruit_NeoPixel_brightness) >> 8;
-      g = (g * Adafruit_NeoPixel_brightness) >> 8;
-      b = (b * Adafruit_NeoPixel_brightness) >> 8;
-      w = (w * Adafruit_NeoPixel_brightness) >> 8;
+  if (n < strip->numLEDs) {
+#if !DEFERRED_BRIGHTNESS
+    if (strip->brightness) { // See notes in setBrightness()
+      r = (r * strip->brightness) >> 8;
+      g = (g * strip->brightness) >> 8;
+      b = (b * strip->brightness) >> 8;
+      w = (w * strip->brightness) >> 8;
     }
-    uint8_t *p;
-    if (Adafruit_NeoPixel_wOffset == Adafruit_NeoPixel_rOffset) { // Is an RGB-type strip
-      p = &Adafruit_NeoPixel_pixels[n * 3];     // 3 bytes per pixel (ignore W)
+#endif
+    uint8_t *p, changed = 0;
+    if (NEO_IS_RGB(strip)) { // Is an RGB-type strip
+      p = &strip->pixels[n * 3];     // 3 bytes per pixel (ignore W)
     } else {                  // Is a WRGB-type strip
-      p = &Adafruit_NeoPixel_pixels[n * 4];     // 4 bytes per pixel
-      p[Adafruit_NeoPixel_wOffset] = w;         // Store W
+      p = &strip->pixels[n * 4];     // 4 bytes per pixel
+      changed = Adafruit_NeoPixel_storeChannel(strip, p, NEO_W_OFFSET(strip), w); // Store W
     }
-    p[Adafruit_NeoPixel_rOffset] = r; // Store R,G,B
-    p[Adafruit_NeoPixel_gOffset] = g;
-    p[Adafruit_NeoPixel_bOffset] = b;
+    changed |= Adafruit_NeoPixel_storeChannel(strip, p, NEO_R_OFFSET(strip), r); // Store R,G,B
+    changed |= Adafruit_NeoPixel_storeChannel(strip, p, NEO_G_OFFSET(strip), g);
+    changed |= Adafruit_NeoPixel_storeChannel(strip, p, NEO_B_OFFSET(strip), b);
+    if (changed) Adafruit_NeoPixel_markDirty(strip, n, n);
   }
 }
 
@@ -274,24 +471,30 @@ void Adafruit_NeoPixel_setPixelColor_nrgbw(uint16_t n, uint8_t r, uint8_t g,
               pixels) or ignored (for RGB pixels), next is red, then green,
               and least significant byte is blue.
 */
-void Adafruit_NeoPixel_setPixelColor_nc(uint16_t n, uint32_t c) {
-  if (n < Adafruit_NeoPixel_numLEDs) {
-    uint8_t *p, r = (uint8_t)(c >> 16), g = (uint8_t)(c >> 8), b = (uint8_t)c;
-    if (Adafruit_NeoPixel_brightness) { // See notes in setBrightness()
-      r = (r * Adafruit_NeoPixel_brightness) >> 8;
-      g = (g * Adafruit_NeoPixel_brightness) >> 8;
-      b = (b * Adafruit_NeoPixel_brightness) >> 8;
+void Adafruit_NeoPixel_setPixelColor_nc(Adafruit_NeoPixel *strip, uint16_t n, uint32_t c) {
+  if (n < strip->numLEDs) {
+    uint8_t *p, r = (uint8_t)(c >> 16), g = (uint8_t)(c >> 8), b = (uint8_t)c, changed = 0;
+#if !DEFERRED_BRIGHTNESS
+    if (strip->brightness) { // See notes in setBrightness()
+      r = (r * strip->brightness) >> 8;
+      g = (g * strip->brightness) >> 8;
+      b = (b * strip->brightness) >> 8;
     }
-    if (Adafruit_NeoPixel_wOffset == Adafruit_NeoPixel_rOffset) {
-      p = &Adafruit_NeoPixel_pixels[n * 3];
+#endif
+    if (NEO_IS_RGB(strip)) {
+      p = &strip->pixels[n * 3];
     } else {
-      p = &Adafruit_NeoPixel_pixels[n * 4];
+      p = &strip->pixels[n * 4];
       uint8_t w = (uint8_t)(c >> 24);
-      p[Adafruit_NeoPixel_wOffset] = Adafruit_NeoPixel_brightness ? ((w * Adafruit_NeoPixel_brightness) >> 8) : w;
+#if !DEFERRED_BRIGHTNESS
+      if (strip->brightness) w = (w * strip->brightness) >> 8;
+#endif
+      changed = Adafruit_NeoPixel_storeChannel(strip, p, NEO_W_OFFSET(strip), w);
     }
-    p[Adafruit_NeoPixel_rOffset] = r;
-    p[Adafruit_NeoPixel_gOffset] = g;
-    p[Adafruit_NeoPixel_bOffset] = b;
+    changed |= Adafruit_NeoPixel_storeChannel(strip, p, NEO_R_OFFSET(strip), r);
+    changed |= Adafruit_NeoPixel_storeChannel(strip, p, NEO_G_OFFSET(strip), g);
+    changed |= Adafruit_NeoPixel_storeChannel(strip, p, NEO_B_OFFSET(strip), b);
+    if (changed) Adafruit_NeoPixel_markDirty(strip, n, n);
   }
 }
 
@@ -306,27 +509,79 @@ void Adafruit_NeoPixel_setPixelColor_nc(uint16_t n, uint32_t c) {
   @param   count  Number of pixels to fill, as a positive value. Passing
                   0 or leaving unspecified will fill to end of strip.
 */
-void Adafruit_NeoPixel_fill(uint32_t c, uint16_t first, uint16_t count) {
-  uint16_t i, end;
+void Adafruit_NeoPixel_fill(Adafruit_NeoPixel *strip, uint32_t c, uint16_t first, uint16_t count) {
+  uint8_t pixel[4];
+  uint8_t r = (uint8_t)(c >> 16), g = (uint8_t)(c >> 8), b = (uint8_t)c, w = (uint8_t)(c >> 24);
+#if !DEFERRED_BRIGHTNESS
+  if (strip->brightness) { // See notes in setBrightness()
+    r = (r * strip->brightness) >> 8;
+    g = (g * strip->brightness) >> 8;
+    b = (b * strip->brightness) >> 8;
+    w = (w * strip->brightness) >> 8;
+  }
+#endif
+  // Encode the color once in device byte order, then replicate it
+  pixel[NEO_W_OFFSET(strip)] = w; // overwritten by R on RGB strips
+  pixel[NEO_R_OFFSET(strip)] = r;
+  pixel[NEO_G_OFFSET(strip)] = g;
+  pixel[NEO_B_OFFSET(strip)] = b;
+  Adafruit_NeoPixel_fillSpan(strip, pixel, first, count);
+}
+
+static inline bool Adafruit_NeoPixel_pixelEquals(const uint8_t *a, const uint8_t *b, uint8_t bytesPerPixel) {
+  return a[0] == b[0] && a[1] == b[1] && a[2] == b[2] && (bytesPerPixel == 3 || a[3] == b[3]);
+}
+
+/*!
+  @brief   Fill all or part of the strip with a pixel that is already in
+           device byte order (3 or 4 bytes), as is. Only the part that
+           actually changes is written and marked dirty.
+  @param   pixel  Pixel bytes, in the order they go out to the LEDs.
+  @param   first  Index of first pixel to fill.
+  @param   count  Number of pixels to fill, 0 fills to end of strip.
+*/
+void Adafruit_NeoPixel_fillSpan(Adafruit_NeoPixel *strip, const uint8_t *pixel, uint16_t first, uint16_t count) {
+  uint16_t end;
 
-  if (first >= Adafruit_NeoPixel_numLEDs) {
+  if (first >= strip->numLEDs) {
     return; // If first LED is past end of strip, nothing to do
   }
 
   // Calculate the index ONE AFTER the last pixel to fill
-  if (count == 0) {
-    // Fill to end of strip
-    end = Adafruit_NeoPixel_numLEDs;
+  if (count == 0 || count > strip->numLEDs - first) {
+    end = strip->numLEDs;
   } else {
-    // Ensure that the loop won't go past the last pixel
     end = first + count;
-    if (end > Adafruit_NeoPixel_numLEDs)
-      end = Adafruit_NeoPixel_numLEDs;
   }
 
-  for (i = first; i < end; i++) {
-    Adafruit_NeoPixel_setPixelColor_nc(i, c);
+  uint8_t bytesPerPixel = NEO_BYTES_PER_PIXEL(strip);
+  uint8_t *p = strip->pixels;
+  uint16_t last = end - 1;
+
+  // Trim the pixels that already have the color from both ends, most
+  // frames of a static or slowly changing effect don't change anything.
+  while (first <= last && Adafruit_NeoPixel_pixelEquals(p + first * bytesPerPixel, pixel, bytesPerPixel))
+    first++;
+  if (first > last)
+    return;
+  while (Adafruit_NeoPixel_pixelEquals(p + last * bytesPerPixel, pixel, bytesPerPixel))
+    last--;
+
+  // Write the first pixel, then keep doubling the filled part by copying it
+  // onto the remainder: a handful of bulk copies rather than one store per
+  // channel per LED.
+  Adafruit_NeoPixel_subSums(strip, first, last);
+  for (uint8_t i = 0; i < bytesPerPixel; i++)
+    strip->sums[i] += (uint32_t)pixel[i] * (last - first + 1);
+  uint8_t *dst = p + first * bytesPerPixel;
+  size_t len = (size_t)(last - first + 1) * bytesPerPixel, done = bytesPerPixel;
+  Adafruit_NeoPixel_memmove(dst, pixel, bytesPerPixel);
+  while (done < len) {
+    size_t n = min(done, len - done);
+    Adafruit_NeoPixel_memmove(dst + done, dst, n);
+    done += n;
   }
+  Adafruit_NeoPixel_markDirty(strip, first, last);
 }
 
 /*!
@@ -439,38 +694,44 @@ uint32_t Adafruit_NeoPixel_ColorHSV(uint16_t hue, uint8_t sat, uint8_t val) {
            was previously written with one of the setPixelColor() functions.
            This gets more pronounced at lower brightness levels.
 */
-uint32_t Adafruit_NeoPixel_getPixelColor(uint16_t n) {
-  if (n >= Adafruit_NeoPixel_numLEDs)
+uint32_t Adafruit_NeoPixel_getPixelColor(Adafruit_NeoPixel *strip, uint16_t n) {
+  if (n >= strip->numLEDs)
     return 0; // Out of bounds, return no color.
 
   uint8_t *p;
 
-  if (Adafruit_NeoPixel_wOffset == Adafruit_NeoPixel_rOffset) { // Is RGB-type device
-    p = &Adafruit_NeoPixel_pixels[n * 3];
-    if (Adafruit_NeoPixel_brightness) {
+  if (NEO_IS_RGB(strip)) { // Is RGB-type device
+    p = &strip->pixels[n * 3];
+#if !DEFERRED_BRIGHTNESS // otherwise the buffer holds the colors at full scale
+    if (strip->brightness) {
       // Stored color was decimated by setBrightness(). Returned value
       // attempts to scale back to an approximation of the original 24-bit
       // value used when setting the pixel color, but there will always be
       // some error -- those bits are simply gone. Issue is most
       // pronounced at low brightness levels.
-      return (((uint32_t)(p[Adafruit_NeoPixel_rOffset] << 8) / Adafruit_NeoPixel_brightness) << 16) |
-             (((uint32_t)(p[Adafruit_NeoPixel_gOffset] << 8) / Adafruit_NeoPixel_brightness) << 8) |
-             ((uint32_t)(p[Adafruit_NeoPixel_bOffset] << 8) / Adafruit_NeoPixel_brightness);
-    } else {
+      return (((uint32_t)(p[NEO_R_OFFSET(strip)] << 8) / strip->brightness) << 16) |
+             (((uint32_t)(p[NEO_G_OFFSET(strip)] << 8) / strip->brightness) << 8) |
+             ((uint32_t)(p[NEO_B_OFFSET(strip)] << 8) / strip->brightness);
+    } else
+#endif
+    {
       // No brightness adjustment has been made -- return 'raw' color
-      return ((uint32_t)p[Adafruit_NeoPixel_rOffset] << 16) | ((uint32_t)p[Adafruit_NeoPixel_gOffset] << 8) |
-             (uint32_t)p[Adafruit_NeoPixel_bOffset];
+      return ((uint32_t)p[NEO_R_OFFSET(strip)] << 16) | ((uint32_t)p[NEO_G_OFFSET(strip)] << 8) |
+             (uint32_t)p[NEO_B_OFFSET(strip)];
     }
   } else { // Is RGBW-type device
-    p = &Adafruit_NeoPixel_pixels[n * 4];
-    if (Adafruit_NeoPixel_brightness) { // Return scaled color
-      return (((uint32_t)(p[Adafruit_NeoPixel_wOffset] << 8) / Adafruit_NeoPixel_brightness) << 24) |
-             (((uint32_t)(p[Adafruit_NeoPixel_rOffset] << 8) / Adafruit_NeoPixel_brightness) << 16) |
-             (((uint32_t)(p[Adafruit_NeoPixel_gOffset] << 8) / Adafruit_NeoPixel_brightness) << 8) |
-             ((uint32_t)(p[Adafruit_NeoPixel_bOffset] << 8) / Adafruit_NeoPixel_brightness);
-    } else { // Return raw color
-      return ((uint32_t)p[Adafruit_NeoPixel_wOffset] << 24) | ((uint32_t)p[Adafruit_NeoPixel_rOffset] << 16) |
-             ((uint32_t)p[Adafruit_NeoPixel_gOffset] << 8) | (uint32_t)p[Adafruit_NeoPixel_bOffset];
+    p = &strip->pixels[n * 4];
+#if !DEFERRED_BRIGHTNESS
+    if (strip->brightness) { // Return scaled color
+      return (((uint32_t)(p[NEO_W_OFFSET(strip)] << 8) / strip->brightness) << 24) |
+             (((uint32_t)(p[NEO_R_OFFSET(strip)] << 8) / strip->brightness) << 16) |
+             (((uint32_t)(p[NEO_G_OFFSET(strip)] << 8) / strip->brightness) << 8) |
+             ((uint32_t)(p[NEO_B_OFFSET(strip)] << 8) / strip->brightness);
+    } else
+#endif
+    { // Return raw color
+      return ((uint32_t)p[NEO_W_OFFSET(strip)] << 24) | ((uint32_t)p[NEO_R_OFFSET(strip)] << 16) |
+             ((uint32_t)p[NEO_G_OFFSET(strip)] << 8) | (uint32_t)p[NEO_B_OFFSET(strip)];
     }
   }
 }
@@ -490,7 +751,7 @@ uint32_t Adafruit_NeoPixel_getPixelColor(uint16_t n) {
            write-only resource, maintaining their own state to render each
            frame of an animation, not relying on read-modify-write.
 */
-void Adafruit_NeoPixel_setBrightness(uint8_t b) {
+void Adafruit_NeoPixel_setBrightness(Adafruit_NeoPixel *strip, uint8_t b) {
   // Stored brightness value is different than what's passed.
   // This simplifies the actual scaling math later, allowing a fast
   // 8x8-bit multiply and taking the MSB. 'brightness' is a uint8_t,
@@ -498,7 +759,15 @@ void Adafruit_NeoPixel_setBrightness(uint8_t b) {
   // (color values are interpreted literally; no scaling), 1 = min
   // brightness (off), 255 = just below max brightness.
   uint8_t newBrightness = b + 1;
-  if (newBrightness != Adafruit_NeoPixel_brightness) { // Compare against prior value
+#if DEFERRED_BRIGHTNESS
+  // The buffer is kept at full scale and show() applies the brightness on
+  // its way to the transmit buffer, so there's nothing to re-scale here.
+  if (newBrightness != strip->brightness) {
+    Adafruit_NeoPixel_markAllDirty(strip);
+    strip->brightness = newBrightness;
+  }
+#else
+  if (newBrightness != strip->brightness) { // Compare against prior value
     // Brightness has changed -- re-scale existing data in RAM,
     // This process is potentially "lossy," especially when increasing
     // brightness. The tight timing in the WS2811/WS2812 code means there
@@ -509,8 +778,8 @@ void Adafruit_NeoPixel_setBrightness(uint8_t b) {
     // the limited number of steps (quantization) in the old data will be
     // quite visible in the re-scaled version. For a non-destructive
     // change, you'll need to re-render the full strip data. C'est la vie.
-    uint8_t c, *ptr = Adafruit_NeoPixel_pixels,
-               oldBrightness = Adafruit_NeoPixel_brightness - 1; // De-wrap old brightness value
+    uint8_t c, *ptr = strip->pixels,
+               oldBrightness = strip->brightness - 1; // De-wrap old brightness value
     uint16_t scale;
     if (oldBrightness == 0)
       scale = 0; // Avoid /0
@@ -518,40 +787,84 @@ void Adafruit_NeoPixel_setBrightness(uint8_t b) {
       scale = 65535 / oldBrightness;
     else
       scale = (((uint16_t)newBrightness << 8) - 1) / oldBrightness;
-    for (uint16_t i = 0; i < Adafruit_NeoPixel_numBytes; i++) {
+    for (uint16_t i = 0; i < strip->numBytes; i++) {
       c = *ptr;
       *ptr++ = (c * scale) >> 8;
     }
-    Adafruit_NeoPixel_brightness = newBrightness;
+    Adafruit_NeoPixel_recountSums(strip);
+    Adafruit_NeoPixel_markAllDirty(strip);
+    strip->brightness = newBrightness;
   }
+#endif
 }
 
 /*!
   @brief   Retrieve the last-set brightness value for the strip.
   @return  Brightness value: 0 = minimum (off), 255 = maximum.
 */
-uint8_t Adafruit_NeoPixel_getBrightness(void) { return Adafruit_NeoPixel_brightness - 1; }
+uint8_t Adafruit_NeoPixel_getBrightness(Adafruit_NeoPixel *strip) { return strip->brightness - 1; }
 
 /*!
   @brief   Fill the whole NeoPixel strip with 0 / black / off.
 */
-void Adafruit_NeoPixel_clear(void) { Adafruit_NeoPixel_memset(Adafruit_NeoPixel_pixels, 0, Adafruit_NeoPixel_numBytes); }
-
-// A 32-bit variant of gamma8() that applies the same function
-// to all components of a packed RGB or WRGB value.
-static uint32_t Adafruit_NeoPixel_gamma32(uint32_t x) {
-  uint8_t *y = (uint8_t *)&x;
-  // All four bytes of a 32-bit value are filtered even if RGB (not WRGB),
-  // to avoid a bunch of shifting and masking that would be necessary for
-  // properly handling different endianisms (and each byte is a fairly
-  // trivial operation, so it might not even be wasting cycles vs a check
-  // and branch for the RGB case). In theory this might cause trouble *if*
-  // someone's storing information in the unused most significant byte
-  // of an RGB value, but this seems exceedingly rare and if it's
-  // encountered in reality they can mask values going in or coming out.
-  for (uint8_t i = 0; i < 4; i++)
-    y[i] = Adafruit_NeoPixel_gamma8(y[i]);
-  return x; // Packed 32-bit return
+void Adafruit_NeoPixel_clear(Adafruit_NeoPixel *strip) {
+  Adafruit_NeoPixel_memset(strip->pixels, 0, strip->numBytes);
+  Adafruit_NeoPixel_memset(strip->sums, 0, sizeof(strip->sums));
+  Adafruit_NeoPixel_markAllDirty(strip);
+}
+
+// Add (sign 1) or remove (sign -1) pixels first..last from the running sums.
+static void Adafruit_NeoPixel_sumSpan(Adafruit_NeoPixel *strip, uint16_t first, uint16_t last, int32_t sign) {
+  if (first > last || last >= strip->numLEDs) return;
+
+  uint8_t bytesPerPixel = NEO_BYTES_PER_PIXEL(strip);
+  const uint8_t *p = strip->pixels + first * bytesPerPixel, *end = strip->pixels + (last + 1) * bytesPerPixel;
+  uint32_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+  if (bytesPerPixel == 3) {
+    for (; p < end; p += 3) {
+      s0 += p[0];
+      s1 += p[1];
+      s2 += p[2];
+    }
+  } else {
+    for (; p < end; p += 4) {
+      s0 += p[0];
+      s1 += p[1];
+      s2 += p[2];
+      s3 += p[3];
+    }
+  }
+  strip->sums[0] += sign * s0;
+  strip->sums[1] += sign * s1;
+  strip->sums[2] += sign * s2;
+  strip->sums[3] += sign * s3;
+}
+
+/*!
+  @brief   Take pixels first..last (inclusive) out of the running channel
+           sums, before rewriting them through the getPixels() buffer.
+           Pair with addSums() once the new values are in.
+*/
+void Adafruit_NeoPixel_subSums(Adafruit_NeoPixel *strip, uint16_t first, uint16_t last) {
+  Adafruit_NeoPixel_sumSpan(strip, first, last, -1);
+}
+
+/*!
+  @brief   Put pixels first..last (inclusive) back into the running channel
+           sums, after rewriting them.
+*/
+void Adafruit_NeoPixel_addSums(Adafruit_NeoPixel *strip, uint16_t first, uint16_t last) {
+  Adafruit_NeoPixel_sumSpan(strip, first, last, 1);
+}
+
+/*!
+  @brief   Rebuild the running channel sums from the whole buffer, for code
+           that rewrote it directly without subSums()/addSums().
+*/
+void Adafruit_NeoPixel_recountSums(Adafruit_NeoPixel *strip) {
+  Adafruit_NeoPixel_memset(strip->sums, 0, sizeof(strip->sums));
+  if (strip->numLEDs) Adafruit_NeoPixel_sumSpan(strip, 0, strip->numLEDs - 1, 1);
 }
 
 /*!
@@ -572,13 +885,35 @@ static uint32_t Adafruit_NeoPixel_gamma32(uint32_t x) {
   @param   gammify     If true (default), apply gamma correction to colors
                        for better appearance.
 */
-void Adafruit_NeoPixel_rainbow(uint16_t first_hue, int8_t reps,
+void Adafruit_NeoPixel_rainbow(Adafruit_NeoPixel *strip, uint16_t first_hue, int8_t reps,
   uint8_t saturation, uint8_t brightness, bool gammify) {
-  for (uint16_t i=0; i<Adafruit_NeoPixel_numLEDs; i++) {
-    uint16_t hue = first_hue + (i * reps * 65536) / Adafruit_NeoPixel_numLEDs;
-    uint32_t color = Adafruit_NeoPixel_ColorHSV(hue, saturation, brightness);
-    if (gammify) color = Adafruit_NeoPixel_gamma32(color);
-    Adafruit_NeoPixel_setPixelColor_nc(i, color);
+  // Pixel i gets first_hue + i * reps * 65536 / numLEDs. Rather than a
+  // divide per pixel, step the quotient and remainder of reps * 65536 /
+  // numLEDs along (same rounding as the divide, towards zero).
+  uint16_t hues[32];
+  uint32_t colors[32];
+  uint32_t span = (uint32_t)(reps < 0 ? -reps : reps) << 16;
+  uint32_t quot = strip->numLEDs ? span / strip->numLEDs : 0;
+  uint32_t rem = strip->numLEDs ? span % strip->numLEDs : 0;
+  uint32_t offset = 0, frac = 0;
+
+  for (uint16_t i = 0; i < strip->numLEDs; i += 32) {
+    uint16_t n = min(32, strip->numLEDs - i);
+    for (uint16_t k = 0; k < n; k++) {
+      hues[k] = reps < 0 ? first_hue - (uint16_t)offset : first_hue + (uint16_t)offset;
+      offset += quot;
+      frac += rem;
+      if (frac >= strip->numLEDs) {
+        frac -= strip->numLEDs;
+        offset++;
+      }
+    }
+    Adafruit_NeoPixel_hsvToRgbSpan(colors, hues, saturation, brightness, n);
+    for (uint16_t k = 0; k < n; k++) {
+      uint32_t color = colors[k];
+      if (gammify) color = Adafruit_NeoPixel_gamma32(color);
+      Adafruit_NeoPixel_setPixelColor_nc(strip, i + k, color);
+    }
   }
 }
 
@@ -608,7 +943,7 @@ char Adafruit_NeoPixel_tolower(char c) {
         return c;
     }
 }
-static neoPixelType Adafruit_NeoPixel_str2order(const char *v) {
+neoPixelType Adafruit_NeoPixel_str2order(const char *v) {
   int8_t r = 0, g = 0, b = 0, w = -1;
   if (v) {
     char c;
@@ -37,6 +37,7 @@
 #define ADAFRUIT_NEOPIXEL_H
 
 #include "Adafruit_NeoPixel_defines.h"
+#include "ws2812_user_def.h"
 
 // The order of primary colors in the NeoPixel data stream can vary among
 // device types, manufacturers and even different revisions of the same
@@ -109,6 +110,24 @@
 
 typedef uint8_t neoPixelType; ///< 3rd arg to Adafruit_NeoPixel constructor
 
+// Byte offsets of the color channels within a pixel. If NEO_FIXED_TYPE is
+// defined (e.g. NEO_GRB) the pixel type is fixed at build time, the offsets
+// become constants and pixel accesses compile to plain stores; the type
+// passed to init() is then ignored.
+#ifdef NEO_FIXED_TYPE
+#define NEO_W_OFFSET(strip) ((NEO_FIXED_TYPE >> 6) & 0b11)
+#define NEO_R_OFFSET(strip) ((NEO_FIXED_TYPE >> 4) & 0b11)
+#define NEO_G_OFFSET(strip) ((NEO_FIXED_TYPE >> 2) & 0b11)
+#define NEO_B_OFFSET(strip) (NEO_FIXED_TYPE & 0b11)
+#else
+#define NEO_W_OFFSET(strip) ((strip)->wOffset)
+#define NEO_R_OFFSET(strip) ((strip)->rOffset)
+#define NEO_G_OFFSET(strip) ((strip)->gOffset)
+#define NEO_B_OFFSET(strip) ((strip)->bOffset)
+#endif
+#define NEO_IS_RGB(strip) (NEO_W_OFFSET(strip) == NEO_R_OFFSET(strip)) ///< 3 bytes per pixel, no white
+#define NEO_BYTES_PER_PIXEL(strip) (NEO_IS_RGB(strip) ? 3 : 4)
+
 
 // These two tables are declared outside the Adafruit_NeoPixel class
 // because some boards may require oldschool compilers that don't
@@ -169,28 +188,103 @@ static const uint8_t _NeoPixelGammaTable[256] = {
     218, 220, 223, 225, 227, 230, 232, 235, 237, 240, 242, 245, 247, 250, 252,
     255};
 
-extern uint16_t Adafruit_NeoPixel_numLEDs;
-extern uint16_t Adafruit_NeoPixel_numBytes;
-extern uint8_t Adafruit_NeoPixel_brightness;
-extern uint8_t *Adafruit_NeoPixel_pixels;
-extern uint8_t Adafruit_NeoPixel_rOffset;    ///< Red index within each 3- or 4-byte pixel
-extern uint8_t Adafruit_NeoPixel_gOffset;    ///< Index of green byte
-extern uint8_t Adafruit_NeoPixel_bOffset;    ///< Index of blue byte
-extern uint8_t Adafruit_NeoPixel_wOffset;    ///< Index of white (==rOffset if no white)
+typedef struct Adafruit_NeoPixel {
+  bool begun;         ///< true if begin() previously called
+  uint16_t numLEDs;   ///< Number of RGB LEDs in strip
+  uint16_t numBytes;  ///< Size of 'pixels' buffer below
+  int16_t pin;        ///< Output pin number (-1 if not yet set)
+  uint8_t brightness; ///< Strip brightness 0-255 (stored as +1)
+  uint8_t *pixels;    ///< Holds LED color values (3 or 4 bytes each)
+  uint8_t *txPixels;  ///< Brightness-scaled copy of pixels sent to the LEDs (NULL if none)
+  uint8_t rOffset;    ///< Red index within each 3- or 4-byte pixel
+  uint8_t gOffset;    ///< Index of green byte
+  uint8_t bOffset;    ///< Index of blue byte
+  uint8_t wOffset;    ///< Index of white (==rOffset if no white)
+  uint64_t endTime;   ///< Latch timing reference (micros)
+  uint64_t (*micros)(void); ///< 64-bit monotonic microsecond clock, NULL if none
+  uint16_t dirtyFirst; ///< First pixel changed since last show()
+  uint16_t dirtyLast;  ///< Last pixel changed since last show() (empty if < dirtyFirst)
+  uint8_t *txFront;    ///< Buffer handed to the transport, swapped with txPixels (NULL if single buffered)
+  uint16_t staleFirst; ///< Pixels txPixels is behind txFront on (empty if < staleFirst)
+  uint16_t staleLast;
+  void (*transport)(struct Adafruit_NeoPixel *strip, const uint8_t *data, uint16_t len); ///< Asynchronous output (NULL: port_write())
+  volatile bool txBusy; ///< The transport hasn't called txDone() yet
+  uint32_t sums[4];     ///< Running total of each byte position over all pixels (device order)
+  uint16_t limit;       ///< Extra output scale of the power limiter, 256 = none (needs txPixels)
+} Adafruit_NeoPixel;
+
+/*!
+  @brief   Record that pixels first..last (inclusive) have changed since
+           the last show(). Anything writing to the buffer returned by
+           getPixels() directly must call this, or the change may not be
+           transmitted. It must also keep the channel sums right, by
+           calling subSums() before and addSums() after rewriting a range,
+           or recountSums() when done.
+*/
+static inline void Adafruit_NeoPixel_markDirty(Adafruit_NeoPixel *strip, uint16_t first, uint16_t last) {
+  if (first < strip->dirtyFirst) strip->dirtyFirst = first;
+  if (last > strip->dirtyLast) strip->dirtyLast = last;
+}
+
+static inline void Adafruit_NeoPixel_markAllDirty(Adafruit_NeoPixel *strip) {
+  if (strip->numLEDs) Adafruit_NeoPixel_markDirty(strip, 0, strip->numLEDs - 1);
+}
+
+/*!
+  @brief   Store one channel byte of pixel p, keeping the running sums up to
+           date.
+  @param   p       First byte of the pixel in the buffer.
+  @param   offset  Channel offset within the pixel (NEO_x_OFFSET()).
+  @return  Non-zero if the byte changed.
+*/
+static inline uint8_t Adafruit_NeoPixel_storeChannel(Adafruit_NeoPixel *strip, uint8_t *p, uint8_t offset, uint8_t v) {
+  uint8_t old = p[offset];
+  strip->sums[offset] += (uint32_t)v - old;
+  p[offset] = v;
+  return old ^ v;
+}
+
+/*!
+  @brief   Check whether any pixel has changed since the last show().
+*/
+static inline bool Adafruit_NeoPixel_isDirty(Adafruit_NeoPixel *strip) {
+  return strip->dirtyFirst <= strip->dirtyLast;
+}
+
+static inline void Adafruit_NeoPixel_clearDirty(Adafruit_NeoPixel *strip) {
+  strip->dirtyFirst = 0xFFFF;
+  strip->dirtyLast = 0;
+}
 
 // Constructor: number of LEDs, pin number, LED type
 // void Adafruit_NeoPixel_n_pin_type(uint16_t n, int16_t pin = 6,
 //                   neoPixelType type = NEO_GRB + NEO_KHZ800);
-void Adafruit_NeoPixel_init(uint8_t *new_pixels, uint16_t length, neoPixelType t);
+void Adafruit_NeoPixel_init(Adafruit_NeoPixel *strip, uint8_t *new_pixels, uint16_t length, neoPixelType t);
 
-void Adafruit_NeoPixel_begin(void);
-void Adafruit_NeoPixel_show(void);
-void Adafruit_NeoPixel_setPixelColor_nrgb(uint16_t n, uint8_t r, uint8_t g, uint8_t b);
-void Adafruit_NeoPixel_setPixelColor_nrgbw(uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w);
-void Adafruit_NeoPixel_setPixelColor_nc(uint16_t n, uint32_t c);
-void Adafruit_NeoPixel_fill(uint32_t c, uint16_t first, uint16_t count);// uint32_t c = 0, uint16_t first = 0, uint16_t count = 0
-void Adafruit_NeoPixel_setBrightness(uint8_t);
-void Adafruit_NeoPixel_clear(void);
+void Adafruit_NeoPixel_deinit(Adafruit_NeoPixel *strip);
+void Adafruit_NeoPixel_begin(Adafruit_NeoPixel *strip);
+void Adafruit_NeoPixel_port_write(Adafruit_NeoPixel *strip, const uint8_t *data, uint16_t len);
+void Adafruit_NeoPixel_show(Adafruit_NeoPixel *strip);
+void Adafruit_NeoPixel_transmit(Adafruit_NeoPixel *strip);
+void Adafruit_NeoPixel_setTxBuffer(Adafruit_NeoPixel *strip, uint8_t *tx_pixels);
+void Adafruit_NeoPixel_setFrontBuffer(Adafruit_NeoPixel *strip, uint8_t *front);
+void Adafruit_NeoPixel_setTransport(Adafruit_NeoPixel *strip, void (*transport)(Adafruit_NeoPixel *strip, const uint8_t *data, uint16_t len));
+void Adafruit_NeoPixel_txDone(Adafruit_NeoPixel *strip);
+void Adafruit_NeoPixel_txRange(Adafruit_NeoPixel *strip, uint16_t *first, uint16_t *last);
+bool Adafruit_NeoPixel_showAsync(Adafruit_NeoPixel *strip);
+bool Adafruit_NeoPixel_transmitAsync(Adafruit_NeoPixel *strip);
+void Adafruit_NeoPixel_scaleSpan(Adafruit_NeoPixel *strip, uint16_t first, uint16_t last, uint16_t scale);
+void Adafruit_NeoPixel_scaleCopy(Adafruit_NeoPixel *strip, uint16_t dst_first, uint16_t src_first, uint16_t count, uint16_t scale);
+void Adafruit_NeoPixel_subSums(Adafruit_NeoPixel *strip, uint16_t first, uint16_t last);
+void Adafruit_NeoPixel_addSums(Adafruit_NeoPixel *strip, uint16_t first, uint16_t last);
+void Adafruit_NeoPixel_recountSums(Adafruit_NeoPixel *strip);
+void Adafruit_NeoPixel_setPixelColor_nrgb(Adafruit_NeoPixel *strip, uint16_t n, uint8_t r, uint8_t g, uint8_t b);
+void Adafruit_NeoPixel_setPixelColor_nrgbw(Adafruit_NeoPixel *strip, uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w);
+void Adafruit_NeoPixel_setPixelColor_nc(Adafruit_NeoPixel *strip, uint16_t n, uint32_t c);
+void Adafruit_NeoPixel_fill(Adafruit_NeoPixel *strip, uint32_t c, uint16_t first, uint16_t count);// uint32_t c = 0, uint16_t first = 0, uint16_t count = 0
+void Adafruit_NeoPixel_fillSpan(Adafruit_NeoPixel *strip, const uint8_t *pixel, uint16_t first, uint16_t count);
+void Adafruit_NeoPixel_setBrightness(Adafruit_NeoPixel *strip, uint8_t);
+void Adafruit_NeoPixel_clear(Adafruit_NeoPixel *strip);
 /*!
   @brief   Check whether a call to show() will start sending data
             immediately or will 'block' for a required interval. NeoPixels
@@ -204,7 +298,7 @@ void Adafruit_NeoPixel_clear(void);
   @return  1 or true if show() will start sending immediately, 0 or false
             if show() would block (meaning some idle time is available).
 */
-bool Adafruit_NeoPixel_canShow(void);
+bool Adafruit_NeoPixel_canShow(Adafruit_NeoPixel *strip);
 /*!
   @brief   Get a pointer directly to the NeoPixel data buffer in RAM.
             Pixel data is stored in a device-native format (a la the NEO_*
@@ -219,14 +313,14 @@ bool Adafruit_NeoPixel_canShow(void);
             writes past the ends of the buffer. Great power, great
             responsibility and all that.
 */
-uint8_t *Adafruit_NeoPixel_getPixels(void);
-uint8_t Adafruit_NeoPixel_getBrightness(void);
+uint8_t *Adafruit_NeoPixel_getPixels(Adafruit_NeoPixel *strip);
+uint8_t Adafruit_NeoPixel_getBrightness(Adafruit_NeoPixel *strip);
 /*!
   @brief   Return the number of pixels in an Adafruit_NeoPixel strip object.
   @return  Pixel count (0 if not set).
 */
-uint16_t Adafruit_NeoPixel_numPixels(void);
-uint32_t Adafruit_NeoPixel_getPixelColor(uint16_t n);
+uint16_t Adafruit_NeoPixel_numPixels(Adafruit_NeoPixel *strip);
+uint32_t Adafruit_NeoPixel_getPixelColor(Adafruit_NeoPixel *strip, uint16_t n);
 /*!
   @brief   An 8-bit integer sine wave function, not directly compatible
             with standard trigonometric units like radians or degrees.
@@ -239,7 +333,9 @@ uint32_t Adafruit_NeoPixel_getPixelColor(uint16_t n);
             a signed int8_t, but you'll most likely want unsigned as this
             output is often used for pixel brightness in animation effects.
 */
-uint8_t Adafruit_NeoPixel_sine8(uint8_t x);
+static inline uint8_t Adafruit_NeoPixel_sine8(uint8_t x) {
+  return _NeoPixelSineTable[x]; // 0-255 in, 0-255 out
+}
 /*!
   @brief   An 8-bit gamma-correction function for basic pixel brightness
             adjustment. Makes color transitions appear more perceptially
@@ -251,7 +347,9 @@ uint8_t Adafruit_NeoPixel_sine8(uint8_t x);
             NeoPixels in average tasks. If you need finer control you'll
             need to provide your own gamma-correction function instead.
 */
-static uint8_t Adafruit_NeoPixel_gamma8(uint8_t x);
+static inline uint8_t Adafruit_NeoPixel_gamma8(uint8_t x) {
+  return _NeoPixelGammaTable[x]; // 0-255 in, 0-255 out
+}
 /*!
   @brief   Convert separate red, green and blue values into a single
             "packed" 32-bit RGB color.
@@ -263,7 +361,9 @@ static uint8_t Adafruit_NeoPixel_gamma8(uint8_t x);
             function. Packed RGB format is predictable, regardless of
             LED strand color order.
 */
-static uint32_t Adafruit_NeoPixel_Color_rgb(uint8_t r, uint8_t g, uint8_t b);
+static inline uint32_t Adafruit_NeoPixel_Color_rgb(uint8_t r, uint8_t g, uint8_t b) {
+  return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+}
 /*!
   @brief   Convert separate red, green, blue and white values into a
             single "packed" 32-bit WRGB color.
@@ -276,8 +376,11 @@ static uint32_t Adafruit_NeoPixel_Color_rgb(uint8_t r, uint8_t g, uint8_t b);
             function. Packed WRGB format is predictable, regardless of
             LED strand color order.
 */
-static uint32_t Adafruit_NeoPixel_Color_rgbw(uint8_t r, uint8_t g, uint8_t b, uint8_t w);
-static uint32_t Adafruit_NeoPixel_ColorHSV(uint16_t hue, uint8_t sat, uint8_t val);// uint16_t hue, uint8_t sat = 255, uint8_t val = 255
+static inline uint32_t Adafruit_NeoPixel_Color_rgbw(uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
+  return ((uint32_t)w << 24) | ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+}
+uint32_t Adafruit_NeoPixel_ColorHSV(uint16_t hue, uint8_t sat, uint8_t val);// uint16_t hue, uint8_t sat = 255, uint8_t val = 255
+void Adafruit_NeoPixel_hsvToRgbSpan(uint32_t *out, const uint16_t *hues, uint8_t sat, uint8_t val, uint16_t n);
 /*!
   @brief   A gamma-correction function for 32-bit packed RGB or WRGB
             colors. Makes color transitions appear more perceptially
@@ -290,9 +393,22 @@ static uint32_t Adafruit_NeoPixel_ColorHSV(uint16_t hue, uint8_t sat, uint8_t va
             control you'll need to provide your own gamma-correction
             function instead.
 */
-uint32_t Adafruit_NeoPixel_gamma32(uint32_t x);
+static inline uint32_t Adafruit_NeoPixel_gamma32(uint32_t x) {
+  uint8_t *y = (uint8_t *)&x;
+  // All four bytes of a 32-bit value are filtered even if RGB (not WRGB),
+  // to avoid a bunch of shifting and masking that would be necessary for
+  // properly handling different endianisms (and each byte is a fairly
+  // trivial operation, so it might not even be wasting cycles vs a check
+  // and branch for the RGB case). In theory this might cause trouble *if*
+  // someone's storing information in the unused most significant byte
+  // of an RGB value, but this seems exceedingly rare and if it's
+  // encountered in reality they can mask values going in or coming out.
+  for (uint8_t i = 0; i < 4; i++)
+    y[i] = Adafruit_NeoPixel_gamma8(y[i]);
+  return x; // Packed 32-bit return
+}
 
-void Adafruit_NeoPixel_rainbow(uint16_t first_hue, int8_t reps,
+void Adafruit_NeoPixel_rainbow(Adafruit_NeoPixel *strip, uint16_t first_hue, int8_t reps,
   uint8_t saturation, uint8_t brightness, bool gammify);// uint16_t first_hue = 0, int8_t reps = 1, uint8_t saturation = 255, uint8_t brightness = 255, bool gammify = true
 
 neoPixelType Adafruit_NeoPixel_str2order(const char *v);
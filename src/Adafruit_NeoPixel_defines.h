@@ -36,6 +36,5 @@ int Adafruit_NeoPixel_constrain(int value, int min, int max);
 void* Adafruit_NeoPixel_memmove(void* dest, const void* src, size_t num);
 void* Adafruit_NeoPixel_memset(void* dest, int value, size_t num);
 void* Adafruit_NeoPixel_memchr(const void* ptr, int value, size_t num);
-double Adafruit_NeoPixel_pow(double base, int exponent);
 
 #endif
\ No newline at end of file
@@ -1,4 +1,13 @@
+// system headers first, Adafruit_NeoPixel_defines.h redefines the integer types
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "ws2812_user_def.h"
 #include "Adafruit_NeoPixel_defines.h"
+#include "Adafruit_NeoPixel.h"
 
 int Adafruit_NeoPixel_constrain(int value, int min, int max) {
     if (value < min) {
@@ -10,17 +19,110 @@ int Adafruit_NeoPixel_constrain(int value, int min, int max) {
     }
 }
 
+// a hosted C library's versions beat the built-in ones (see
+// extras/bench/bench_mem.c), freestanding targets keep the word/SIMD loops
+#ifndef USE_LIBC_MEM
+#if defined(__has_include)
+#if __STDC_HOSTED__ && __has_include(<string.h>)
+#define USE_LIBC_MEM 1
+#endif
+#elif defined(__GLIBC__)
+#define USE_LIBC_MEM 1
+#endif
+#endif
+
+#if USE_LIBC_MEM
+
+void* Adafruit_NeoPixel_memmove(void* dest, const void* src, size_t num) {
+    return memmove(dest, src, num);
+}
+
+void* Adafruit_NeoPixel_memset(void* dest, int value, size_t num) {
+    return memset(dest, value, num);
+}
+
+void* Adafruit_NeoPixel_memchr(const void* ptr, int value, size_t num) {
+    return memchr(ptr, value, num);
+}
+
+#else
+
+/*
+ * Bulk copies work a machine word (or a SIMD register, where the host has
+ * one) at a time; the unaligned head and the tail are done byte-wise. These
+ * run for every copyPixels() shift and every clear(), so they matter.
+ */
+#if defined(__GNUC__)
+typedef size_t __attribute__((__may_alias__)) mem_word;
+#else
+typedef size_t mem_word;
+#endif
+#define MEM_WORD_SIZE sizeof(mem_word)
+#define MEM_WORD_MASK (MEM_WORD_SIZE - 1)
+#define MEM_ONES      ((mem_word)-1 / 0xFF)   // 0x0101...01
+#define MEM_HIGHS     (MEM_ONES * 0x80)       // 0x8080...80
+// non-zero if any byte of x is zero
+#define MEM_HAS_ZERO(x) (((x) - MEM_ONES) & ~(x) & MEM_HIGHS)
+
+#if defined(__SSE2__)
+#define MEM_VEC_SIZE 16
+#define MEM_VEC_COPY(d, s) _mm_storeu_si128((__m128i*)(d), _mm_loadu_si128((const __m128i*)(s)))
+#elif defined(__ARM_NEON)
+#define MEM_VEC_SIZE 16
+#define MEM_VEC_COPY(d, s) vst1q_u8((uint8_t*)(d), vld1q_u8((const uint8_t*)(s)))
+#endif
+
 void* Adafruit_NeoPixel_memmove(void* dest, const void* src, size_t num) {
     unsigned char* d = dest;
     const unsigned char* s = src;
 
+    if (d == s || num == 0) {
+        return dest;
+    }
+
+    // Each chunk is loaded before it's stored, so copying forward is safe
+    // for d < s (and backward for d > s) even if the regions overlap.
     if (d < s) {
+#ifdef MEM_VEC_SIZE
+        for (; num >= MEM_VEC_SIZE; num -= MEM_VEC_SIZE, d += MEM_VEC_SIZE, s += MEM_VEC_SIZE) {
+            MEM_VEC_COPY(d, s);
+        }
+#else
+        if ((((size_t)d ^ (size_t)s) & MEM_WORD_MASK) == 0) {
+            while (((size_t)d & MEM_WORD_MASK) && num) {
+                *d++ = *s++;
+                num--;
+            }
+            for (; num >= MEM_WORD_SIZE; num -= MEM_WORD_SIZE, d += MEM_WORD_SIZE, s += MEM_WORD_SIZE) {
+                *(mem_word*)d = *(const mem_word*)s;
+            }
+        }
+#endif
         while (num--) {
             *d++ = *s++;
         }
     } else {
         d += num;
         s += num;
+#ifdef MEM_VEC_SIZE
+        for (; num >= MEM_VEC_SIZE; num -= MEM_VEC_SIZE) {
+            d -= MEM_VEC_SIZE;
+            s -= MEM_VEC_SIZE;
+            MEM_VEC_COPY(d, s);
+        }
+#else
+        if ((((size_t)d ^ (size_t)s) & MEM_WORD_MASK) == 0) {
+            while (((size_t)d & MEM_WORD_MASK) && num) {
+                *(--d) = *(--s);
+                num--;
+            }
+            for (; num >= MEM_WORD_SIZE; num -= MEM_WORD_SIZE) {
+                d -= MEM_WORD_SIZE;
+                s -= MEM_WORD_SIZE;
+                *(mem_word*)d = *(const mem_word*)s;
+            }
+        }
+#endif
         while (num--) {
             *(--d) = *(--s);
         }
@@ -33,8 +135,27 @@ void* Adafruit_NeoPixel_memset(void* dest, int value, size_t num) {
     unsigned char* p = (unsigned char*)dest;
     unsigned char v = (unsigned char)value;
 
-    for (size_t i = 0; i < num; ++i) {
-        p[i] = v;
+    while (((size_t)p & MEM_WORD_MASK) && num) {
+        *p++ = v;
+        num--;
+    }
+#if defined(__SSE2__)
+    __m128i vv = _mm_set1_epi8((char)v);
+    for (; num >= 16; num -= 16, p += 16) {
+        _mm_storeu_si128((__m128i*)p, vv);
+    }
+#elif defined(__ARM_NEON)
+    uint8x16_t vv = vdupq_n_u8(v);
+    for (; num >= 16; num -= 16, p += 16) {
+        vst1q_u8(p, vv);
+    }
+#endif
+    mem_word w = MEM_ONES * v;
+    for (; num >= MEM_WORD_SIZE; num -= MEM_WORD_SIZE, p += MEM_WORD_SIZE) {
+        *(mem_word*)p = w;
+    }
+    while (num--) {
+        *p++ = v;
     }
 
     return dest;
@@ -44,28 +165,116 @@ void* Adafruit_NeoPixel_memchr(const void* ptr, int value, size_t num) {
     const unsigned char* p = ptr;
     unsigned char v = (unsigned char)value;
 
-    for (size_t i = 0; i < num; ++i) {
-        if (p[i] == v) {
-            return (void*)(p + i);
+    while (((size_t)p & MEM_WORD_MASK) && num) {
+        if (*p == v) {
+            return (void*)p;
+        }
+        p++;
+        num--;
+    }
+#if defined(__SSE2__)
+    __m128i vv = _mm_set1_epi8((char)v);
+    for (; num >= 16; num -= 16, p += 16) {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), vv));
+        if (mask) {
+            return (void*)(p + __builtin_ctz(mask));
+        }
+    }
+#endif
+    // xor turns the bytes equal to v into zeros, then look for a zero byte
+    mem_word w = MEM_ONES * v;
+    for (; num >= MEM_WORD_SIZE; num -= MEM_WORD_SIZE, p += MEM_WORD_SIZE) {
+        mem_word x = *(const mem_word*)p ^ w;
+        if (MEM_HAS_ZERO(x)) {
+            break;
+        }
+    }
+    for (; num; num--, p++) {
+        if (*p == v) {
+            return (void*)p;
         }
     }
 
     return NULL;
 }
 
-double Adafruit_NeoPixel_pow(double base, int exponent) {
-    double result = 1.0;
+#endif // USE_LIBC_MEM
 
-    if (exponent >= 0) {
-        for (int i = 0; i < exponent; ++i) {
-            result *= base;
+/*
+ * Batch version of Adafruit_NeoPixel_ColorHSV(), same results. On the 0-1530
+ * hexcone each channel is a clamped distance from its peak, so there are no
+ * branches to take: red is |h - 765| - 255, green 510 - |h - 510| and blue
+ * 510 - |h - 1020|, each clamped to 0-255. The hue remap
+ * (hue * 1530 + 32768) / 65536 is a multiply and a shift.
+ */
+static inline uint8_t Adafruit_NeoPixel_hsvClamp(int16_t x) {
+    return (uint8_t)(x < 0 ? 0 : (x > 255 ? 255 : x));
+}
+
+static inline int16_t Adafruit_NeoPixel_hsvDist(int16_t x) {
+    return x < 0 ? -x : x;
+}
+
+void Adafruit_NeoPixel_hsvToRgbSpan(uint32_t *out, const uint16_t *hues, uint8_t sat, uint8_t val, uint16_t n) {
+    uint16_t v1 = 1 + val;  // 1 to 256; allows >>8 instead of /255
+    uint16_t s1 = 1 + sat;  // 1 to 256; same reason
+    uint16_t s2 = 255 - sat;
+    uint16_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128(), hue_scale = _mm_set1_epi16(1530), full = _mm_set1_epi16(255);
+    const __m128i vs1 = _mm_set1_epi16((int16_t)s1), vs2 = _mm_set1_epi16((int16_t)s2), vv1 = _mm_set1_epi16((int16_t)v1);
+    for (; i + 8 <= n; i += 8) {
+        __m128i hue = _mm_loadu_si128((const __m128i*)(hues + i));
+        // high half of hue * 1530, plus the carry of adding 32768 to the low half
+        __m128i h = _mm_add_epi16(_mm_mulhi_epu16(hue, hue_scale), _mm_srli_epi16(_mm_mullo_epi16(hue, hue_scale), 15));
+        __m128i d, c[3];
+        d = _mm_sub_epi16(h, _mm_set1_epi16(765));
+        c[0] = _mm_sub_epi16(_mm_max_epi16(d, _mm_sub_epi16(zero, d)), full);
+        d = _mm_sub_epi16(h, _mm_set1_epi16(510));
+        c[1] = _mm_sub_epi16(_mm_set1_epi16(510), _mm_max_epi16(d, _mm_sub_epi16(zero, d)));
+        d = _mm_sub_epi16(h, _mm_set1_epi16(1020));
+        c[2] = _mm_sub_epi16(_mm_set1_epi16(510), _mm_max_epi16(d, _mm_sub_epi16(zero, d)));
+        for (uint8_t k = 0; k < 3; k++) {
+            c[k] = _mm_min_epi16(_mm_max_epi16(c[k], zero), full);
+            c[k] = _mm_add_epi16(_mm_srli_epi16(_mm_mullo_epi16(c[k], vs1), 8), vs2);
+            c[k] = _mm_srli_epi16(_mm_mullo_epi16(c[k], vv1), 8);
         }
-    } else {
-        for (int i = 0; i > exponent; --i) {
-            result /= base;
+        __m128i gb = _mm_or_si128(c[2], _mm_slli_epi16(c[1], 8));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi16(gb, c[0]));
+        _mm_storeu_si128((__m128i*)(out + i + 4), _mm_unpackhi_epi16(gb, c[0]));
+    }
+#elif defined(__ARM_NEON)
+    const int16x8_t zero = vdupq_n_s16(0), full = vdupq_n_s16(255);
+    const uint16x8_t vs1 = vdupq_n_u16(s1), vs2 = vdupq_n_u16(s2), vv1 = vdupq_n_u16(v1);
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t hue = vld1q_u16(hues + i);
+        uint32x4_t lo = vaddq_u32(vmull_n_u16(vget_low_u16(hue), 1530), vdupq_n_u32(32768));
+        uint32x4_t hi = vaddq_u32(vmull_n_u16(vget_high_u16(hue), 1530), vdupq_n_u32(32768));
+        int16x8_t h = vreinterpretq_s16_u16(vcombine_u16(vshrn_n_u32(lo, 16), vshrn_n_u32(hi, 16)));
+        int16x8_t s[3];
+        s[0] = vsubq_s16(vabsq_s16(vsubq_s16(h, vdupq_n_s16(765))), full);
+        s[1] = vsubq_s16(vdupq_n_s16(510), vabsq_s16(vsubq_s16(h, vdupq_n_s16(510))));
+        s[2] = vsubq_s16(vdupq_n_s16(510), vabsq_s16(vsubq_s16(h, vdupq_n_s16(1020))));
+        uint16x8_t c[3];
+        for (uint8_t k = 0; k < 3; k++) {
+            c[k] = vreinterpretq_u16_s16(vminq_s16(vmaxq_s16(s[k], zero), full));
+            c[k] = vaddq_u16(vshrq_n_u16(vmulq_u16(c[k], vs1), 8), vs2);
+            c[k] = vshrq_n_u16(vmulq_u16(c[k], vv1), 8);
         }
+        uint16x8x2_t packed = vzipq_u16(vorrq_u16(c[2], vshlq_n_u16(c[1], 8)), c[0]);
+        vst1q_u32(out + i, vreinterpretq_u32_u16(packed.val[0]));
+        vst1q_u32(out + i + 4, vreinterpretq_u32_u16(packed.val[1]));
+    }
+#endif
+    for (; i < n; i++) {
+        int16_t h = (int16_t)(((uint32_t)hues[i] * 1530 + 32768) >> 16);
+        uint16_t r = Adafruit_NeoPixel_hsvClamp(Adafruit_NeoPixel_hsvDist(h - 765) - 255);
+        uint16_t g = Adafruit_NeoPixel_hsvClamp(510 - Adafruit_NeoPixel_hsvDist(h - 510));
+        uint16_t b = Adafruit_NeoPixel_hsvClamp(510 - Adafruit_NeoPixel_hsvDist(h - 1020));
+        r = ((((r * s1) >> 8) + s2) * v1) >> 8;
+        g = ((((g * s1) >> 8) + s2) * v1) >> 8;
+        b = ((((b * s1) >> 8) + s2) * v1) >> 8;
+        out[i] = ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
     }
-
-    return result;
 }
-
@@ -52,58 +52,180 @@
   2018-02-24   added hooks for user created custom effects
 */
 
+#if SUPPORT_MALLOC
+#include <stdlib.h>
+#endif
 #include "WS2812FX.h"
 #include "WS2812FX_modes_defines.h"
 
-uint16_t _rand16seed;
-
-void (*customShow)(void) = NULL;
-
-bool
-  _running,
-  _triggered;
-
-WS2812FX_Segment* _segments;                 // array of segments (20 bytes per element)
-WS2812FX_Segment_runtime* _segment_runtimes; // array of segment runtimes (16 bytes per element)
-uint8_t* _active_segments;          // array of active segments (1 bytes per element)
-
-uint8_t _segments_len = 0;          // size of _segments array
-uint8_t _active_segments_len = 0;   // size of _segments_runtime and _active_segments arrays
-uint8_t _num_segments = 0;          // number of configured segments in the _segments array
-
-WS2812FX_Segment* _seg;                      // currently active segment (20 bytes)
-WS2812FX_Segment_runtime* _seg_rt;           // currently active segment runtime (16 bytes)
+// pixel lookup tables, see WS2812FX_pixelLut()
+#define LUT_GAMMA      0   // gamma curve
+#define LUT_GAMMA_BRI  256 // gamma curve scaled by the strip brightness
+#define LUT_BRI        512 // strip brightness only
+#define LUT_SIZE       768
+
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define SCRATCH_ROUND(n) (((size_t)(n) + 7) & ~(size_t)7)
+
+// offsets of the regions carved from the arena, relative to its aligned start
+typedef struct WS2812FX_arena_layout {
+  size_t pixels;
+  size_t tx;       // copy of the pixels that gets sent (DEFERRED_BRIGHTNESS, DOUBLE_BUFFER or POWER_LIMIT)
+  size_t front;    // second transmit buffer (DOUBLE_BUFFER only)
+  size_t segments;
+  size_t runtimes;
+  size_t indexes;  // active_segments, seg_slot and the scheduler arrays
+  size_t palettes; // MAX_NUM_PALETTES x 256 colors
+  size_t lut;      // pixel lookup tables
+  size_t scratch;
+  size_t scratch_len;
+  size_t total;
+} WS2812FX_Arena_layout;
+
+static void WS2812FX_arenaLayout(WS2812FX_Arena_layout *l, uint16_t num_leds, neoPixelType type,
+                                 uint8_t segs, uint8_t active) {
+#ifdef NEO_FIXED_TYPE
+  type = NEO_FIXED_TYPE;
+#endif
+  uint8_t bytesPerPixel = (((type >> 6) & 0b11) == ((type >> 4) & 0b11)) ? 3 : 4;
+  size_t off = 0;
+  l->pixels   = off; off += ARENA_ROUND((size_t)num_leds * bytesPerPixel);
+  l->tx       = off;
+#if HAS_TX_BUFFER
+  off += ARENA_ROUND((size_t)num_leds * bytesPerPixel);
+#endif
+  l->front    = off;
+#if DOUBLE_BUFFER
+  off += ARENA_ROUND((size_t)num_leds * bytesPerPixel);
+#endif
+  l->segments = off; off += ARENA_ROUND(segs * sizeof(WS2812FX_Segment));
+  l->runtimes = off; off += ARENA_ROUND(active * sizeof(WS2812FX_Segment_runtime));
+  l->indexes  = off; off += ARENA_ROUND(4 * active + segs);
+  l->palettes = off; off += ARENA_ROUND(MAX_NUM_PALETTES * 256 * sizeof(uint32_t));
+  l->lut      = off; off += ARENA_ROUND(LUT_SIZE);
+  l->scratch_len = ARENA_ROUND((size_t)active * SCRATCH_BYTES_PER_SEGMENT + (size_t)num_leds * SCRATCH_BYTES_PER_LED);
+  l->scratch  = off; off += l->scratch_len;
+  l->total = off;
+}
 
-uint16_t _seg_len;                  // num LEDs in the currently active segment
+/*
+ * Size of the arena WS2812FX_init() needs for the given strip and segment
+ * counts, including the slack to align its start.
+ */
+size_t WS2812FX_requiredBytes(uint16_t num_leds, neoPixelType type, uint8_t max_num_segments, uint8_t max_num_active_segments) {
+  WS2812FX_Arena_layout l;
+  WS2812FX_arenaLayout(&l, num_leds, type, min(max_num_segments, MAX_NUM_SEGMENTS),
+                       min(max_num_active_segments, MAX_NUM_ACTIVE_SEGMENTS));
+  return l.total + ARENA_ALIGN - 1;
+}
 
-uint32_t (*WS2812FX_millis)(void);
+// palette 0 is the color wheel, the others start out as copies of it
+static void WS2812FX_resetPalettes(WS2812FX_Ctx *ctx) {
+  for(uint16_t i=0; i < 256; i++) {
+    ctx->palettes[i] = WS2812FX_color_wheel((uint8_t)i);
+  }
+  for(uint8_t p=1; p < MAX_NUM_PALETTES; p++) {
+    Adafruit_NeoPixel_memmove(ctx->palettes + p * 256, ctx->palettes, 256 * sizeof(uint32_t));
+  }
+}
 
-void WS2812FX_init(uint16_t num_leds, neoPixelType type,
+/*
+ * Initialise an engine context. All state used by the modes, helpers and
+ * pixel primitives lives in the context, so several strips can be driven
+ * independently (e.g. one context per output, serviced from its own thread).
+ * The pixel buffer, segment tables, runtimes and the modes' scratch memory
+ * are laid out in the caller supplied arena, which must be at least
+ * WS2812FX_requiredBytes() long and stay valid for the life of the context.
+ * Returns false (and leaves the context untouched) if the arena is too small.
+ */
+bool WS2812FX_init(WS2812FX_Ctx *ctx, void *arena, size_t arena_size, uint16_t num_leds, neoPixelType type,
                     uint8_t max_num_segments,// uint8_t max_num_segments=MAX_NUM_SEGMENTS
                     uint8_t max_num_active_segments) {// max_num_active_segments=MAX_NUM_ACTIVE_SEGMENTS
-  uint8_t new_pixls[128];// TODO
-  Adafruit_NeoPixel_init(new_pixls, num_leds, type);
+  max_num_segments = min(max_num_segments, MAX_NUM_SEGMENTS);
+  max_num_active_segments = min(max_num_active_segments, MAX_NUM_ACTIVE_SEGMENTS);
+  if(arena == NULL || arena_size < WS2812FX_requiredBytes(num_leds, type, max_num_segments, max_num_active_segments)) return false;
+
+  WS2812FX_Arena_layout l;
+  WS2812FX_arenaLayout(&l, num_leds, type, max_num_segments, max_num_active_segments);
+  uint8_t *base = (uint8_t*)arena + ((ARENA_ALIGN - ((size_t)arena & (ARENA_ALIGN - 1))) & (ARENA_ALIGN - 1));
+  Adafruit_NeoPixel_memset(base, 0, l.total);
+
+  Adafruit_NeoPixel_init(&ctx->strip, base + l.pixels, num_leds, type);
+#if HAS_TX_BUFFER
+  Adafruit_NeoPixel_setTxBuffer(&ctx->strip, base + l.tx);
+#endif
+#if DOUBLE_BUFFER
+  Adafruit_NeoPixel_setFrontBuffer(&ctx->strip, base + l.front);
+#endif
+
+  Adafruit_NeoPixel_begin(&ctx->strip);
+  ctx->strip.brightness = DEFAULT_BRIGHTNESS + 1; // Adafruit_NeoPixel internally offsets brightness by 1
+  ctx->running = false;
+  ctx->triggered = false;
+  ctx->show_pending = false;
+  ctx->rand16seed = 0;
+  ctx->customShow = NULL;
+  ctx->micros = NULL;
+  ctx->min_frame_us = MIN_FRAME_US;
+  Adafruit_NeoPixel_memset(ctx->customModes, 0, sizeof(ctx->customModes));
+
+  ctx->segments_len = max_num_segments;
+  ctx->active_segments_len = max_num_active_segments;
+
+  ctx->segments         = (WS2812FX_Segment*)(base + l.segments);
+  ctx->segment_runtimes = (WS2812FX_Segment_runtime*)(base + l.runtimes);
+  ctx->active_segments  = base + l.indexes;
+  ctx->sched_heap       = ctx->active_segments + max_num_active_segments;
+  ctx->sched_pos        = ctx->sched_heap + max_num_active_segments;
+  ctx->sched_ran        = ctx->sched_pos + max_num_active_segments;
+  ctx->seg_slot         = ctx->sched_ran + max_num_active_segments;
+  ctx->palettes         = (uint32_t*)(base + l.palettes);
+  ctx->lut              = base + l.lut;
+  ctx->scratch_pool     = base + l.scratch;
+  ctx->scratch_pool_len = l.scratch_len;
+  ctx->scratch_used     = 0;
 
-  WS2812FX_resetSegmentRuntimes();
-  Adafruit_NeoPixel_begin();
-  Adafruit_NeoPixel_brightness = DEFAULT_BRIGHTNESS + 1; // Adafruit_NeoPixel internally offsets brightness by 1
-  _running = false;
+  // init segment pointers
+  ctx->seg     = ctx->segments;
+  ctx->seg_rt  = ctx->segment_runtimes;
+  ctx->seg_len = 0;
 
-  _segments_len = max_num_segments;
-  _active_segments_len = max_num_active_segments;
+  ctx->sched_len = 0;
+  ctx->sched_ran_len = 0;
+  Adafruit_NeoPixel_memset(ctx->sched_pos, INACTIVE_SEGMENT, ctx->active_segments_len);
+  Adafruit_NeoPixel_memset(ctx->active_segments, INACTIVE_SEGMENT, ctx->active_segments_len);
+  Adafruit_NeoPixel_memset(ctx->seg_slot, INACTIVE_SEGMENT, ctx->segments_len);
 
-  // create all the segment arrays and init to zeros
-  WS2812FX_Segment _segments[MAX_NUM_SEGMENTS];
-  uint8_t _active_segments[MAX_NUM_ACTIVE_SEGMENTS];
-  WS2812FX_Segment_runtime _segment_runtimes[MAX_NUM_ACTIVE_SEGMENTS];
+  WS2812FX_setGamma(ctx, DEFAULT_GAMMA);
+  WS2812FX_resetPalettes(ctx);
+  WS2812FX_setCurrentModel(ctx, NULL, LED_IDLE_UA);
+  ctx->power_budget_ma = 0;
+  ctx->power_slew = DEFAULT_POWER_SLEW;
+  ctx->power_settling = false;
 
-  // init segment pointers
-  _seg     = _segments;
-  _seg_rt  = _segment_runtimes;
+  WS2812FX_resetSegments(ctx);
+  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(ctx, 0, 0, num_leds - 1, DEFAULT_MODE, DEFAULT_COLOR, DEFAULT_SPEED, NO_OPTIONS);
+  return true;
+}
+
+#if SUPPORT_MALLOC
+/*
+ * Allocate a context together with its arena in one block and initialise it.
+ */
+WS2812FX_Ctx* WS2812FX_new(uint16_t num_leds, neoPixelType type, uint8_t max_num_segments, uint8_t max_num_active_segments) {
+  size_t arena_size = WS2812FX_requiredBytes(num_leds, type, max_num_segments, max_num_active_segments);
+  WS2812FX_Ctx *ctx = (WS2812FX_Ctx*)malloc(sizeof(WS2812FX_Ctx) + arena_size);
+  if(ctx == NULL) return NULL;
+  WS2812FX_init(ctx, ctx + 1, arena_size, num_leds, type, max_num_segments, max_num_active_segments);
+  return ctx;
+}
 
-  WS2812FX_resetSegments();
-  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(0, 0, num_leds - 1, DEFAULT_MODE, DEFAULT_COLOR, DEFAULT_SPEED, NO_OPTIONS);
+void WS2812FX_delete(WS2812FX_Ctx *ctx) {
+  if(ctx == NULL) return;
+  Adafruit_NeoPixel_deinit(&ctx->strip);
+  free(ctx);
 }
+#endif
 
 // void WS2812FX_timer() {
 //   for (int j=0; j < 1000; j++) {
@@ -111,471 +233,1007 @@ void WS2812FX_init(uint16_t num_leds, neoPixelType type,
 //   }
 // }
 
-bool WS2812FX_service() {
+/*
+ * Segment scheduler. The active runtime slots are kept in a binary min-heap
+ * keyed on next_time, so service() only has to look at the heap top to find
+ * out whether anything is due, and only touches the segments that are.
+ */
+#define SCHED_TIME(i) (ctx->segment_runtimes[ctx->sched_heap[i]].next_time)
+
+static void WS2812FX_sched_swap(WS2812FX_Ctx *ctx, uint8_t i, uint8_t j) {
+  uint8_t tmp = ctx->sched_heap[i];
+  ctx->sched_heap[i] = ctx->sched_heap[j];
+  ctx->sched_heap[j] = tmp;
+  ctx->sched_pos[ctx->sched_heap[i]] = i;
+  ctx->sched_pos[ctx->sched_heap[j]] = j;
+}
+
+static void WS2812FX_sched_siftUp(WS2812FX_Ctx *ctx, uint8_t i) {
+  while(i > 0) {
+    uint8_t parent = (i - 1) / 2;
+    if(!TIME_BEFORE(SCHED_TIME(i), SCHED_TIME(parent))) break;
+    WS2812FX_sched_swap(ctx, i, parent);
+    i = parent;
+  }
+}
+
+static void WS2812FX_sched_siftDown(WS2812FX_Ctx *ctx, uint8_t i) {
+  while(true) {
+    uint16_t child = 2 * i + 1;
+    if(child >= ctx->sched_len) break;
+    if(child + 1 < ctx->sched_len && TIME_BEFORE(SCHED_TIME(child + 1), SCHED_TIME(child))) child++;
+    if(!TIME_BEFORE(SCHED_TIME(child), SCHED_TIME(i))) break;
+    WS2812FX_sched_swap(ctx, i, (uint8_t)child);
+    i = (uint8_t)child;
+  }
+}
+
+static void WS2812FX_sched_insert(WS2812FX_Ctx *ctx, uint8_t slot) {
+  if(ctx->sched_pos[slot] != INACTIVE_SEGMENT) return; // already scheduled
+  uint8_t i = ctx->sched_len++;
+  ctx->sched_heap[i] = slot;
+  ctx->sched_pos[slot] = i;
+  WS2812FX_sched_siftUp(ctx, i);
+}
+
+static void WS2812FX_sched_remove(WS2812FX_Ctx *ctx, uint8_t slot) {
+  uint8_t i = ctx->sched_pos[slot];
+  if(i == INACTIVE_SEGMENT) return; // not scheduled
+  uint8_t last = --ctx->sched_len;
+  if(i != last) {
+    uint8_t moved = ctx->sched_heap[last];
+    WS2812FX_sched_swap(ctx, i, last);
+    WS2812FX_sched_siftUp(ctx, i);
+    WS2812FX_sched_siftDown(ctx, ctx->sched_pos[moved]);
+  }
+  ctx->sched_pos[slot] = INACTIVE_SEGMENT;
+}
+
+// restore the heap order after a slot's next_time has been changed
+static void WS2812FX_sched_update(WS2812FX_Ctx *ctx, uint8_t slot) {
+  if(slot >= ctx->active_segments_len) return;
+  uint8_t i = ctx->sched_pos[slot];
+  if(i == INACTIVE_SEGMENT) return;
+  WS2812FX_sched_siftUp(ctx, i);
+  WS2812FX_sched_siftDown(ctx, ctx->sched_pos[slot]);
+}
+
+// runtime slot of an active segment, INACTIVE_SEGMENT if the segment isn't active
+static uint8_t WS2812FX_slotOf(WS2812FX_Ctx *ctx, uint8_t seg) {
+  return seg < ctx->segments_len ? ctx->seg_slot[seg] : INACTIVE_SEGMENT;
+}
+
+/*
+ * Scratch memory. Each runtime slot can own one block of the context's
+ * scratch pool for the private state of its mode. Blocks are kept packed at
+ * the start of the pool: freeing one moves the blocks above it down, so the
+ * pool never fragments. Modes must therefore re-read seg_rt->scratch on every
+ * call rather than keep the pointer around.
+ */
+static void WS2812FX_freeScratch(WS2812FX_Ctx *ctx, uint8_t slot) {
+  WS2812FX_Segment_runtime *rt = &ctx->segment_runtimes[slot];
+  if(rt->scratch == NULL) return;
+  uint8_t *hole = rt->scratch;
+  size_t len = SCRATCH_ROUND(rt->scratch_len);
+  uint8_t *end = ctx->scratch_pool + ctx->scratch_used;
+  Adafruit_NeoPixel_memmove(hole, hole + len, end - (hole + len));
+  for(uint8_t i=0; i<ctx->active_segments_len; i++) {
+    if(ctx->segment_runtimes[i].scratch > hole) ctx->segment_runtimes[i].scratch -= len;
+  }
+  ctx->scratch_used -= len;
+  rt->scratch = NULL;
+  rt->scratch_len = 0;
+}
+
+static uint8_t* WS2812FX_allocScratch_slot(WS2812FX_Ctx *ctx, uint8_t slot, uint16_t size) {
+  WS2812FX_freeScratch(ctx, slot);
+  size_t len = SCRATCH_ROUND(size);
+  if(size == 0 || ctx->scratch_used + len > ctx->scratch_pool_len) return NULL;
+  WS2812FX_Segment_runtime *rt = &ctx->segment_runtimes[slot];
+  rt->scratch = ctx->scratch_pool + ctx->scratch_used;
+  rt->scratch_len = size;
+  ctx->scratch_used += len;
+  Adafruit_NeoPixel_memset(rt->scratch, 0, len);
+  return rt->scratch;
+}
+
+/*
+ * (Re)allocate zeroed scratch memory for the segment currently being
+ * serviced, releasing its previous block. Returns NULL if the pool is
+ * exhausted. The block is released when the segment's runtime is reset
+ * (mode change, start()) or the segment is deactivated.
+ */
+uint8_t* WS2812FX_allocScratch(WS2812FX_Ctx *ctx, uint16_t size) {
+  return WS2812FX_allocScratch_slot(ctx, (uint8_t)(ctx->seg_rt - ctx->segment_runtimes), size);
+}
+
+// replace a slot's scratch memory with the block its segment's mode declares
+// in _mode_scratch[], if any. If the pool is exhausted the mode finds no
+// block and keeps trying to allocate one itself.
+static void WS2812FX_carveScratch(WS2812FX_Ctx *ctx, uint8_t slot) {
+  WS2812FX_freeScratch(ctx, slot);
+  const WS2812FX_Segment *seg = &ctx->segments[ctx->active_segments[slot]];
+  if(seg->mode < MODE_COUNT && _mode_scratch[seg->mode] != NULL) {
+    WS2812FX_allocScratch_slot(ctx, slot, _mode_scratch[seg->mode](seg, &ctx->segment_runtimes[slot]));
+  }
+}
+
+bool WS2812FX_service(WS2812FX_Ctx *ctx) {
+  return WS2812FX_service_next(ctx, NULL);
+}
+
+/*
+ * Run every segment whose timer has expired (or all active segments if
+ * triggered) and show the result. If next_time is not NULL it receives the
+ * earliest pending deadline (micros), or MAX_MICROS if no segment is scheduled.
+ * Due segments are run in runtime slot order, same as before, so overlapping
+ * segments keep painting on top of each other in a predictable order.
+ * Nothing runs until a clock has been set, see WS2812FX_setClock().
+ */
+bool WS2812FX_service_next(WS2812FX_Ctx *ctx, uint64_t *next_time) {
   bool doShow = false;
-  if(_running || _triggered) {
-    unsigned long now = WS2812FX_millis(); // Be aware, millis() rolls over every 49 days
-    for(uint8_t i=0; i < _active_segments_len; i++) {
-      if(_active_segments[i] != INACTIVE_SEGMENT) {
-        _seg     = &_segments[_active_segments[i]];
-        _seg_len = (uint16_t)(_seg->stop - _seg->start + 1);
-        _seg_rt  = &_segment_runtimes[i];
-        CLR_FRAME_CYCLE;
-        if(now > _seg_rt->next_time || _triggered) {
-          SET_FRAME;
-          doShow = true;
-          uint16_t delay = _modes[_seg->mode]();
-          _seg_rt->next_time = now + max(delay, SPEED_MIN);
-          _seg_rt->counter_mode_call++;
+  if(ctx->micros == NULL) { // no clock yet
+    if(next_time != NULL) *next_time = MAX_MICROS;
+    return false;
+  }
+  if(ctx->running || ctx->triggered) {
+    uint64_t now = ctx->micros();
+    uint8_t* due = ctx->sched_ran;
+    uint8_t due_len = 0;
+
+    // the frame/cycle flags only live until the next service() call
+    for(uint8_t i=0; i < ctx->sched_ran_len; i++) {
+      ctx->seg_rt = &ctx->segment_runtimes[due[i]];
+      CLR_FRAME_CYCLE;
+    }
+
+    if(ctx->triggered) {
+      for(uint8_t i=0; i < ctx->active_segments_len; i++) {
+        if(ctx->active_segments[i] != INACTIVE_SEGMENT) due[due_len++] = i;
+      }
+    } else {
+      // pop the expired slots and insertion sort them back into slot order
+      while(ctx->sched_len > 0 && !TIME_BEFORE(now, SCHED_TIME(0))) {
+        uint8_t slot = ctx->sched_heap[0];
+        WS2812FX_sched_remove(ctx, slot);
+        uint8_t j = due_len++;
+        while(j > 0 && due[j - 1] > slot) {
+          due[j] = due[j - 1];
+          j--;
         }
+        due[j] = slot;
+      }
+    }
+
+    for(uint8_t i=0; i < due_len; i++) {
+      uint8_t slot = due[i];
+      ctx->seg     = &ctx->segments[ctx->active_segments[slot]];
+      ctx->seg_len = (uint16_t)(ctx->seg->stop - ctx->seg->start + 1);
+      ctx->seg_rt  = &ctx->segment_runtimes[slot];
+      SET_FRAME;
+      uint16_t delay = _modes[ctx->seg->mode](ctx);
+      uint64_t interval = (uint64_t)delay * 1000;
+      ctx->seg_rt->next_time = now + max(interval, ctx->min_frame_us);
+      ctx->seg_rt->counter_mode_call++;
+      if(ctx->sched_pos[slot] == INACTIVE_SEGMENT) {
+        WS2812FX_sched_insert(ctx, slot);
+      } else {
+        WS2812FX_sched_update(ctx, slot);
       }
     }
-    if(doShow) {
-      WS2812FX_show();
+    ctx->sched_ran_len = due_len;
+
+    // skip the show if the modes didn't actually change any pixel
+    // (e.g. static mode rewriting the same colours), unless the power
+    // limiter is still letting go
+    if((due_len > 0 || ctx->show_pending) && (Adafruit_NeoPixel_isDirty(&ctx->strip) || ctx->power_settling)) {
+#if DOUBLE_BUFFER
+      // don't wait for the previous frame, retry on the next call instead
+      ctx->show_pending = !WS2812FX_showAsync(ctx);
+      doShow = !ctx->show_pending;
+#else
+      WS2812FX_show(ctx);
+      doShow = true;
+#endif
     }
-    _triggered = false;
+    ctx->triggered = false;
+  }
+  if(next_time != NULL) {
+    *next_time = ctx->sched_len > 0 ? SCHED_TIME(0) : MAX_MICROS;
   }
   return doShow;
 }
 
+/*
+ * Time (micros) at which service() next has work to do, taking into account
+ * pending triggers, the segment timers and the strip's data latch window.
+ * Returns MAX_MICROS if nothing will happen until the engine is started or
+ * triggered (or given a clock), so the host can block until then.
+ */
+uint64_t WS2812FX_nextDeadline(WS2812FX_Ctx *ctx) {
+  uint64_t deadline;
+  if(ctx->micros == NULL) {
+    return MAX_MICROS;
+  } else if(ctx->triggered) {
+    deadline = ctx->micros();
+  } else if(ctx->running && ctx->sched_len > 0) {
+    deadline = SCHED_TIME(0);
+  } else {
+    return MAX_MICROS;
+  }
+  // a frame is waiting for the transport: check back when it could be done
+  if(ctx->show_pending) {
+    uint64_t retry = ctx->strip.txBusy ? ctx->micros() + 300 : ctx->strip.endTime + 300;
+    if(TIME_BEFORE(retry, deadline)) deadline = retry;
+  }
+  // show() would busy-wait for the latch, so don't wake up before it's over
+  uint64_t latch_end = ctx->strip.endTime + 300;
+  if(TIME_BEFORE(deadline, latch_end) && !Adafruit_NeoPixel_canShow(&ctx->strip)) deadline = latch_end;
+  return deadline;
+}
+
+/*
+ * service() followed by nextDeadline(), for tickless main loops. Returns how
+ * many micros the caller may sleep before calling again (0 if more work is
+ * due right away), or MAX_MICROS if it may sleep until the next start() or
+ * trigger().
+ */
+uint64_t WS2812FX_serviceUntil(WS2812FX_Ctx *ctx) {
+  WS2812FX_service(ctx);
+  uint64_t deadline = WS2812FX_nextDeadline(ctx);
+  if(deadline == MAX_MICROS) return MAX_MICROS;
+  uint64_t now = ctx->micros();
+  return TIME_BEFORE(now, deadline) ? deadline - now : 0;
+}
+
+/*
+ * Pixel lookup tables. Gamma correction and (unless DEFERRED_BRIGHTNESS) the
+ * strip brightness are folded into one 256 entry table per channel value,
+ * so a pixel write costs one load per byte. The gamma curve is built once
+ * per setGamma(), the scaled tables whenever the strip brightness changed.
+ */
+static void WS2812FX_buildGammaCurve(WS2812FX_Ctx *ctx) {
+  uint8_t *curve = ctx->lut + LUT_GAMMA;
+  for(uint16_t i=0; i<256; i++) {
+    curve[i] = (uint8_t)WS2812FX_pow_ratio(i, 255, ctx->gamma10, 10, 255); // round(255 * (i/255)^(gamma10/10))
+  }
+  ctx->lut_valid = false;
+}
+
+static void WS2812FX_buildLuts(WS2812FX_Ctx *ctx) {
+#if DEFERRED_BRIGHTNESS
+  uint16_t scale = 256; // brightness is applied in the output stage
+#else
+  uint16_t scale = ctx->strip.brightness ? ctx->strip.brightness : 256; // see Adafruit_NeoPixel_setBrightness()
+#endif
+  for(uint16_t i=0; i<256; i++) {
+    ctx->lut[LUT_GAMMA_BRI + i] = (uint8_t)((ctx->lut[LUT_GAMMA + i] * scale) >> 8);
+    ctx->lut[LUT_BRI + i] = (uint8_t)((i * scale) >> 8);
+  }
+  ctx->lut_brightness = ctx->strip.brightness;
+  ctx->lut_valid = true;
+}
+
+// table for the current segment's options and the current brightness
+static inline const uint8_t* WS2812FX_pixelLut(WS2812FX_Ctx *ctx) {
+  if(!ctx->lut_valid || ctx->lut_brightness != ctx->strip.brightness) WS2812FX_buildLuts(ctx);
+  return ctx->lut + (IS_GAMMA ? LUT_GAMMA_BRI : LUT_BRI);
+}
+
 // overload setPixelColor() functions so we can use gamma correction
 // (see https://learn.adafruit.com/led-tricks-gamma-correction/the-issue)
-void WS2812FX_setPixelColor_nc(uint16_t n, uint32_t c) {
+void WS2812FX_setPixelColor_nc(WS2812FX_Ctx *ctx, uint16_t n, uint32_t c) {
   uint8_t w = (c >> 24) & 0xFF;
   uint8_t r = (c >> 16) & 0xFF;
   uint8_t g = (c >>  8) & 0xFF;
   uint8_t b =  c        & 0xFF;
-  WS2812FX_setPixelColor_nrgbw(n, r, g, b, w);
+  WS2812FX_setPixelColor_nrgbw(ctx, n, r, g, b, w);
 }
 
-void WS2812FX_setPixelColor_nrgb(uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
-  WS2812FX_setPixelColor_nrgbw(n, r, g, b, 0);
+void WS2812FX_setPixelColor_nrgb(WS2812FX_Ctx *ctx, uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
+  WS2812FX_setPixelColor_nrgbw(ctx, n, r, g, b, 0);
 }
 
-void WS2812FX_setPixelColor_nrgbw(uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
-  if(IS_GAMMA) {
-    Adafruit_NeoPixel_setPixelColor_nrgbw(n, Adafruit_NeoPixel_gamma8(r), Adafruit_NeoPixel_gamma8(g), Adafruit_NeoPixel_gamma8(b), Adafruit_NeoPixel_gamma8(w));
-  } else {
-    Adafruit_NeoPixel_setPixelColor_nrgbw(n, r, g, b, w);
+void WS2812FX_setPixelColor_nrgbw(WS2812FX_Ctx *ctx, uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
+  if(n < ctx->strip.numLEDs) {
+    const uint8_t *lut = WS2812FX_pixelLut(ctx);
+    uint8_t *p = &ctx->strip.pixels[n * NEO_BYTES_PER_PIXEL(&ctx->strip)];
+    uint8_t changed = 0;
+    r = lut[r]; g = lut[g]; b = lut[b];
+    if(!NEO_IS_RGB(&ctx->strip)) {
+      changed = Adafruit_NeoPixel_storeChannel(&ctx->strip, p, NEO_W_OFFSET(&ctx->strip), lut[w]);
+    }
+    changed |= Adafruit_NeoPixel_storeChannel(&ctx->strip, p, NEO_R_OFFSET(&ctx->strip), r);
+    changed |= Adafruit_NeoPixel_storeChannel(&ctx->strip, p, NEO_G_OFFSET(&ctx->strip), g);
+    changed |= Adafruit_NeoPixel_storeChannel(&ctx->strip, p, NEO_B_OFFSET(&ctx->strip), b);
+    if(changed) Adafruit_NeoPixel_markDirty(&ctx->strip, n, n);
   }
 }
 
+// convert a color into device byte order the way setPixelColor() stores it, e.g. for Adafruit_NeoPixel_fillSpan()
+void WS2812FX_encodePixel(WS2812FX_Ctx *ctx, uint32_t c, uint8_t *pixel) {
+  const uint8_t *lut = WS2812FX_pixelLut(ctx);
+  pixel[NEO_W_OFFSET(&ctx->strip)] = lut[(c >> 24) & 0xFF]; // overwritten by R on RGB strips
+  pixel[NEO_R_OFFSET(&ctx->strip)] = lut[(c >> 16) & 0xFF];
+  pixel[NEO_G_OFFSET(&ctx->strip)] = lut[(c >>  8) & 0xFF];
+  pixel[NEO_B_OFFSET(&ctx->strip)] = lut[ c        & 0xFF];
+}
+
 // custom setPixelColor() function that bypasses the Adafruit_Neopixel global brightness rigmarole
-void WS2812FX_setRawPixelColor(uint16_t n, uint32_t c) {
-  if (n < Adafruit_NeoPixel_numLEDs) {
-    uint8_t *p = (Adafruit_NeoPixel_wOffset == Adafruit_NeoPixel_rOffset) ? &Adafruit_NeoPixel_pixels[n * 3] : &Adafruit_NeoPixel_pixels[n * 4]; 
+void WS2812FX_setRawPixelColor(WS2812FX_Ctx *ctx, uint16_t n, uint32_t c) {
+  if (n < ctx->strip.numLEDs) {
+    uint8_t *p = NEO_IS_RGB(&ctx->strip) ? &ctx->strip.pixels[n * 3] : &ctx->strip.pixels[n * 4]; 
     uint8_t w = (uint8_t)(c >> 24), r = (uint8_t)(c >> 16), g = (uint8_t)(c >> 8), b = (uint8_t)c;
 
-    p[Adafruit_NeoPixel_wOffset] = w;
-    p[Adafruit_NeoPixel_rOffset] = r;
-    p[Adafruit_NeoPixel_gOffset] = g;
-    p[Adafruit_NeoPixel_bOffset] = b;
+    // on RGB strips W shares R's offset and is overwritten by it
+    uint8_t changed = Adafruit_NeoPixel_storeChannel(&ctx->strip, p, NEO_W_OFFSET(&ctx->strip), w);
+    changed |= Adafruit_NeoPixel_storeChannel(&ctx->strip, p, NEO_R_OFFSET(&ctx->strip), r);
+    changed |= Adafruit_NeoPixel_storeChannel(&ctx->strip, p, NEO_G_OFFSET(&ctx->strip), g);
+    changed |= Adafruit_NeoPixel_storeChannel(&ctx->strip, p, NEO_B_OFFSET(&ctx->strip), b);
+    if(changed) Adafruit_NeoPixel_markDirty(&ctx->strip, n, n);
   }
 }
 
 // custom getPixelColor() function that bypasses the Adafruit_Neopixel global brightness rigmarole
-uint32_t WS2812FX_getRawPixelColor(uint16_t n) {
-  if (n >= Adafruit_NeoPixel_numLEDs) return 0; // Out of bounds, return no color.
+uint32_t WS2812FX_getRawPixelColor(WS2812FX_Ctx *ctx, uint16_t n) {
+  if (n >= ctx->strip.numLEDs) return 0; // Out of bounds, return no color.
 
-  if(Adafruit_NeoPixel_wOffset == Adafruit_NeoPixel_rOffset) { // RGB
-    uint8_t *p = &Adafruit_NeoPixel_pixels[n * 3]; 
-    return ((uint32_t)p[Adafruit_NeoPixel_rOffset] << 16) | ((uint32_t)p[Adafruit_NeoPixel_gOffset] << 8) | (uint32_t)p[Adafruit_NeoPixel_bOffset];
+  if(NEO_IS_RGB(&ctx->strip)) { // RGB
+    uint8_t *p = &ctx->strip.pixels[n * 3]; 
+    return ((uint32_t)p[NEO_R_OFFSET(&ctx->strip)] << 16) | ((uint32_t)p[NEO_G_OFFSET(&ctx->strip)] << 8) | (uint32_t)p[NEO_B_OFFSET(&ctx->strip)];
   } else { // RGBW
-    uint8_t *p = &Adafruit_NeoPixel_pixels[n * 4];
-    return ((uint32_t)p[Adafruit_NeoPixel_wOffset] << 24) | ((uint32_t)p[Adafruit_NeoPixel_rOffset] << 16) | ((uint32_t)p[Adafruit_NeoPixel_gOffset] << 8) | (uint32_t)p[Adafruit_NeoPixel_bOffset];
+    uint8_t *p = &ctx->strip.pixels[n * 4];
+    return ((uint32_t)p[NEO_W_OFFSET(&ctx->strip)] << 24) | ((uint32_t)p[NEO_R_OFFSET(&ctx->strip)] << 16) | ((uint32_t)p[NEO_G_OFFSET(&ctx->strip)] << 8) | (uint32_t)p[NEO_B_OFFSET(&ctx->strip)];
   }
 }
 
-void WS2812FX_copyPixels(uint16_t dest, uint16_t src, uint16_t count) {
-  uint8_t *pixels = Adafruit_NeoPixel_getPixels();
-  uint8_t bytesPerPixel = WS2812FX_getNumBytesPerPixel(); // 3=RGB, 4=RGBW
+void WS2812FX_copyPixels(WS2812FX_Ctx *ctx, uint16_t dest, uint16_t src, uint16_t count) {
+  uint8_t *pixels = Adafruit_NeoPixel_getPixels(&ctx->strip);
+  uint8_t bytesPerPixel = NEO_BYTES_PER_PIXEL(&ctx->strip); // 3=RGB, 4=RGBW
 
+  if(count == 0) return;
+  Adafruit_NeoPixel_subSums(&ctx->strip, dest, dest + count - 1);
   Adafruit_NeoPixel_memmove(pixels + (dest * bytesPerPixel), pixels + (src * bytesPerPixel), count * bytesPerPixel);
+  Adafruit_NeoPixel_addSums(&ctx->strip, dest, dest + count - 1);
+  Adafruit_NeoPixel_markDirty(&ctx->strip, dest, dest + count - 1);
+}
+
+/*
+ * Shift the current segment's pixels n places towards its stop (n < 0:
+ * towards its start), like the equivalent copyPixels() would, so the pixels
+ * at the end the shift comes from keep their old colors. With a transmit
+ * buffer the pixel buffer isn't moved at all: the segment's rotation changes
+ * and the output stage puts the pixels back in order, so a mode has to
+ * address the segment's pixels through WS2812FX_segPixel().
+ */
+void WS2812FX_scroll(WS2812FX_Ctx *ctx, int16_t n) {
+  uint16_t start = ctx->seg->start, len = ctx->seg_len;
+  uint16_t k = n < 0 ? -n : n;
+  if(k == 0 || k >= len) return;
+#if HAS_TX_BUFFER
+  if(ctx->seg->stop < ctx->strip.numLEDs && 2 * k <= len) {
+    WS2812FX_Segment_runtime *rt = ctx->seg_rt;
+    rt->rotation = (rt->rotation + (n > 0 ? len - k : k)) % len;
+    // the k pixels that wrapped around get the colors they had before
+    for(uint16_t i=0; i<k; i++) {
+      uint16_t dest = n > 0 ? i : len - k + i;
+      uint16_t src = n > 0 ? i + k : len - 2 * k + i;
+      WS2812FX_copyPixels(ctx, WS2812FX_segPixel(ctx, dest), WS2812FX_segPixel(ctx, src), 1);
+    }
+    Adafruit_NeoPixel_markDirty(&ctx->strip, start, ctx->seg->stop);
+    return;
+  }
+#endif
+  if(n > 0) {
+    WS2812FX_copyPixels(ctx, start + k, start, len - k);
+  } else {
+    WS2812FX_copyPixels(ctx, start, start + k, len - k);
+  }
+}
+
+static void WS2812FX_reversePixels(WS2812FX_Ctx *ctx, uint16_t first, uint16_t last) {
+  uint8_t bytesPerPixel = NEO_BYTES_PER_PIXEL(&ctx->strip);
+  uint8_t *a = ctx->strip.pixels + first * bytesPerPixel;
+  uint8_t *b = ctx->strip.pixels + last * bytesPerPixel;
+  for(; a < b; a += bytesPerPixel, b -= bytesPerPixel) {
+    for(uint8_t j=0; j<bytesPerPixel; j++) {
+      uint8_t tmp = a[j];
+      a[j] = b[j];
+      b[j] = tmp;
+    }
+  }
 }
 
+// put a scrolled segment's pixels back in order in the pixel buffer
+static void WS2812FX_unrotate(WS2812FX_Ctx *ctx, uint8_t slot) {
+  WS2812FX_Segment_runtime *rt = &ctx->segment_runtimes[slot];
+  if(rt->rotation == 0) return;
+  WS2812FX_Segment *seg = &ctx->segments[ctx->active_segments[slot]];
+  uint16_t start = seg->start, stop = seg->stop;
+  // rotate left by three reversals, in place
+  WS2812FX_reversePixels(ctx, start, start + rt->rotation - 1);
+  WS2812FX_reversePixels(ctx, start + rt->rotation, stop);
+  WS2812FX_reversePixels(ctx, start, stop);
+  rt->rotation = 0;
+  Adafruit_NeoPixel_markDirty(&ctx->strip, start, stop);
+}
+
+// current drawn by the colors alone, in microamps, before the power limiter
+static uint64_t WS2812FX_colorCurrent(WS2812FX_Ctx *ctx) {
+  const uint32_t *sums = ctx->strip.sums;
+  uint64_t ua = (uint64_t)sums[NEO_R_OFFSET(&ctx->strip)] * ctx->current_ua[0] +
+                (uint64_t)sums[NEO_G_OFFSET(&ctx->strip)] * ctx->current_ua[1] +
+                (uint64_t)sums[NEO_B_OFFSET(&ctx->strip)] * ctx->current_ua[2];
+  if(!NEO_IS_RGB(&ctx->strip)) ua += (uint64_t)sums[NEO_W_OFFSET(&ctx->strip)] * ctx->current_ua[3];
+  ua /= 255;
+#if DEFERRED_BRIGHTNESS
+  uint8_t brightness = ctx->strip.brightness;
+  if(brightness) ua = (ua * brightness) >> 8;
+#endif
+  return ua;
+}
+
+#if HAS_TX_BUFFER
+/*
+ * Power limiter: pick the output scale that brings the estimated current
+ * within the budget. The LEDs' idle current can't be scaled, so it comes off
+ * the budget first. Called once per frame, before the output stage.
+ */
+static void WS2812FX_limitPower(WS2812FX_Ctx *ctx) {
+  Adafruit_NeoPixel *strip = &ctx->strip;
+  uint16_t target = 256, limit = strip->limit;
+
+  if(ctx->power_budget_ma) {
+    uint64_t budget = (uint64_t)ctx->power_budget_ma * 1000;
+    uint64_t idle = (uint64_t)strip->numLEDs * ctx->idle_ua;
+    uint64_t color = WS2812FX_colorCurrent(ctx);
+    if(color + idle > budget) {
+      target = budget > idle ? (uint16_t)(((budget - idle) << 8) / color) : 0;
+    }
+  }
+  if(target < limit || ctx->power_slew == 0) {
+    limit = target;
+  } else {
+    limit = min(target, limit + ctx->power_slew);
+  }
+  ctx->power_settling = limit != target;
+  if(limit != strip->limit) {
+    strip->limit = limit;
+    Adafruit_NeoPixel_markAllDirty(strip); // every pixel goes out at the new scale
+  }
+}
+
+/*
+ * Output stage: scale the changed part of the full scale pixel buffer into
+ * the transmit buffer, by the global brightness and the power limit and,
+ * with DEFERRED_BRIGHTNESS, within each active segment by the segment's
+ * brightness on top of it. Scrolled segments are put back in order on the
+ * way, see WS2812FX_scroll().
+ */
+static void WS2812FX_renderTx(WS2812FX_Ctx *ctx) {
+  Adafruit_NeoPixel *strip = &ctx->strip;
+  if(!Adafruit_NeoPixel_isDirty(strip)) return;
+  uint16_t first, last;
+  Adafruit_NeoPixel_txRange(strip, &first, &last);
+  // a scrolled segment only comes out in order as a whole
+  for(uint8_t i=0; i<ctx->active_segments_len; i++) {
+    if(ctx->active_segments[i] == INACTIVE_SEGMENT || ctx->segment_runtimes[i].rotation == 0) continue;
+    WS2812FX_Segment *seg = &ctx->segments[ctx->active_segments[i]];
+    if(seg->start <= last && seg->stop >= first) {
+      Adafruit_NeoPixel_markDirty(strip, seg->start, seg->stop);
+    }
+  }
+  Adafruit_NeoPixel_txRange(strip, &first, &last);
+  last = min(last, strip->numLEDs - 1);
+#if DEFERRED_BRIGHTNESS
+  uint16_t scale = strip->brightness ? strip->brightness : 256;
+#else
+  uint16_t scale = 256; // brightness was applied when the pixels were set
+#endif
+  scale = (uint16_t)(((uint32_t)scale * strip->limit) >> 8);
+
+  Adafruit_NeoPixel_scaleSpan(strip, first, last, scale);
+  for(uint8_t i=0; i<ctx->active_segments_len; i++) {
+    if(ctx->active_segments[i] == INACTIVE_SEGMENT) continue;
+    WS2812FX_Segment *seg = &ctx->segments[ctx->active_segments[i]];
+    uint16_t rotation = ctx->segment_runtimes[i].rotation;
+    uint16_t segScale = scale;
+#if DEFERRED_BRIGHTNESS
+    if(seg->brightness) segScale = (uint16_t)((scale * seg->brightness) >> 8);
+#endif
+    if(rotation) { // within the dirty range as a whole, see above
+      uint16_t len = seg->stop - seg->start + 1;
+      Adafruit_NeoPixel_scaleCopy(strip, seg->start, seg->start + rotation, len - rotation, segScale);
+      Adafruit_NeoPixel_scaleCopy(strip, seg->start + len - rotation, seg->start, rotation, segScale);
+      continue;
+    }
+    if(segScale == scale) continue; // full brightness, already done
+    uint16_t start = max(seg->start, first), stop = min(seg->stop, last);
+    if(start > stop) continue;
+    Adafruit_NeoPixel_scaleSpan(strip, start, stop, segScale);
+  }
+}
+#endif
+
 // overload show() functions so we can use custom show()
-void WS2812FX_show(void) {
-  customShow == NULL ? Adafruit_NeoPixel_show() : customShow();
+// (with a transmit buffer a custom show() should send the strip's txPixels)
+void WS2812FX_show(WS2812FX_Ctx *ctx) {
+#if HAS_TX_BUFFER
+  WS2812FX_limitPower(ctx);
+  if(!ctx->strip.txFront) {
+    while(ctx->strip.txBusy); // don't render into the buffer that's going out
+  }
+  WS2812FX_renderTx(ctx);
+  if(ctx->customShow == NULL) {
+    Adafruit_NeoPixel_transmit(&ctx->strip);
+    return;
+  }
+#else
+  if(ctx->customShow == NULL) {
+    Adafruit_NeoPixel_show(&ctx->strip);
+    return;
+  }
+#endif
+  ctx->customShow(ctx);
+  Adafruit_NeoPixel_clearDirty(&ctx->strip); // the strip's own show() does this itself
+}
+
+/*
+ * Non-blocking show(): start sending the frame if the transport and the data
+ * latch are ready, otherwise return false right away and leave the frame to
+ * be retried. With DOUBLE_BUFFER and an asynchronous transport (see
+ * Adafruit_NeoPixel_setTransport()) the modes render the next frame while this
+ * one is still going out. A custom show() is always run synchronously.
+ */
+bool WS2812FX_showAsync(WS2812FX_Ctx *ctx) {
+  if(ctx->customShow != NULL) {
+    WS2812FX_show(ctx);
+    return true;
+  }
+  if(!Adafruit_NeoPixel_isDirty(&ctx->strip) && !ctx->power_settling) return true;
+  if(!Adafruit_NeoPixel_canShow(&ctx->strip)) return false;
+#if HAS_TX_BUFFER
+  WS2812FX_limitPower(ctx);
+  WS2812FX_renderTx(ctx);
+  return Adafruit_NeoPixel_transmitAsync(&ctx->strip);
+#else
+  return Adafruit_NeoPixel_showAsync(&ctx->strip);
+#endif
 }
 
-void WS2812FX_start() {
-  WS2812FX_resetSegmentRuntimes();
-  _running = true;
+void WS2812FX_start(WS2812FX_Ctx *ctx) {
+  WS2812FX_resetSegmentRuntimes(ctx);
+  ctx->running = true;
 }
 
-void WS2812FX_stop() {
-  _running = false;
-  WS2812FX_strip_off();
+void WS2812FX_stop(WS2812FX_Ctx *ctx) {
+  ctx->running = false;
+  WS2812FX_strip_off(ctx);
 }
 
-void WS2812FX_pause() {
-  _running = false;
+void WS2812FX_pause(WS2812FX_Ctx *ctx) {
+  ctx->running = false;
 }
 
-void WS2812FX_resume() {
-  _running = true;
+void WS2812FX_resume(WS2812FX_Ctx *ctx) {
+  ctx->running = true;
 }
 
-void WS2812FX_trigger() {
-  _triggered = true;
+void WS2812FX_trigger(WS2812FX_Ctx *ctx) {
+  ctx->triggered = true;
 }
 
-void WS2812FX_setMode_m(uint8_t m) {
-  WS2812FX_setMode_seg_m(0, m);
+void WS2812FX_setMode_m(WS2812FX_Ctx *ctx, uint8_t m) {
+  WS2812FX_setMode_seg_m(ctx, 0, m);
 }
 
-void WS2812FX_setMode_seg_m(uint8_t seg, uint8_t m) {
-  WS2812FX_resetSegmentRuntime(seg);
-  _segments[seg].mode = Adafruit_NeoPixel_constrain(m, 0, MODE_COUNT - 1);
+void WS2812FX_setMode_seg_m(WS2812FX_Ctx *ctx, uint8_t seg, uint8_t m) {
+  ctx->segments[seg].mode = Adafruit_NeoPixel_constrain(m, 0, MODE_COUNT - 1);
+  WS2812FX_resetSegmentRuntime(ctx, seg); // after the mode is set, to carve its scratch memory
 }
 
-void WS2812FX_setOptions(uint8_t seg, uint8_t o) {
-  _segments[seg].options = o;
+void WS2812FX_setOptions(WS2812FX_Ctx *ctx, uint8_t seg, uint8_t o) {
+  ctx->segments[seg].options = o;
 }
 
-void WS2812FX_setSpeed_s(uint16_t s) {
-  WS2812FX_setSpeed_seg_s(0, s);
+void WS2812FX_setSpeed_s(WS2812FX_Ctx *ctx, uint16_t s) {
+  WS2812FX_setSpeed_seg_s(ctx, 0, s);
 }
 
-void WS2812FX_setSpeed_seg_s(uint8_t seg, uint16_t s) {
-  _segments[seg].speed = Adafruit_NeoPixel_constrain(s, SPEED_MIN, SPEED_MAX);
+void WS2812FX_setSpeed_seg_s(WS2812FX_Ctx *ctx, uint8_t seg, uint16_t s) {
+  ctx->segments[seg].speed = Adafruit_NeoPixel_constrain(s, SPEED_MIN, SPEED_MAX);
 }
 
-void WS2812FX_increaseSpeed(uint8_t s) {
-  uint16_t newSpeed = Adafruit_NeoPixel_constrain(_seg->speed + s, SPEED_MIN, SPEED_MAX);
-  WS2812FX_setSpeed_s(newSpeed);
+void WS2812FX_increaseSpeed(WS2812FX_Ctx *ctx, uint8_t s) {
+  uint16_t newSpeed = Adafruit_NeoPixel_constrain(ctx->seg->speed + s, SPEED_MIN, SPEED_MAX);
+  WS2812FX_setSpeed_s(ctx, newSpeed);
 }
 
-void WS2812FX_decreaseSpeed(uint8_t s) {
-  uint16_t newSpeed = Adafruit_NeoPixel_constrain(_seg->speed - s, SPEED_MIN, SPEED_MAX);
-  WS2812FX_setSpeed_s(newSpeed);
+void WS2812FX_decreaseSpeed(WS2812FX_Ctx *ctx, uint8_t s) {
+  uint16_t newSpeed = Adafruit_NeoPixel_constrain(ctx->seg->speed - s, SPEED_MIN, SPEED_MAX);
+  WS2812FX_setSpeed_s(ctx, newSpeed);
 }
 
-void WS2812FX_setColor_rgb(uint8_t r, uint8_t g, uint8_t b) {
-  WS2812FX_setColor_c(((uint32_t)r << 16) | ((uint32_t)g << 8) | b);
+void WS2812FX_setColor_rgb(WS2812FX_Ctx *ctx, uint8_t r, uint8_t g, uint8_t b) {
+  WS2812FX_setColor_c(ctx, ((uint32_t)r << 16) | ((uint32_t)g << 8) | b);
 }
 
-void WS2812FX_setColor_rgbw(uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
-  WS2812FX_setColor_c((((uint32_t)w << 24)| ((uint32_t)r << 16) | ((uint32_t)g << 8)| ((uint32_t)b)));
+void WS2812FX_setColor_rgbw(WS2812FX_Ctx *ctx, uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
+  WS2812FX_setColor_c(ctx, (((uint32_t)w << 24)| ((uint32_t)r << 16) | ((uint32_t)g << 8)| ((uint32_t)b)));
 }
 
-void WS2812FX_setColor_c(uint32_t c) {
-  WS2812FX_setColor_seg_c(0, c);
+void WS2812FX_setColor_c(WS2812FX_Ctx *ctx, uint32_t c) {
+  WS2812FX_setColor_seg_c(ctx, 0, c);
 }
 
-void WS2812FX_setColor_seg_c(uint8_t seg, uint32_t c) {
-  _segments[seg].colors[0] = c;
+void WS2812FX_setColor_seg_c(WS2812FX_Ctx *ctx, uint8_t seg, uint32_t c) {
+  ctx->segments[seg].colors[0] = c;
 }
 
-void WS2812FX_setColors(uint8_t seg, uint32_t* c) {
+void WS2812FX_setColors_seg_pc(WS2812FX_Ctx *ctx, uint8_t seg, uint32_t* c) {
   for(uint8_t i=0; i<MAX_NUM_COLORS; i++) {
-    _segments[seg].colors[i] = c[i];
+    ctx->segments[seg].colors[i] = c[i];
   }
 }
 
-void WS2812FX_setBrightness(uint8_t b) {
+void WS2812FX_setBrightness(WS2812FX_Ctx *ctx, uint8_t b) {
 //b = constrain(b, BRIGHTNESS_MIN, BRIGHTNESS_MAX);
-  Adafruit_NeoPixel_setBrightness(b);
-  WS2812FX_show();
+  Adafruit_NeoPixel_setBrightness(&ctx->strip, b);
+  WS2812FX_show(ctx);
 }
 
-void WS2812FX_increaseBrightness(uint8_t s) {
+/*
+ * Set the gamma exponent, in tenths (26 = 2.6), used for segments with the
+ * GAMMA option. Pixels already drawn are not changed.
+ */
+void WS2812FX_setGamma(WS2812FX_Ctx *ctx, uint8_t gamma10) {
+  ctx->gamma10 = gamma10;
+  WS2812FX_buildGammaCurve(ctx);
+}
+
+uint8_t WS2812FX_getGamma(WS2812FX_Ctx *ctx) {
+  return ctx->gamma10;
+}
+
+/*
+ * Dim a single segment relative to the global brightness. This is applied in
+ * the output stage, so it only has an effect with DEFERRED_BRIGHTNESS.
+ */
+void WS2812FX_setSegmentBrightness(WS2812FX_Ctx *ctx, uint8_t seg, uint8_t b) {
+  if(seg >= ctx->segments_len) return;
+  uint8_t newBrightness = b + 1; // see Adafruit_NeoPixel_setBrightness()
+  if(newBrightness != ctx->segments[seg].brightness) {
+    ctx->segments[seg].brightness = newBrightness;
+    if(ctx->segments[seg].start <= ctx->segments[seg].stop && ctx->segments[seg].stop < ctx->strip.numLEDs) {
+      Adafruit_NeoPixel_markDirty(&ctx->strip, ctx->segments[seg].start, ctx->segments[seg].stop);
+    }
+  }
+}
+
+uint8_t WS2812FX_getSegmentBrightness(WS2812FX_Ctx *ctx, uint8_t seg) {
+  return ctx->segments[seg].brightness - 1;
+}
+
+void WS2812FX_increaseBrightness(WS2812FX_Ctx *ctx, uint8_t s) {
 //s = constrain(getBrightness() + s, BRIGHTNESS_MIN, BRIGHTNESS_MAX);
-  WS2812FX_setBrightness(Adafruit_NeoPixel_getBrightness() + s);
+  WS2812FX_setBrightness(ctx, Adafruit_NeoPixel_getBrightness(&ctx->strip) + s);
 }
 
-void WS2812FX_decreaseBrightness(uint8_t s) {
+void WS2812FX_decreaseBrightness(WS2812FX_Ctx *ctx, uint8_t s) {
 //s = constrain(getBrightness() - s, BRIGHTNESS_MIN, BRIGHTNESS_MAX);
-  WS2812FX_setBrightness(Adafruit_NeoPixel_getBrightness() - s);
+  WS2812FX_setBrightness(ctx, Adafruit_NeoPixel_getBrightness(&ctx->strip) - s);
 }
 
 
-void WS2812FX_increaseLength(uint16_t s) {
-  uint16_t seglen = _segments[0].stop - _segments[0].start + 1;
-  WS2812FX_setLength(seglen + s);
+void WS2812FX_increaseLength(WS2812FX_Ctx *ctx, uint16_t s) {
+  uint16_t seglen = ctx->segments[0].stop - ctx->segments[0].start + 1;
+  WS2812FX_setLength(ctx, seglen + s);
 }
 
-void WS2812FX_decreaseLength(uint16_t s) {
-  uint16_t seglen = _segments[0].stop - _segments[0].start + 1;
-  WS2812FX_fill(BLACK, _segments[0].start, seglen);
-  WS2812FX_show();
+void WS2812FX_decreaseLength(WS2812FX_Ctx *ctx, uint16_t s) {
+  uint16_t seglen = ctx->segments[0].stop - ctx->segments[0].start + 1;
+  WS2812FX_fill(ctx, BLACK, ctx->segments[0].start, seglen);
+  WS2812FX_show(ctx);
 
-  if (s < seglen) WS2812FX_setLength(seglen - s);
+  if (s < seglen) WS2812FX_setLength(ctx, seglen - s);
 }
 
-bool WS2812FX_isRunning() {
-  return _running;
+bool WS2812FX_isRunning(WS2812FX_Ctx *ctx) {
+  return ctx->running;
 }
 
-bool WS2812FX_isTriggered() {
-  return _triggered;
+bool WS2812FX_isTriggered(WS2812FX_Ctx *ctx) {
+  return ctx->triggered;
 }
 
-bool WS2812FX_isFrame(void) {
-  return WS2812FX_isFrame_seg(0);
+bool WS2812FX_isFrame(WS2812FX_Ctx *ctx) {
+  return WS2812FX_isFrame_seg(ctx, 0);
 }
 
-bool WS2812FX_isFrame_seg(uint8_t seg) {
-  uint8_t* ptr = (uint8_t*)Adafruit_NeoPixel_memchr(_active_segments, seg, _active_segments_len);
-  if(ptr == NULL) return false; // segment not active
-  return (_segment_runtimes[ptr - _active_segments].aux_param2 & FRAME);
+bool WS2812FX_isFrame_seg(WS2812FX_Ctx *ctx, uint8_t seg) {
+  uint8_t slot = WS2812FX_slotOf(ctx, seg);
+  if(slot == INACTIVE_SEGMENT) return false; // segment not active
+  return (ctx->segment_runtimes[slot].aux_param2 & FRAME);
 }
 
-bool WS2812FX_isCycle() {
-  return WS2812FX_isCycle_seg(0);
+bool WS2812FX_isCycle(WS2812FX_Ctx *ctx) {
+  return WS2812FX_isCycle_seg(ctx, 0);
 }
 
-bool WS2812FX_isCycle_seg(uint8_t seg) {
-  uint8_t* ptr = (uint8_t*)Adafruit_NeoPixel_memchr(_active_segments, seg, _active_segments_len);
-  if(ptr == NULL) return false; // segment not active
-  return (_segment_runtimes[ptr - _active_segments].aux_param2 & CYCLE);
+bool WS2812FX_isCycle_seg(WS2812FX_Ctx *ctx, uint8_t seg) {
+  uint8_t slot = WS2812FX_slotOf(ctx, seg);
+  if(slot == INACTIVE_SEGMENT) return false; // segment not active
+  return (ctx->segment_runtimes[slot].aux_param2 & CYCLE);
 }
 
-void WS2812FX_setCycle() {
+void WS2812FX_setCycle(WS2812FX_Ctx *ctx) {
   SET_CYCLE;
 }
 
-uint8_t WS2812FX_getMode(void) {
-  return WS2812FX_getMode(0);
+uint8_t WS2812FX_getMode(WS2812FX_Ctx *ctx) {
+  return WS2812FX_getMode_seg(ctx, 0);
 }
 
-uint8_t WS2812FX_getMode(uint8_t seg) {
-  return _segments[seg].mode;
+uint8_t WS2812FX_getMode_seg(WS2812FX_Ctx *ctx, uint8_t seg) {
+  return ctx->segments[seg].mode;
 }
 
-uint16_t WS2812FX_getSpeed(void) {
-  return WS2812FX_getSpeed(0);
+uint16_t WS2812FX_getSpeed(WS2812FX_Ctx *ctx) {
+  return WS2812FX_getSpeed_seg(ctx, 0);
 }
 
-uint16_t WS2812FX_getSpeed(uint8_t seg) {
-  return _segments[seg].speed;
+uint16_t WS2812FX_getSpeed_seg(WS2812FX_Ctx *ctx, uint8_t seg) {
+  return ctx->segments[seg].speed;
 }
 
-uint8_t WS2812FX_getOptions(uint8_t seg) {
-  return _segments[seg].options;
+uint8_t WS2812FX_getOptions(WS2812FX_Ctx *ctx, uint8_t seg) {
+  return ctx->segments[seg].options;
 }
 
-uint16_t WS2812FX_getLength(void) {
-  return Adafruit_NeoPixel_numPixels();
+uint16_t WS2812FX_getLength(WS2812FX_Ctx *ctx) {
+  return Adafruit_NeoPixel_numPixels(&ctx->strip);
 }
 
-uint16_t WS2812FX_getNumBytes(void) {
-  return Adafruit_NeoPixel_numBytes;
+uint16_t WS2812FX_getNumBytes(WS2812FX_Ctx *ctx) {
+  return ctx->strip.numBytes;
 }
 
-uint8_t WS2812FX_getNumBytesPerPixel(void) {
-  return (Adafruit_NeoPixel_wOffset == Adafruit_NeoPixel_rOffset) ? 3 : 4; // 3=RGB, 4=RGBW
+uint8_t WS2812FX_getNumBytesPerPixel(WS2812FX_Ctx *ctx) {
+  (void)ctx; // unused if NEO_FIXED_TYPE fixes the pixel type
+  return NEO_BYTES_PER_PIXEL(&ctx->strip); // 3=RGB, 4=RGBW
 }
 
-uint8_t WS2812FX_getModeCount(void) {
+uint8_t WS2812FX_getModeCount(WS2812FX_Ctx *ctx) {
+  (void)ctx;
   return MODE_COUNT;
 }
 
-uint8_t WS2812FX_getNumSegments(void) {
-  return _num_segments;
+uint8_t WS2812FX_getNumSegments(WS2812FX_Ctx *ctx) {
+  return ctx->num_segments;
 }
 
-void WS2812FX_setNumSegments(uint8_t n) {
-  _num_segments = n;
+void WS2812FX_setNumSegments(WS2812FX_Ctx *ctx, uint8_t n) {
+  ctx->num_segments = n;
 }
 
-uint32_t WS2812FX_getColor(void) {
-  return WS2812FX_getColor(0);
+uint32_t WS2812FX_getColor(WS2812FX_Ctx *ctx) {
+  return WS2812FX_getColor_seg(ctx, 0);
 }
 
-uint32_t WS2812FX_getColor(uint8_t seg) {
-  return _segments[seg].colors[0];
+uint32_t WS2812FX_getColor_seg(WS2812FX_Ctx *ctx, uint8_t seg) {
+  return ctx->segments[seg].colors[0];
 }
 
-uint32_t* WS2812FX_getColors(uint8_t seg) {
-  return _segments[seg].colors;
+uint32_t* WS2812FX_getColors(WS2812FX_Ctx *ctx, uint8_t seg) {
+  return ctx->segments[seg].colors;
 }
 
-WS2812FX_Segment* WS2812FX_getSegment(void) {
-  return _seg;
+WS2812FX_Segment* WS2812FX_getSegment(WS2812FX_Ctx *ctx) {
+  return ctx->seg;
 }
 
-WS2812FX_Segment* WS2812FX_getSegment(uint8_t seg) {
-  return &_segments[seg];
+WS2812FX_Segment* WS2812FX_getSegment_seg(WS2812FX_Ctx *ctx, uint8_t seg) {
+  return &ctx->segments[seg];
 }
 
-WS2812FX_Segment* WS2812FX_getSegments(void) {
-  return _segments;
+WS2812FX_Segment* WS2812FX_getSegments(WS2812FX_Ctx *ctx) {
+  return ctx->segments;
 }
 
-WS2812FX_Segment_runtime* WS2812FX_getSegmentRuntime(void) {
-  return _seg_rt;
+WS2812FX_Segment_runtime* WS2812FX_getSegmentRuntime(WS2812FX_Ctx *ctx) {
+  return ctx->seg_rt;
 }
 
-WS2812FX_Segment_runtime* WS2812FX_getSegmentRuntime(uint8_t seg) {
-  uint8_t* ptr = (uint8_t*)Adafruit_NeoPixel_memchr(_active_segments, seg, _active_segments_len);
-  if(ptr == NULL) return NULL; // segment not active
-  return &_segment_runtimes[ptr - _active_segments];
+WS2812FX_Segment_runtime* WS2812FX_getSegmentRuntime_seg(WS2812FX_Ctx *ctx, uint8_t seg) {
+  uint8_t slot = WS2812FX_slotOf(ctx, seg);
+  if(slot == INACTIVE_SEGMENT) return NULL; // segment not active
+  return &ctx->segment_runtimes[slot];
 }
 
-WS2812FX_Segment_runtime* WS2812FX_getSegmentRuntimes(void) {
-  return _segment_runtimes;
+WS2812FX_Segment_runtime* WS2812FX_getSegmentRuntimes(WS2812FX_Ctx *ctx) {
+  return ctx->segment_runtimes;
 }
 
-uint8_t* WS2812FX_getActiveSegments(void) {
-  return _active_segments;
+uint8_t* WS2812FX_getActiveSegments(WS2812FX_Ctx *ctx) {
+  return ctx->active_segments;
 }
 
-void WS2812FX_setSegment() {
-  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(0, 0, WS2812FX_getLength()-1, DEFAULT_MODE, DEFAULT_COLOR, DEFAULT_SPEED, NO_OPTIONS);
+void WS2812FX_setSegment(WS2812FX_Ctx *ctx) {
+  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(ctx, 0, 0, WS2812FX_getLength(ctx)-1, DEFAULT_MODE, DEFAULT_COLOR, DEFAULT_SPEED, NO_OPTIONS);
 }
 
-void WS2812FX_setSegment_n(uint8_t n) {
-  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(n, 0, WS2812FX_getLength()-1, DEFAULT_MODE, DEFAULT_COLOR, DEFAULT_SPEED, NO_OPTIONS);
+void WS2812FX_setSegment_n(WS2812FX_Ctx *ctx, uint8_t n) {
+  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(ctx, n, 0, WS2812FX_getLength(ctx)-1, DEFAULT_MODE, DEFAULT_COLOR, DEFAULT_SPEED, NO_OPTIONS);
 }
 
-void WS2812FX_setSegment_n_start(uint8_t n, uint16_t start) {
-  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(n, start, WS2812FX_getLength()-1, DEFAULT_MODE, DEFAULT_COLOR, DEFAULT_SPEED, NO_OPTIONS);
+void WS2812FX_setSegment_n_start(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start) {
+  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(ctx, n, start, WS2812FX_getLength(ctx)-1, DEFAULT_MODE, DEFAULT_COLOR, DEFAULT_SPEED, NO_OPTIONS);
 }
 
-void WS2812FX_setSegment_n_start_stop(uint8_t n, uint16_t start, uint16_t stop) {
-  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(n, start, stop, DEFAULT_MODE, DEFAULT_COLOR, DEFAULT_SPEED, NO_OPTIONS);
+void WS2812FX_setSegment_n_start_stop(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop) {
+  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(ctx, n, start, stop, DEFAULT_MODE, DEFAULT_COLOR, DEFAULT_SPEED, NO_OPTIONS);
 }
 
-void WS2812FX_setSegment_n_start_stop_mode(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode) {
-  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(n, start, stop, mode, DEFAULT_COLOR, DEFAULT_SPEED, NO_OPTIONS);
+void WS2812FX_setSegment_n_start_stop_mode(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode) {
+  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(ctx, n, start, stop, mode, DEFAULT_COLOR, DEFAULT_SPEED, NO_OPTIONS);
 }
 
-void WS2812FX_setSegment_n_start_stop_mode_color(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color) {
-  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(n, start, stop, mode, color, DEFAULT_SPEED, NO_OPTIONS);
+void WS2812FX_setSegment_n_start_stop_mode_color(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color) {
+  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(ctx, n, start, stop, mode, color, DEFAULT_SPEED, NO_OPTIONS);
 }
 
-void WS2812FX_setSegment_n_start_stop_mode_color_speed(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color, uint16_t speed) {
-  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(n, start, stop, mode, color, speed, NO_OPTIONS);
+void WS2812FX_setSegment_n_start_stop_mode_color_speed(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color, uint16_t speed) {
+  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(ctx, n, start, stop, mode, color, speed, NO_OPTIONS);
 }
 
-void WS2812FX_setSegment_n_start_stop_mode_color_speed_reverse(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color, uint16_t speed, bool reverse) {
-  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(n, start, stop, mode, color, speed, (uint8_t)(reverse ? REVERSE : NO_OPTIONS));
+void WS2812FX_setSegment_n_start_stop_mode_color_speed_reverse(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color, uint16_t speed, bool reverse) {
+  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(ctx, n, start, stop, mode, color, speed, (uint8_t)(reverse ? REVERSE : NO_OPTIONS));
 }
 
-void WS2812FX_setSegment_n_start_stop_mode_color_speed_options(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color, uint16_t speed, uint8_t options) {
+void WS2812FX_setSegment_n_start_stop_mode_color_speed_options(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color, uint16_t speed, uint8_t options) {
   uint32_t colors[] = {color, 0, 0};
-  WS2812FX_setSegment_n_start_stop_mode_colors_speed_options(n, start, stop, mode, colors, speed, options);
+  WS2812FX_setSegment_n_start_stop_mode_colors_speed_options(ctx, n, start, stop, mode, colors, speed, options);
 }
 
-void WS2812FX_setSegment_n_start_stop_mode_colors(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[]) {
-  WS2812FX_setSegment_n_start_stop_mode_colors_speed_options(n, start, stop, mode, colors, DEFAULT_SPEED, NO_OPTIONS);
+void WS2812FX_setSegment_n_start_stop_mode_colors(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[]) {
+  WS2812FX_setSegment_n_start_stop_mode_colors_speed_options(ctx, n, start, stop, mode, colors, DEFAULT_SPEED, NO_OPTIONS);
 }
 
-void WS2812FX_setSegment_n_start_stop_mode_colors_speed(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[], uint16_t speed) {
-  WS2812FX_setSegment_n_start_stop_mode_colors_speed_options(n, start, stop, mode, colors, speed, NO_OPTIONS);
+void WS2812FX_setSegment_n_start_stop_mode_colors_speed(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[], uint16_t speed) {
+  WS2812FX_setSegment_n_start_stop_mode_colors_speed_options(ctx, n, start, stop, mode, colors, speed, NO_OPTIONS);
 }
 
-void WS2812FX_setSegment_n_start_stop_mode_colors_speed_reverse(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[], uint16_t speed, bool reverse) {
-  WS2812FX_setSegment_n_start_stop_mode_colors_speed_options(n, start, stop, mode, colors, speed, (uint8_t)(reverse ? REVERSE : NO_OPTIONS));
+void WS2812FX_setSegment_n_start_stop_mode_colors_speed_reverse(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[], uint16_t speed, bool reverse) {
+  WS2812FX_setSegment_n_start_stop_mode_colors_speed_options(ctx, n, start, stop, mode, colors, speed, (uint8_t)(reverse ? REVERSE : NO_OPTIONS));
 }
 
-void WS2812FX_setSegment_n_start_stop_mode_colors_speed_options(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[], uint16_t speed, uint8_t options) {
-  if(n < _segments_len) {
-    if(n + 1 > _num_segments) _num_segments = n + 1;
-    _segments[n].start = start;
-    _segments[n].stop = stop;
-    _segments[n].mode = mode;
-    _segments[n].speed = speed;
-    _segments[n].options = options;
+void WS2812FX_setSegment_n_start_stop_mode_colors_speed_options(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[], uint16_t speed, uint8_t options) {
+  if(n < ctx->segments_len) {
+    if(n + 1 > ctx->num_segments) ctx->num_segments = n + 1;
+    uint8_t slot = WS2812FX_slotOf(ctx, n);
+    if(slot != INACTIVE_SEGMENT) WS2812FX_unrotate(ctx, slot); // new bounds or mode, lay the pixels out plainly
+    bool newMode = ctx->segments[n].mode != mode;
+    ctx->segments[n].start = start;
+    ctx->segments[n].stop = stop;
+    ctx->segments[n].mode = mode;
+    ctx->segments[n].speed = speed;
+    ctx->segments[n].options = options;
 
-    WS2812FX_setColors_seg_pc(n, (uint32_t*)colors);
+    WS2812FX_setColors_seg_pc(ctx, n, (uint32_t*)colors);
 
-    if(n < _active_segments_len) WS2812FX_addActiveSegment(n);
+    // an active segment changing modes mustn't hand the new mode the old one's state
+    if(slot != INACTIVE_SEGMENT && newMode) WS2812FX_resetSegmentRuntime(ctx, n);
+    if(n < ctx->active_segments_len) WS2812FX_addActiveSegment(ctx, n);
   }
 }
 
-void WS2812FX_setIdleSegment(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color, uint16_t speed) {
-  WS2812FX_setIdleSegment_options(n, start, stop, mode, color, speed, NO_OPTIONS);
+void WS2812FX_setIdleSegment(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color, uint16_t speed) {
+  WS2812FX_setIdleSegment_options(ctx, n, start, stop, mode, color, speed, NO_OPTIONS);
 }
 
-void WS2812FX_setIdleSegment_options(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color, uint16_t speed, uint8_t options) {
+void WS2812FX_setIdleSegment_options(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color, uint16_t speed, uint8_t options) {
   uint32_t colors[] = {color, 0, 0};
-  WS2812FX_setIdleSegment_colors_options(n, start, stop, mode, colors, speed, options);
+  WS2812FX_setIdleSegment_colors_options(ctx, n, start, stop, mode, colors, speed, options);
 }
 
-void WS2812FX_setIdleSegment_colors_options(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[], uint16_t speed, uint8_t options) {
-  WS2812FX_setSegment_n_start_stop_mode_colors_speed_options(n, start, stop, mode, colors, speed, options);
-  if(n < _active_segments_len) WS2812FX_removeActiveSegment(n);;
+void WS2812FX_setIdleSegment_colors_options(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[], uint16_t speed, uint8_t options) {
+  WS2812FX_setSegment_n_start_stop_mode_colors_speed_options(ctx, n, start, stop, mode, colors, speed, options);
+  if(n < ctx->active_segments_len) WS2812FX_removeActiveSegment(ctx, n);;
 }
 
-void WS2812FX_addActiveSegment(uint8_t seg) {
-  uint8_t* ptr = (uint8_t*)Adafruit_NeoPixel_memchr(_active_segments, seg, _active_segments_len);
-  if(ptr != NULL) return; // segment already active
-  for(uint8_t i=0; i<_active_segments_len; i++) {
-    if(_active_segments[i] == INACTIVE_SEGMENT) {
-      _active_segments[i] = seg;
-      WS2812FX_resetSegmentRuntime(seg);
+void WS2812FX_addActiveSegment(WS2812FX_Ctx *ctx, uint8_t seg) {
+  if(seg >= ctx->segments_len) return;
+  if(ctx->seg_slot[seg] != INACTIVE_SEGMENT) return; // segment already active
+  for(uint8_t i=0; i<ctx->active_segments_len; i++) {
+    if(ctx->active_segments[i] == INACTIVE_SEGMENT) {
+      ctx->active_segments[i] = seg;
+      ctx->seg_slot[seg] = i;
+      WS2812FX_sched_insert(ctx, i);
+      WS2812FX_resetSegmentRuntime(ctx, seg);
       break;
     }
   }
 }
 
-void WS2812FX_removeActiveSegment(uint8_t seg) {
-  for(uint8_t i=0; i<_active_segments_len; i++) {
-    if(_active_segments[i] == seg) {
-      _active_segments[i] = INACTIVE_SEGMENT;
-    }
-  }
-}
-
-void WS2812FX_swapActiveSegment(uint8_t oldSeg, uint8_t newSeg) {
-  uint8_t* ptr = (uint8_t*)Adafruit_NeoPixel_memchr(_active_segments, newSeg, _active_segments_len);
-  if(ptr != NULL) return; // if newSeg is already active, don't swap
-  for(uint8_t i=0; i<_active_segments_len; i++) {
-    if(_active_segments[i] == oldSeg) {
-      _active_segments[i] = newSeg;
-
-      // reset all runtime parameters EXCEPT next_time,
-      // allowing the current animation frame to complete
-      WS2812FX_Segment_runtime seg_rt = _segment_runtimes[i];
-      seg_rt.counter_mode_step = 0;
-      seg_rt.counter_mode_call = 0;
-      seg_rt.aux_param = 0;
-      seg_rt.aux_param2 = 0;
-      seg_rt.aux_param3 = 0;
-      break;
-    }
+void WS2812FX_removeActiveSegment(WS2812FX_Ctx *ctx, uint8_t seg) {
+  uint8_t slot = WS2812FX_slotOf(ctx, seg);
+  if(slot == INACTIVE_SEGMENT) return;
+  WS2812FX_unrotate(ctx, slot);
+  ctx->active_segments[slot] = INACTIVE_SEGMENT;
+  ctx->seg_slot[seg] = INACTIVE_SEGMENT;
+  WS2812FX_sched_remove(ctx, slot);
+  WS2812FX_freeScratch(ctx, slot);
+}
+
+void WS2812FX_swapActiveSegment(WS2812FX_Ctx *ctx, uint8_t oldSeg, uint8_t newSeg) {
+  if(newSeg >= ctx->segments_len) return;
+  if(ctx->seg_slot[newSeg] != INACTIVE_SEGMENT) return; // if newSeg is already active, don't swap
+  uint8_t slot = WS2812FX_slotOf(ctx, oldSeg);
+  if(slot == INACTIVE_SEGMENT) return;
+  WS2812FX_unrotate(ctx, slot);
+
+  ctx->active_segments[slot] = newSeg;
+  ctx->seg_slot[oldSeg] = INACTIVE_SEGMENT;
+  ctx->seg_slot[newSeg] = slot;
+
+  // reset all runtime parameters EXCEPT next_time,
+  // allowing the current animation frame to complete
+  WS2812FX_Segment_runtime* seg_rt = &ctx->segment_runtimes[slot];
+  seg_rt->counter_mode_step = 0;
+  seg_rt->counter_mode_call = 0;
+  seg_rt->aux_param = 0;
+  seg_rt->aux_param2 = 0;
+  seg_rt->aux_param3 = 0;
+  WS2812FX_carveScratch(ctx, slot);
+}
+
+bool WS2812FX_isActiveSegment(WS2812FX_Ctx *ctx, uint8_t seg) {
+  return WS2812FX_slotOf(ctx, seg) != INACTIVE_SEGMENT;
+}
+
+void WS2812FX_resetSegments(WS2812FX_Ctx *ctx) {
+  WS2812FX_resetSegmentRuntimes(ctx);
+  Adafruit_NeoPixel_memset(ctx->segments, 0, ctx->segments_len * sizeof(WS2812FX_Segment));
+  Adafruit_NeoPixel_memset(ctx->active_segments, INACTIVE_SEGMENT, ctx->active_segments_len);
+  Adafruit_NeoPixel_memset(ctx->seg_slot, INACTIVE_SEGMENT, ctx->segments_len);
+  Adafruit_NeoPixel_memset(ctx->sched_pos, INACTIVE_SEGMENT, ctx->active_segments_len);
+  for(uint8_t i=0; i<ctx->active_segments_len; i++) {
+    ctx->segment_runtimes[i].scratch = NULL;
+    ctx->segment_runtimes[i].scratch_len = 0;
   }
+  ctx->scratch_used = 0;
+  ctx->sched_len = 0;
+  ctx->sched_ran_len = 0;
+  ctx->num_segments = 0;
 }
 
-bool WS2812FX_isActiveSegment(uint8_t seg) {
-  uint8_t* ptr = (uint8_t*)Adafruit_NeoPixel_memchr(_active_segments, seg, _active_segments_len);
-  if(ptr != NULL) return true;
-  return false;
-}
-
-void WS2812FX_resetSegments() {
-  WS2812FX_resetSegmentRuntimes();
-  Adafruit_NeoPixel_memset(_segments, 0, _segments_len * sizeof(WS2812FX_Segment));
-  Adafruit_NeoPixel_memset(_active_segments, INACTIVE_SEGMENT, _active_segments_len);
-  _num_segments = 0;
-}
-
-void WS2812FX_resetSegmentRuntimes() {
-  for(uint8_t i=0; i<_segments_len; i++) {
-    WS2812FX_resetSegmentRuntime(i);
+void WS2812FX_resetSegmentRuntimes(WS2812FX_Ctx *ctx) {
+  for(uint8_t i=0; i<ctx->segments_len; i++) {
+    WS2812FX_resetSegmentRuntime(ctx, i);
   };
 }
 
-void WS2812FX_resetSegmentRuntime(uint8_t seg) {
-  uint8_t* ptr = (uint8_t*)Adafruit_NeoPixel_memchr(_active_segments, seg, _active_segments_len);
-  if(ptr == NULL) return; // segment not active
-  _segment_runtimes[seg].next_time = 0;
-  _segment_runtimes[seg].counter_mode_step = 0;
-  _segment_runtimes[seg].counter_mode_call = 0;
-  _segment_runtimes[seg].aux_param = 0;
-  _segment_runtimes[seg].aux_param2 = 0;
-  _segment_runtimes[seg].aux_param3 = 0;
+void WS2812FX_resetSegmentRuntime(WS2812FX_Ctx *ctx, uint8_t seg) {
+  uint8_t slot = WS2812FX_slotOf(ctx, seg);
+  if(slot == INACTIVE_SEGMENT) return; // segment not active
+  WS2812FX_unrotate(ctx, slot);
+  ctx->segment_runtimes[slot].next_time = ctx->micros != NULL ? ctx->micros() : 0; // due right away
+  ctx->segment_runtimes[slot].counter_mode_step = 0;
+  ctx->segment_runtimes[slot].counter_mode_call = 0;
+  ctx->segment_runtimes[slot].aux_param = 0;
+  ctx->segment_runtimes[slot].aux_param2 = 0;
+  ctx->segment_runtimes[slot].aux_param3 = 0;
+  WS2812FX_carveScratch(ctx, slot);
+  WS2812FX_sched_update(ctx, slot);
   // don't reset any external data source
 }
 
 /*
  * Turns everything off. Doh.
  */
-void WS2812FX_strip_off() {
-  Adafruit_NeoPixel_clear();
-  WS2812FX_show();
+void WS2812FX_strip_off(WS2812FX_Ctx *ctx) {
+  Adafruit_NeoPixel_clear(&ctx->strip);
+  WS2812FX_show(ctx);
 }
 
 /*
@@ -596,17 +1254,48 @@ uint32_t WS2812FX_color_wheel(uint8_t pos) {
   }
 }
 
+/*
+ * Fill palette 1..MAX_NUM_PALETTES-1 with a gradient through num_stops
+ * evenly spaced colors (RGB or RGBW). The gradient wraps around, the last
+ * stop blends back into the first, so modes cycling through the palette
+ * don't jump. Palette 0, the color wheel, can't be changed.
+ */
+bool WS2812FX_setPaletteGradient(WS2812FX_Ctx *ctx, uint8_t palette, const uint32_t *stops, uint8_t num_stops) {
+  if(palette == 0 || palette >= MAX_NUM_PALETTES || stops == NULL || num_stops == 0) return false;
+  uint32_t *colors = ctx->palettes + palette * 256;
+  for(uint16_t i=0; i < 256; i++) {
+    uint16_t pos = i * num_stops;
+    uint8_t stop = pos >> 8;
+    colors[i] = WS2812FX_color_blend(stops[stop], stops[(stop + 1) % num_stops], pos & 0xFF);
+  }
+  return true;
+}
+
+uint32_t* WS2812FX_getPalette(WS2812FX_Ctx *ctx, uint8_t palette) {
+  return palette < MAX_NUM_PALETTES ? ctx->palettes + palette * 256 : NULL;
+}
+
+void WS2812FX_setSegmentPalette(WS2812FX_Ctx *ctx, uint8_t seg, uint8_t palette) {
+  if(seg < ctx->segments_len && palette < MAX_NUM_PALETTES) {
+    ctx->segments[seg].palette = palette;
+  }
+}
+
+uint8_t WS2812FX_getSegmentPalette(WS2812FX_Ctx *ctx, uint8_t seg) {
+  return ctx->segments[seg].palette;
+}
+
 /*
  * Returns a new, random wheel index with a minimum distance of 42 from pos.
  */
-uint8_t WS2812FX_get_random_wheel_index(uint8_t pos) {
+uint8_t WS2812FX_get_random_wheel_index(WS2812FX_Ctx *ctx, uint8_t pos) {
   uint8_t r = 0;
   uint8_t x = 0;
   uint8_t y = 0;
   uint8_t d = 0;
 
   while(d < 42) {
-    r = WS2812FX_random8();
+    r = WS2812FX_random8(ctx);
     x = abs(pos - r);
     y = 255 - x;
     d = min(x, y);
@@ -615,81 +1304,160 @@ uint8_t WS2812FX_get_random_wheel_index(uint8_t pos) {
   return r;
 }
 
-void WS2812FX_setRandomSeed(uint16_t seed) {
-  _rand16seed = seed;
+void WS2812FX_setRandomSeed(WS2812FX_Ctx *ctx, uint16_t seed) {
+  ctx->rand16seed = seed;
 }
 
 // fast 8-bit random number generator shamelessly borrowed from FastLED
-uint8_t WS2812FX_random8() {
-  _rand16seed = (_rand16seed * 2053) + 13849;
-  return (uint8_t)((_rand16seed + (_rand16seed >> 8)) & 0xFF);
+uint8_t WS2812FX_random8(WS2812FX_Ctx *ctx) {
+  ctx->rand16seed = (ctx->rand16seed * 2053) + 13849;
+  return (uint8_t)((ctx->rand16seed + (ctx->rand16seed >> 8)) & 0xFF);
 }
 
 // note random8(lim) generates numbers in the range 0 to (lim -1)
-uint8_t WS2812FX_random8_lim(uint8_t lim) {
-  uint8_t r = WS2812FX_random8();
+uint8_t WS2812FX_random8_lim(WS2812FX_Ctx *ctx, uint8_t lim) {
+  uint8_t r = WS2812FX_random8(ctx);
   r = ((uint16_t)r * lim) >> 8;
   return r;
 }
 
-uint8_t WS2812FX_random(uint8_t min_value, uint8_t max_value) {
+uint8_t WS2812FX_random(WS2812FX_Ctx *ctx, uint8_t min_value, uint8_t max_value) {
     uint8_t range = max_value - min_value;
-    return (WS2812FX_random8() % range) + min_value;
+    return (WS2812FX_random8(ctx) % range) + min_value;
 }
 
-uint16_t WS2812FX_random16() {
-  return (uint16_t)WS2812FX_random8() * 256 + WS2812FX_random8();
+uint16_t WS2812FX_random16(WS2812FX_Ctx *ctx) {
+  return (uint16_t)WS2812FX_random8(ctx) * 256 + WS2812FX_random8(ctx);
 }
 
 // note random16(lim) generates numbers in the range 0 to (lim - 1)
-uint16_t WS2812FX_random16_lim(uint16_t lim) {
-  uint16_t r = WS2812FX_random16();
+uint16_t WS2812FX_random16_lim(WS2812FX_Ctx *ctx, uint16_t lim) {
+  uint16_t r = WS2812FX_random16(ctx);
   r = ((uint32_t)r * lim) >> 16;
   return r;
 }
 
 // Return the sum of all LED intensities (can be used for
 // rudimentary power calculations)
-uint32_t WS2812FX_intensitySum() {
-  uint8_t *pixels = Adafruit_NeoPixel_getPixels();
-  uint32_t sum = 0;
-  for(uint16_t i=0; i < Adafruit_NeoPixel_numBytes; i++) {
-    sum+= pixels[i];
+uint32_t WS2812FX_intensitySum(WS2812FX_Ctx *ctx) {
+  // the strip keeps running sums up to date on every write
+  const uint32_t *sums = ctx->strip.sums;
+  return sums[0] + sums[1] + sums[2] + sums[3];
+}
+
+/*
+ * Set the current drawn by one LED: channel_ua[] holds the R, G, B and W
+ * channel current at full in microamps (NULL: LED_CHANNEL_UA for each),
+ * idle_ua what the LED draws while off.
+ */
+void WS2812FX_setCurrentModel(WS2812FX_Ctx *ctx, const uint16_t channel_ua[4], uint16_t idle_ua) {
+  for(uint8_t i=0; i < 4; i++) {
+    ctx->current_ua[i] = channel_ua ? channel_ua[i] : LED_CHANNEL_UA;
+  }
+  ctx->idle_ua = idle_ua;
+}
+
+/*
+ * Estimate the strip's current in milliamps from the running channel sums
+ * and the current model, without looking at the pixels. With
+ * DEFERRED_BRIGHTNESS the global brightness is taken into account but the
+ * segment brightnesses and the power limiter are not, so the estimate is an
+ * upper bound.
+ */
+uint32_t WS2812FX_estimateCurrent(WS2812FX_Ctx *ctx) {
+  uint64_t ua = WS2812FX_colorCurrent(ctx) + (uint64_t)ctx->strip.numLEDs * ctx->idle_ua;
+  return (uint32_t)(ua / 1000);
+}
+
+/*
+ * Limit the strip's current to budget_ma (0 turns the limiter off) by scaling
+ * the output down whenever the estimate is over budget. per_channel_ma, if not
+ * 0, replaces the current model's channel current (see setCurrentModel()).
+ * The pixel buffer isn't touched, the scaling is applied on the way to the
+ * transmit buffer, so it needs one (DEFERRED_BRIGHTNESS, DOUBLE_BUFFER or
+ * POWER_LIMIT).
+ */
+void WS2812FX_setPowerBudget(WS2812FX_Ctx *ctx, uint32_t budget_ma, uint8_t per_channel_ma) {
+  if(per_channel_ma) {
+    uint16_t ua = (uint16_t)min((uint32_t)per_channel_ma * 1000, 65535);
+    uint16_t channel_ua[4] = {ua, ua, ua, ua};
+    WS2812FX_setCurrentModel(ctx, channel_ua, ctx->idle_ua);
   }
-  return sum;
+  ctx->power_budget_ma = budget_ma;
+#if HAS_TX_BUFFER
+  ctx->power_settling = true; // re-evaluate on the next frame
+#endif
+}
+
+/*
+ * The limiter cuts the output as soon as a frame is over budget, but lets go
+ * by at most slew/256 per frame, so a flash of a bright frame doesn't make
+ * the whole strip pump. 0 lets go at once.
+ */
+void WS2812FX_setPowerSlew(WS2812FX_Ctx *ctx, uint8_t slew) {
+  ctx->power_slew = slew;
 }
 
 // Return the sum of each color's intensity. Note, the order of
 // intensities in the returned array depends on the type of WS2812
 // LEDs you have. NEO_GRB LEDs will return an array with entries
 // in a different order then NEO_RGB LEDs.
-uint32_t* WS2812FX_intensitySums() {
-  static uint32_t intensities[] = { 0, 0, 0, 0 };
-  Adafruit_NeoPixel_memset(intensities, 0, sizeof(intensities));
-
-  uint8_t *pixels = Adafruit_NeoPixel_getPixels();
-  uint8_t bytesPerPixel = WS2812FX_getNumBytesPerPixel(); // 3=RGB, 4=RGBW
-  for(uint16_t i=0; i < Adafruit_NeoPixel_numBytes; i += bytesPerPixel) {
-    intensities[0] += pixels[i];
-    intensities[1] += pixels[i + 1];
-    intensities[2] += pixels[i + 2];
-    if(bytesPerPixel == 4) intensities[3] += pixels[i + 3]; // for RGBW LEDs
-  }
+uint32_t* WS2812FX_intensitySums(WS2812FX_Ctx *ctx) {
+  uint32_t *intensities = ctx->intensities;
+  Adafruit_NeoPixel_memmove(intensities, ctx->strip.sums, sizeof(ctx->intensities));
   return intensities;
 }
 
 
+/*
+ * Set the engine's time source, a monotonic 64-bit microsecond clock. It is
+ * shared with the strip for the data latch timing.
+ */
+void WS2812FX_setClock(WS2812FX_Ctx *ctx, uint64_t (*micros)(void)) {
+  ctx->micros = micros;
+  ctx->strip.micros = micros;
+}
+
+/*
+ * Shortest interval between two frames of the same segment, in microseconds.
+ * Mode delays below this are clamped to it (defaults to SPEED_MIN millis).
+ */
+void WS2812FX_setMinFrameInterval(WS2812FX_Ctx *ctx, uint32_t us) {
+  ctx->min_frame_us = us;
+}
+
 /*
  * Custom show helper
  */
-void WS2812FX_setCustomShow(void (*p)()) {
-  customShow = p;
+void WS2812FX_setCustomShow(WS2812FX_Ctx *ctx, void (*p)(WS2812FX_Ctx*)) {
+  ctx->customShow = p;
+}
+
+/*
+ * Custom mode helpers
+ */
+void WS2812FX_setCustomMode_vp(WS2812FX_Ctx *ctx, WS2812FX_mode_ptr p) {
+  ctx->customModes[0] = p;
+}
+
+uint8_t WS2812FX_setCustomMode_p(WS2812FX_Ctx *ctx, WS2812FX_mode_ptr p) {
+  return WS2812FX_setCustomMode_index_p(ctx, 0, p);
+}
+
+uint8_t WS2812FX_setCustomMode_index_p(WS2812FX_Ctx *ctx, uint8_t index, WS2812FX_mode_ptr p) {
+  if(index < MAX_CUSTOM_MODES) {
+    ctx->customModes[index] = p;
+    return FX_MODE_CUSTOM_0 + index;
+  }
+  return 0;
 }
 
 /*
  * set a segment runtime's external data source
  */
-void WS2812FX_setExtDataSrc(uint8_t seg, uint8_t *src, uint8_t cnt) {
-  _segment_runtimes[seg].extDataSrc = src;
-  _segment_runtimes[seg].extDataCnt = cnt;
+void WS2812FX_setExtDataSrc(WS2812FX_Ctx *ctx, uint8_t seg, uint8_t *src, uint8_t cnt) {
+  uint8_t slot = WS2812FX_slotOf(ctx, seg);
+  if(slot == INACTIVE_SEGMENT) return; // segment not active
+  ctx->segment_runtimes[slot].extDataSrc = src;
+  ctx->segment_runtimes[slot].extDataCnt = cnt;
 }
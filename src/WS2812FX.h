@@ -38,15 +38,43 @@
 #define WS2812FX_h
 
 #include "Adafruit_NeoPixel.h"
+#include "WS2812FX_math.h"
+#include "ws2812_user_def.h"
+
+// the output stage renders the pixels into a separate transmit buffer
+#if DEFERRED_BRIGHTNESS || DOUBLE_BUFFER || POWER_LIMIT
+#define HAS_TX_BUFFER 1
+#endif
 
 #define MAX_MILLIS (0UL - 1UL) /* ULONG_MAX */
+#define MAX_MICROS (0ULL - 1ULL) /* UINT64_MAX */
+
+// wrap-safe comparison of two 64-bit microsecond timestamps
+#define TIME_BEFORE(a, b) ((int64_t)((a) - (b)) < 0)
 
+#ifndef DEFAULT_BRIGHTNESS
 #define DEFAULT_BRIGHTNESS 100
+#endif
+#ifndef DEFAULT_MODE
 #define DEFAULT_MODE 1
+#endif
+#ifndef DEFAULT_SPEED
 #define DEFAULT_SPEED 255
+#endif
+#ifndef DEFAULT_GAMMA
+#define DEFAULT_GAMMA 26 // gamma exponent x10, i.e. 2.6
+#endif
 
-#define MAX_NUM_SEGMENTS        16
-#define MAX_NUM_ACTIVE_SEGMENTS 16
+// current model of a single LED, used by WS2812FX_estimateCurrent()
+#ifndef LED_CHANNEL_UA
+#define LED_CHANNEL_UA 20000 // microamps drawn by one channel at full (255)
+#endif
+#ifndef LED_IDLE_UA
+#define LED_IDLE_UA     1000 // microamps drawn by the LED's controller while off
+#endif
+#ifndef DEFAULT_POWER_SLEW
+#define DEFAULT_POWER_SLEW 4 // power limiter recovery per frame, in 1/256
+#endif
 
 #define DEFAULT_COLOR      (uint32_t)0xFF0000
 #define DEFAULT_COLORS     { RED, GREEN, BLUE }
@@ -55,17 +83,40 @@
 #define SPEED_MIN (uint16_t)10
 #define SPEED_MAX (uint16_t)65535
 
+#ifndef MIN_FRAME_US
+#define MIN_FRAME_US (uint32_t)(SPEED_MIN * 1000UL)
+#endif
+
 #define BRIGHTNESS_MIN (uint8_t)0
 #define BRIGHTNESS_MAX (uint8_t)255
 
-/* each segment uses 36 bytes of SRAM memory, so if you're compile fails
-  because of insufficient flash memory, decreasing MAX_NUM_SEGMENTS may help */
-#define MAX_NUM_SEGMENTS         1
-#define MAX_NUM_ACTIVE_SEGMENTS  1
+/* upper limits for the number of segments. The memory for the segments is
+  taken from the arena handed to WS2812FX_init(), see WS2812FX_requiredBytes() */
+#ifndef MAX_NUM_SEGMENTS
+#define MAX_NUM_SEGMENTS        16
+#endif
+#ifndef MAX_NUM_ACTIVE_SEGMENTS
+#define MAX_NUM_ACTIVE_SEGMENTS 16
+#endif
 #define INACTIVE_SEGMENT        255 /* max uint_8 */
 #define MAX_NUM_COLORS            3 /* number of colors per segment */
+#ifndef MAX_NUM_PALETTES
+#define MAX_NUM_PALETTES          4 /* 256 colors each, palette 0 is the color wheel */
+#endif
 #define MAX_CUSTOM_MODES          8
 
+// arena layout: every region starts on an ARENA_ALIGN boundary (cache line)
+#ifndef ARENA_ALIGN
+#define ARENA_ALIGN              32
+#endif
+// size of the scratch memory pool the modes can allocate per segment state from
+#ifndef SCRATCH_BYTES_PER_SEGMENT
+#define SCRATCH_BYTES_PER_SEGMENT 64
+#endif
+#ifndef SCRATCH_BYTES_PER_LED
+#define SCRATCH_BYTES_PER_LED      2
+#endif
+
 // some common colors
 #define RED        (uint32_t)0xFF0000
 #define GREEN      (uint32_t)0x00FF00
@@ -91,7 +142,7 @@
 // bits   0: TBD
 #define NO_OPTIONS   (uint8_t)0b00000000
 #define REVERSE      (uint8_t)0b10000000
-#define IS_REVERSE   ((_seg->options & REVERSE) == REVERSE)
+#define IS_REVERSE   ((ctx->seg->options & REVERSE) == REVERSE)
 #define FADE_XFAST   (uint8_t)0b00010000
 #define FADE_FAST    (uint8_t)0b00100000
 #define FADE_MEDIUM  (uint8_t)0b00110000
@@ -99,23 +150,23 @@
 #define FADE_XSLOW   (uint8_t)0b01010000
 #define FADE_XXSLOW  (uint8_t)0b01100000
 #define FADE_GLACIAL (uint8_t)0b01110000
-#define FADE_RATE    ((_seg->options >> 4) & 7)
+#define FADE_RATE    ((ctx->seg->options >> 4) & 7)
 #define GAMMA        (uint8_t)0b00001000
-#define IS_GAMMA     ((_seg->options & GAMMA) == GAMMA)
+#define IS_GAMMA     ((ctx->seg->options & GAMMA) == GAMMA)
 #define SIZE_SMALL   (uint8_t)0b00000000
 #define SIZE_MEDIUM  (uint8_t)0b00000010
 #define SIZE_LARGE   (uint8_t)0b00000100
 #define SIZE_XLARGE  (uint8_t)0b00000110
-#define SIZE_OPTION  ((_seg->options >> 1) & 3)
+#define SIZE_OPTION  ((ctx->seg->options >> 1) & 3)
 
 // segment runtime options (aux_param2)
 #define FRAME           (uint8_t)0b10000000
-#define SET_FRAME       (_seg_rt->aux_param2 |=  FRAME)
-#define CLR_FRAME       (_seg_rt->aux_param2 &= ~FRAME)
+#define SET_FRAME       (ctx->seg_rt->aux_param2 |=  FRAME)
+#define CLR_FRAME       (ctx->seg_rt->aux_param2 &= ~FRAME)
 #define CYCLE           (uint8_t)0b01000000
-#define SET_CYCLE       (_seg_rt->aux_param2 |=  CYCLE)
-#define CLR_CYCLE       (_seg_rt->aux_param2 &= ~CYCLE)
-#define CLR_FRAME_CYCLE (_seg_rt->aux_param2 &= ~(FRAME | CYCLE))
+#define SET_CYCLE       (ctx->seg_rt->aux_param2 |=  CYCLE)
+#define CLR_CYCLE       (ctx->seg_rt->aux_param2 &= ~CYCLE)
+#define CLR_FRAME_CYCLE (ctx->seg_rt->aux_param2 &= ~(FRAME | CYCLE))
 
 // class WS2812FX : public Adafruit_NeoPixel {
 
@@ -123,18 +174,20 @@
   //   typedef uint16_t (WS2812FX_*mode_ptr)(void);
 
 // segment parameters
-typedef struct WS2812FX_segment{ // 20 bytes
+typedef struct WS2812FX_segment{ // 24 bytes
   uint16_t start;
   uint16_t stop;
   uint16_t speed;
   uint8_t  mode;
   uint8_t  options;
+  uint8_t  brightness; // stored as +1 like the strip's, 0 = full (DEFERRED_BRIGHTNESS only)
+  uint8_t  palette;    // colors the modes pick by index, 0 = color wheel
   uint32_t colors[MAX_NUM_COLORS];
 } WS2812FX_Segment;
 
 // segment runtime parameters
-typedef struct WS2812FX_segment_runtime { // 20 bytes for Arduino, 24 bytes for ESP
-  unsigned long next_time;
+typedef struct WS2812FX_segment_runtime { // 40 bytes on 32-bit ARM, 48 bytes on 64-bit hosts
+  uint64_t next_time;   // micros
   uint32_t counter_mode_step;
   uint32_t counter_mode_call;
   uint8_t  aux_param;   // auxilary param (usually stores a color_wheel index)
@@ -142,242 +195,371 @@ typedef struct WS2812FX_segment_runtime { // 20 bytes for Arduino, 24 bytes for
   uint16_t aux_param3;  // auxilary param (usually stores a segment index)
   uint8_t* extDataSrc; // external data array
   uint16_t extDataCnt;    // number of elements in the external data array
+  uint16_t scratch_len;   // size of the scratch memory
+  uint16_t rotation;      // physical offset of the segment's first pixel, see WS2812FX_scroll()
+  uint8_t* scratch;       // per segment state of the mode, see WS2812FX_allocScratch()
 } WS2812FX_Segment_runtime;
 
-extern WS2812FX_Segment* _seg;
-extern WS2812FX_Segment_runtime* _seg_rt;
-extern uint16_t _seg_len;
-extern bool _triggered;
-extern uint16_t (*customModes[MAX_CUSTOM_MODES])(void);
+typedef struct WS2812FX_ctx WS2812FX_Ctx;
+typedef uint16_t (*WS2812FX_mode_ptr)(WS2812FX_Ctx*);
+
+// scratch memory a mode needs for a segment, carved when the mode is selected
+typedef uint16_t (*WS2812FX_scratch_ptr)(const WS2812FX_Segment*, const WS2812FX_Segment_runtime*);
+
+// engine instance, everything that used to live in file scope globals
+struct WS2812FX_ctx {
+  Adafruit_NeoPixel strip;
+
+  WS2812FX_Segment* segments;                 // array of segments
+  WS2812FX_Segment_runtime* segment_runtimes; // array of segment runtimes
+  uint8_t* active_segments;                   // array of active segments
+  uint8_t segments_len;        // size of segments array
+  uint8_t active_segments_len; // size of segments_runtime and active_segments arrays
+  uint8_t num_segments;        // number of configured segments in the segments array
+  uint8_t* seg_slot;           // runtime slot of each segment (INACTIVE_SEGMENT if not active)
+
+  WS2812FX_Segment* seg;             // currently active segment
+  WS2812FX_Segment_runtime* seg_rt;  // currently active segment runtime
+  uint16_t seg_len;                  // num LEDs in the currently active segment
+
+  bool running;
+  bool triggered;
+  uint16_t rand16seed;
+  uint32_t intensities[4];
+
+  void (*customShow)(WS2812FX_Ctx*);
+  WS2812FX_mode_ptr customModes[MAX_CUSTOM_MODES];
+
+  uint32_t* palettes;     // MAX_NUM_PALETTES tables of 256 colors
+  uint8_t* lut;           // gamma curve, gamma+brightness and brightness tables (3 x 256)
+  uint8_t gamma10;        // gamma exponent x10 the curve was built for
+  uint8_t lut_brightness; // strip brightness the tables were built for
+  bool lut_valid;
+
+  bool show_pending; // a frame is waiting for the transport (DOUBLE_BUFFER)
+
+  uint64_t (*micros)(void); // 64-bit monotonic microsecond clock
+  uint32_t min_frame_us;     // shortest interval between two frames of a segment
+
+  uint16_t current_ua[4]; // R, G, B, W channel current at full, in microamps
+  uint16_t idle_ua;       // per LED current while off, in microamps
+  uint32_t power_budget_ma; // current the output is scaled down to, 0 = no limit
+  uint8_t power_slew;       // how fast the limiter lets go, in 1/256 per frame (0 = at once)
+  bool power_settling;      // the limiter hasn't reached its target scale yet
+
+  // scheduler: active runtime slots kept in a min-heap ordered by next_time
+  uint8_t* sched_heap; // heap of runtime slot indexes
+  uint8_t* sched_pos;  // heap position of each slot (INACTIVE_SEGMENT if none)
+  uint8_t* sched_ran;  // slots run by the last service() call
+  uint8_t sched_len;   // number of slots in the heap
+  uint8_t sched_ran_len;
+
+  uint8_t* scratch_pool;   // memory for the runtimes' scratch blocks
+  size_t scratch_pool_len;
+  size_t scratch_used;     // blocks are packed at the start of the pool
+};
+
+size_t
+  WS2812FX_requiredBytes(uint16_t num_leds, neoPixelType type, uint8_t max_num_segments, uint8_t max_num_active_segments);
+
+#if SUPPORT_MALLOC
+WS2812FX_Ctx* WS2812FX_new(uint16_t num_leds, neoPixelType type, uint8_t max_num_segments, uint8_t max_num_active_segments);
+void WS2812FX_delete(WS2812FX_Ctx*);
+#endif
+
+uint8_t* WS2812FX_allocScratch(WS2812FX_Ctx*, uint16_t);
 
 void
 //    timer(void),
-  WS2812FX_init(uint16_t num_leds, neoPixelType type,
-                    uint8_t max_num_segments,// uint8_t max_num_segments=MAX_NUM_SEGMENTS
-                    uint8_t max_num_active_segments),
-  WS2812FX_start(void),
-  WS2812FX_stop(void),
-  WS2812FX_pause(void),
-  WS2812FX_resume(void),
-  WS2812FX_strip_off(void),
-  WS2812FX_fade_out(void),
-  WS2812FX_fade_out_targetColor(uint32_t),
-  WS2812FX_setMode_m(uint8_t m),
-  WS2812FX_setMode_seg_m(uint8_t seg, uint8_t m),
-  WS2812FX_setOptions(uint8_t seg, uint8_t o),
-  WS2812FX_setCustomMode_vp(uint16_t (*p)()),
-  WS2812FX_setCustomShow(void (*p)()),
-  WS2812FX_setSpeed_s(uint16_t s),
-  WS2812FX_setSpeed_seg_s(uint8_t seg, uint16_t s),
-  WS2812FX_increaseSpeed(uint8_t s),
-  WS2812FX_decreaseSpeed(uint8_t s),
-  WS2812FX_setColor_rgb(uint8_t r, uint8_t g, uint8_t b),
-  WS2812FX_setColor_rgbw(uint8_t r, uint8_t g, uint8_t b, uint8_t w),
-  WS2812FX_setColor_c(uint32_t c),
-  WS2812FX_setColor_seg_c(uint8_t seg, uint32_t c),
-  WS2812FX_setColors_seg_pc(uint8_t seg, uint32_t* c),
-  WS2812FX_fill(uint32_t c, uint16_t f, uint16_t cnt),
-  WS2812FX_setBrightness(uint8_t b),
-  WS2812FX_increaseBrightness(uint8_t s),
-  WS2812FX_decreaseBrightness(uint8_t s),
-  WS2812FX_setLength(uint16_t b),
-  WS2812FX_increaseLength(uint16_t s),
-  WS2812FX_decreaseLength(uint16_t s),
-  WS2812FX_trigger(void),
-  WS2812FX_setCycle(void),
-  WS2812FX_setNumSegments(uint8_t n),
-
-  WS2812FX_setSegment(),
-  WS2812FX_setSegment_n(uint8_t n),
-  WS2812FX_setSegment_n_start(uint8_t n, uint16_t start),
-  WS2812FX_setSegment_n_start_stop(uint8_t n, uint16_t start, uint16_t stop),
-  WS2812FX_setSegment_n_start_stop_mode(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode),
-  WS2812FX_setSegment_n_start_stop_mode_color(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color),
-  WS2812FX_setSegment_n_start_stop_mode_color_speed(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color, uint16_t speed),
-  WS2812FX_setSegment_n_start_stop_mode_color_speed_reverse(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color, uint16_t speed, bool reverse),
-  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color, uint16_t speed, uint8_t options),
-
-  WS2812FX_setSegment_n_start_stop_mode_colors(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[]),
-  WS2812FX_setSegment_n_start_stop_mode_colors_speed(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[], uint16_t speed),
-  WS2812FX_setSegment_n_start_stop_mode_colors_speed_reverse(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[], uint16_t speed, bool reverse),
-  WS2812FX_setSegment_n_start_stop_mode_colors_speed_options(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[], uint16_t speed, uint8_t options),
-
-  WS2812FX_setIdleSegment(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color,          uint16_t speed),
-  WS2812FX_setIdleSegment_options(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color,          uint16_t speed, uint8_t options),
-  WS2812FX_setIdleSegment_colors_options(uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[], uint16_t speed, uint8_t options),
-  WS2812FX_addActiveSegment(uint8_t seg),
-  WS2812FX_removeActiveSegment(uint8_t seg),
-  WS2812FX_swapActiveSegment(uint8_t oldSeg, uint8_t newSeg),
-
-  WS2812FX_resetSegments(void),
-  WS2812FX_resetSegmentRuntimes(void),
-  WS2812FX_resetSegmentRuntime(uint8_t),
-  WS2812FX_setPixelColor_nc(uint16_t n, uint32_t c),
-  WS2812FX_setPixelColor_nrgb(uint16_t n, uint8_t r, uint8_t g, uint8_t b),
-  WS2812FX_setPixelColor_nrgbw(uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w),
-  WS2812FX_setRawPixelColor(uint16_t n, uint32_t c),
-  WS2812FX_copyPixels(uint16_t d, uint16_t s, uint16_t c),
-  WS2812FX_setPixels(uint16_t, uint8_t*),
-  WS2812FX_setRandomSeed(uint16_t),
-  WS2812FX_setExtDataSrc(uint8_t seg, uint8_t *src, uint8_t cnt),
-  WS2812FX_show(void);
+  WS2812FX_start(WS2812FX_Ctx*),
+  WS2812FX_stop(WS2812FX_Ctx*),
+  WS2812FX_pause(WS2812FX_Ctx*),
+  WS2812FX_resume(WS2812FX_Ctx*),
+  WS2812FX_strip_off(WS2812FX_Ctx*),
+  WS2812FX_fade_out(WS2812FX_Ctx*),
+  WS2812FX_fade_out_targetColor(WS2812FX_Ctx*, uint32_t),
+  WS2812FX_setMode_m(WS2812FX_Ctx *ctx, uint8_t m),
+  WS2812FX_setMode_seg_m(WS2812FX_Ctx *ctx, uint8_t seg, uint8_t m),
+  WS2812FX_setOptions(WS2812FX_Ctx *ctx, uint8_t seg, uint8_t o),
+  WS2812FX_setCustomMode_vp(WS2812FX_Ctx*, WS2812FX_mode_ptr p),
+  WS2812FX_setCustomShow(WS2812FX_Ctx*, void (*p)(WS2812FX_Ctx*)),
+  WS2812FX_setClock(WS2812FX_Ctx*, uint64_t (*micros)(void)),
+  WS2812FX_setMinFrameInterval(WS2812FX_Ctx*, uint32_t),
+  WS2812FX_setSpeed_s(WS2812FX_Ctx *ctx, uint16_t s),
+  WS2812FX_setSpeed_seg_s(WS2812FX_Ctx *ctx, uint8_t seg, uint16_t s),
+  WS2812FX_increaseSpeed(WS2812FX_Ctx *ctx, uint8_t s),
+  WS2812FX_decreaseSpeed(WS2812FX_Ctx *ctx, uint8_t s),
+  WS2812FX_setColor_rgb(WS2812FX_Ctx *ctx, uint8_t r, uint8_t g, uint8_t b),
+  WS2812FX_setColor_rgbw(WS2812FX_Ctx *ctx, uint8_t r, uint8_t g, uint8_t b, uint8_t w),
+  WS2812FX_setColor_c(WS2812FX_Ctx *ctx, uint32_t c),
+  WS2812FX_setColor_seg_c(WS2812FX_Ctx *ctx, uint8_t seg, uint32_t c),
+  WS2812FX_setColors_seg_pc(WS2812FX_Ctx *ctx, uint8_t seg, uint32_t* c),
+  WS2812FX_fill(WS2812FX_Ctx *ctx, uint32_t c, uint16_t f, uint16_t cnt),
+  WS2812FX_setBrightness(WS2812FX_Ctx *ctx, uint8_t b),
+  WS2812FX_increaseBrightness(WS2812FX_Ctx *ctx, uint8_t s),
+  WS2812FX_decreaseBrightness(WS2812FX_Ctx *ctx, uint8_t s),
+  WS2812FX_setSegmentBrightness(WS2812FX_Ctx *ctx, uint8_t seg, uint8_t b),
+  WS2812FX_setGamma(WS2812FX_Ctx *ctx, uint8_t gamma10),
+  WS2812FX_setSegmentPalette(WS2812FX_Ctx *ctx, uint8_t seg, uint8_t palette),
+  WS2812FX_setCurrentModel(WS2812FX_Ctx *ctx, const uint16_t channel_ua[4], uint16_t idle_ua),
+  WS2812FX_setPowerBudget(WS2812FX_Ctx *ctx, uint32_t budget_ma, uint8_t per_channel_ma),
+  WS2812FX_setPowerSlew(WS2812FX_Ctx *ctx, uint8_t slew),
+  WS2812FX_setLength(WS2812FX_Ctx *ctx, uint16_t b),
+  WS2812FX_increaseLength(WS2812FX_Ctx *ctx, uint16_t s),
+  WS2812FX_decreaseLength(WS2812FX_Ctx *ctx, uint16_t s),
+  WS2812FX_trigger(WS2812FX_Ctx*),
+  WS2812FX_setCycle(WS2812FX_Ctx*),
+  WS2812FX_setNumSegments(WS2812FX_Ctx *ctx, uint8_t n),
+
+  WS2812FX_setSegment(WS2812FX_Ctx*),
+  WS2812FX_setSegment_n(WS2812FX_Ctx *ctx, uint8_t n),
+  WS2812FX_setSegment_n_start(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start),
+  WS2812FX_setSegment_n_start_stop(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop),
+  WS2812FX_setSegment_n_start_stop_mode(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode),
+  WS2812FX_setSegment_n_start_stop_mode_color(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color),
+  WS2812FX_setSegment_n_start_stop_mode_color_speed(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color, uint16_t speed),
+  WS2812FX_setSegment_n_start_stop_mode_color_speed_reverse(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color, uint16_t speed, bool reverse),
+  WS2812FX_setSegment_n_start_stop_mode_color_speed_options(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color, uint16_t speed, uint8_t options),
+
+  WS2812FX_setSegment_n_start_stop_mode_colors(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[]),
+  WS2812FX_setSegment_n_start_stop_mode_colors_speed(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[], uint16_t speed),
+  WS2812FX_setSegment_n_start_stop_mode_colors_speed_reverse(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[], uint16_t speed, bool reverse),
+  WS2812FX_setSegment_n_start_stop_mode_colors_speed_options(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[], uint16_t speed, uint8_t options),
+
+  WS2812FX_setIdleSegment(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color,          uint16_t speed),
+  WS2812FX_setIdleSegment_options(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, uint32_t color,          uint16_t speed, uint8_t options),
+  WS2812FX_setIdleSegment_colors_options(WS2812FX_Ctx *ctx, uint8_t n, uint16_t start, uint16_t stop, uint8_t mode, const uint32_t colors[], uint16_t speed, uint8_t options),
+  WS2812FX_addActiveSegment(WS2812FX_Ctx *ctx, uint8_t seg),
+  WS2812FX_removeActiveSegment(WS2812FX_Ctx *ctx, uint8_t seg),
+  WS2812FX_swapActiveSegment(WS2812FX_Ctx *ctx, uint8_t oldSeg, uint8_t newSeg),
+
+  WS2812FX_resetSegments(WS2812FX_Ctx*),
+  WS2812FX_resetSegmentRuntimes(WS2812FX_Ctx*),
+  WS2812FX_resetSegmentRuntime(WS2812FX_Ctx*, uint8_t),
+  WS2812FX_setPixelColor_nc(WS2812FX_Ctx *ctx, uint16_t n, uint32_t c),
+  WS2812FX_setPixelColor_nrgb(WS2812FX_Ctx *ctx, uint16_t n, uint8_t r, uint8_t g, uint8_t b),
+  WS2812FX_setPixelColor_nrgbw(WS2812FX_Ctx *ctx, uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w),
+  WS2812FX_setRawPixelColor(WS2812FX_Ctx *ctx, uint16_t n, uint32_t c),
+  WS2812FX_encodePixel(WS2812FX_Ctx *ctx, uint32_t c, uint8_t *pixel),
+  WS2812FX_copyPixels(WS2812FX_Ctx *ctx, uint16_t d, uint16_t s, uint16_t c),
+  WS2812FX_scroll(WS2812FX_Ctx *ctx, int16_t n),
+  WS2812FX_setPixels(WS2812FX_Ctx*, uint16_t, uint8_t*),
+  WS2812FX_setRandomSeed(WS2812FX_Ctx*, uint16_t),
+  WS2812FX_setExtDataSrc(WS2812FX_Ctx *ctx, uint8_t seg, uint8_t *src, uint8_t cnt),
+  WS2812FX_show(WS2812FX_Ctx*);
 
 bool
-  WS2812FX_service(void),
-  WS2812FX_isRunning(void),
-  WS2812FX_isTriggered(void),
-  WS2812FX_isFrame(void),
-  WS2812FX_isFrame_seg(uint8_t),
-  WS2812FX_isCycle(void),
-  WS2812FX_isCycle_seg(uint8_t),
-  WS2812FX_isActiveSegment(uint8_t seg);
+  WS2812FX_fadeSpan(uint8_t *pixels, uint16_t cnt, const uint8_t *target, uint8_t bytesPerPixel, uint8_t rate),
+  WS2812FX_init(WS2812FX_Ctx *ctx, void *arena, size_t arena_size, uint16_t num_leds, neoPixelType type,
+                    uint8_t max_num_segments,// uint8_t max_num_segments=MAX_NUM_SEGMENTS
+                    uint8_t max_num_active_segments),
+  WS2812FX_service(WS2812FX_Ctx*),
+  WS2812FX_service_next(WS2812FX_Ctx*, uint64_t*),
+  WS2812FX_showAsync(WS2812FX_Ctx*),
+  WS2812FX_isRunning(WS2812FX_Ctx*),
+  WS2812FX_isTriggered(WS2812FX_Ctx*),
+  WS2812FX_isFrame(WS2812FX_Ctx*),
+  WS2812FX_isFrame_seg(WS2812FX_Ctx*, uint8_t),
+  WS2812FX_isCycle(WS2812FX_Ctx*),
+  WS2812FX_isCycle_seg(WS2812FX_Ctx*, uint8_t),
+  WS2812FX_isActiveSegment(WS2812FX_Ctx *ctx, uint8_t seg),
+  WS2812FX_setPaletteGradient(WS2812FX_Ctx *ctx, uint8_t palette, const uint32_t *stops, uint8_t num_stops);
 
 uint8_t
-  WS2812FX_random8(void),
-  WS2812FX_random8_lim(uint8_t),
-  WS2812FX_random(uint8_t, uint8_t),
-  WS2812FX_getMode(void),
-  WS2812FX_getMode_seg(uint8_t),
-  WS2812FX_getModeCount(void),
-  WS2812FX_setCustomMode_p(uint16_t (*p)()),
-  WS2812FX_setCustomMode_index_p(uint8_t i, uint16_t (*p)()),
-  WS2812FX_getNumSegments(void),
-  WS2812FX_get_random_wheel_index(uint8_t),
-  WS2812FX_getOptions(uint8_t),
-  WS2812FX_getNumBytesPerPixel(void);
+  WS2812FX_random8(WS2812FX_Ctx*),
+  WS2812FX_random8_lim(WS2812FX_Ctx*, uint8_t),
+  WS2812FX_random(WS2812FX_Ctx*, uint8_t, uint8_t),
+  WS2812FX_getMode(WS2812FX_Ctx*),
+  WS2812FX_getMode_seg(WS2812FX_Ctx*, uint8_t),
+  WS2812FX_getModeCount(WS2812FX_Ctx*),
+  WS2812FX_setCustomMode_p(WS2812FX_Ctx*, WS2812FX_mode_ptr p),
+  WS2812FX_setCustomMode_index_p(WS2812FX_Ctx*, uint8_t, WS2812FX_mode_ptr),
+  WS2812FX_getNumSegments(WS2812FX_Ctx*),
+  WS2812FX_get_random_wheel_index(WS2812FX_Ctx*, uint8_t),
+  WS2812FX_getOptions(WS2812FX_Ctx*, uint8_t),
+  WS2812FX_getSegmentBrightness(WS2812FX_Ctx*, uint8_t),
+  WS2812FX_getGamma(WS2812FX_Ctx*),
+  WS2812FX_getSegmentPalette(WS2812FX_Ctx*, uint8_t),
+  WS2812FX_getNumBytesPerPixel(WS2812FX_Ctx*);
 
 uint16_t
-  WS2812FX_random16(void),
-  WS2812FX_random16_lim(uint16_t),
-  WS2812FX_getSpeed(void),
-  WS2812FX_getSpeed_seg(uint8_t),
-  WS2812FX_getLength(void),
-  WS2812FX_getNumBytes(void);
+  WS2812FX_random16(WS2812FX_Ctx*),
+  WS2812FX_random16_lim(WS2812FX_Ctx*, uint16_t),
+  WS2812FX_getSpeed(WS2812FX_Ctx*),
+  WS2812FX_getSpeed_seg(WS2812FX_Ctx*, uint8_t),
+  WS2812FX_getLength(WS2812FX_Ctx*),
+  WS2812FX_getNumBytes(WS2812FX_Ctx*);
+
+uint64_t
+  WS2812FX_nextDeadline(WS2812FX_Ctx*),
+  WS2812FX_serviceUntil(WS2812FX_Ctx*);
 
 uint32_t
   WS2812FX_color_wheel(uint8_t),
-  WS2812FX_getColor(void),
-  WS2812FX_getColor_seg(uint8_t),
-  WS2812FX_intensitySum(void);
+  WS2812FX_getColor(WS2812FX_Ctx*),
+  WS2812FX_getColor_seg(WS2812FX_Ctx*, uint8_t),
+  WS2812FX_intensitySum(WS2812FX_Ctx*),
+  WS2812FX_estimateCurrent(WS2812FX_Ctx*);
+
+uint32_t* WS2812FX_getColors(WS2812FX_Ctx*, uint8_t);
+uint32_t* WS2812FX_getPalette(WS2812FX_Ctx*, uint8_t);
+uint32_t* WS2812FX_intensitySums(WS2812FX_Ctx*);
+uint8_t*  WS2812FX_getActiveSegments(WS2812FX_Ctx*);
+uint8_t*  WS2812FX_blend(uint8_t*, uint8_t*, uint8_t*, uint16_t, uint8_t);
+uint8_t*  WS2812FX_blendSpan(uint8_t*, const uint8_t*, const uint8_t*, uint16_t, uint8_t);
+
+// color at index pos of the current segment's palette
+static inline uint32_t WS2812FX_paletteColor(WS2812FX_Ctx *ctx, uint8_t pos) {
+  return ctx->palettes[((uint16_t)ctx->seg->palette << 8) | pos];
+}
+
+// physical index of pixel i (0 = start) of the current segment
+static inline uint16_t WS2812FX_segPixel(WS2812FX_Ctx *ctx, uint16_t i) {
+  i += ctx->seg_rt->rotation;
+  return ctx->seg->start + (i >= ctx->seg_len ? i - ctx->seg_len : i);
+}
 
-uint32_t* getColors(uint8_t);
-uint32_t* intensitySums(void);
-uint8_t*  getActiveSegments(void);
-uint8_t*  blend(uint8_t*, uint8_t*, uint8_t*, uint16_t, uint8_t);
+WS2812FX_Segment* WS2812FX_getSegment(WS2812FX_Ctx*);
 
-WS2812FX_Segment* WS2812FX_getSegment(void);
+WS2812FX_Segment* WS2812FX_getSegment_seg(WS2812FX_Ctx*, uint8_t);
 
-WS2812FX_Segment* WS2812FX_getSegment_seg(uint8_t);
+WS2812FX_Segment* WS2812FX_getSegments(WS2812FX_Ctx*);
 
-WS2812FX_Segment* WS2812FX_getSegments(void);
+WS2812FX_Segment_runtime* WS2812FX_getSegmentRuntime(WS2812FX_Ctx*);
 
-WS2812FX_Segment_runtime* WS2812FX_getSegmentRuntime(void);
+WS2812FX_Segment_runtime* WS2812FX_getSegmentRuntime_seg(WS2812FX_Ctx*, uint8_t);
 
-WS2812FX_Segment_runtime* WS2812FX_getSegmentRuntime_seg(uint8_t);
+WS2812FX_Segment_runtime* WS2812FX_getSegmentRuntimes(WS2812FX_Ctx*);
 
-WS2812FX_Segment_runtime* WS2812FX_getSegmentRuntimes(void);
+// particle system, see WS2812FX_particles.c
+#define PARTICLE_SHIFT 16                    // positions and velocities are 16.16 fixed point
+#define PARTICLE_ONE   (1L << PARTICLE_SHIFT) // one pixel, or one pixel per frame
+#define PARTICLE_BYTES (4 + 4 + 4 + 2)         // scratch memory per particle: pos, vel, color, life
+
+typedef struct WS2812FX_particles {
+  uint16_t  count;
+  int32_t*  pos;   // pixels from the segment's start
+  int32_t*  vel;   // pixels per frame
+  uint32_t* color;
+  uint16_t* life;  // frames left, 0 = free slot
+} WS2812FX_Particles;
+
+bool WS2812FX_particles(WS2812FX_Ctx*, WS2812FX_Particles*, uint16_t count);
+int16_t WS2812FX_particles_emit(WS2812FX_Particles*, int32_t pos, int32_t vel, uint32_t color, uint16_t life);
+void WS2812FX_particles_emitAt(WS2812FX_Particles*, uint16_t slot, int32_t pos, int32_t vel, uint32_t color, uint16_t life);
+void WS2812FX_particles_update(WS2812FX_Particles*, int32_t accel, uint16_t decay);
+void WS2812FX_particles_render(WS2812FX_Ctx*, WS2812FX_Particles*);
 
 // mode helper functions
 uint16_t
-  WS2812FX_blink(uint32_t, uint32_t, bool strobe),
-  WS2812FX_color_wipe(uint32_t, uint32_t, bool),
-  WS2812FX_twinkle(uint32_t, uint32_t),
-  WS2812FX_twinkle_fade(uint32_t),
-  WS2812FX_sparkle(uint32_t, uint32_t),
-  WS2812FX_chase(uint32_t, uint32_t, uint32_t),
-  WS2812FX_chase_flash(uint32_t, uint32_t),
-  WS2812FX_running(uint32_t, uint32_t),
-  WS2812FX_fireworks(uint32_t),
-  WS2812FX_fire_flicker(int),
-  WS2812FX_tricolor_chase(uint32_t, uint32_t, uint32_t),
-  WS2812FX_scan(uint32_t, uint32_t, bool);
+  WS2812FX_blink(WS2812FX_Ctx*, uint32_t, uint32_t, bool strobe),
+  WS2812FX_color_wipe(WS2812FX_Ctx*, uint32_t, uint32_t, bool),
+  WS2812FX_twinkle(WS2812FX_Ctx*, uint32_t, uint32_t),
+  WS2812FX_twinkle_fade(WS2812FX_Ctx*, uint32_t),
+  WS2812FX_sparkle(WS2812FX_Ctx*, uint32_t, uint32_t),
+  WS2812FX_dissolve(WS2812FX_Ctx*),
+  WS2812FX_chase(WS2812FX_Ctx*, uint32_t, uint32_t, uint32_t),
+  WS2812FX_chase_flash(WS2812FX_Ctx*, uint32_t, uint32_t),
+  WS2812FX_running(WS2812FX_Ctx*, uint32_t, uint32_t),
+  WS2812FX_fireworks(WS2812FX_Ctx*, uint32_t),
+  WS2812FX_fire_flicker(WS2812FX_Ctx*, int),
+  WS2812FX_tricolor_chase(WS2812FX_Ctx*, uint32_t, uint32_t, uint32_t),
+  WS2812FX_scan(WS2812FX_Ctx*, uint32_t, uint32_t, bool);
 
 uint32_t
   WS2812FX_color_blend(uint32_t, uint32_t, uint8_t),
-  WS2812FX_getRawPixelColor(uint16_t n);
+  WS2812FX_getRawPixelColor(WS2812FX_Ctx *ctx, uint16_t n);
 
 // builtin modes
 uint16_t
-  WS2812FX_mode_static(void),
-  WS2812FX_mode_blink(void),
-  WS2812FX_mode_blink_rainbow(void),
-  WS2812FX_mode_strobe(void),
-  WS2812FX_mode_strobe_rainbow(void),
-  WS2812FX_mode_color_wipe(void),
-  WS2812FX_mode_color_wipe_inv(void),
-  WS2812FX_mode_color_wipe_rev(void),
-  WS2812FX_mode_color_wipe_rev_inv(void),
-  WS2812FX_mode_color_wipe_random(void),
-  WS2812FX_mode_color_sweep_random(void),
-  WS2812FX_mode_random_color(void),
-  WS2812FX_mode_single_dynamic(void),
-  WS2812FX_mode_multi_dynamic(void),
-  WS2812FX_mode_breath(void),
-  WS2812FX_mode_fade(void),
-  WS2812FX_mode_scan(void),
-  WS2812FX_mode_dual_scan(void),
-  WS2812FX_mode_theater_chase(void),
-  WS2812FX_mode_theater_chase_rainbow(void),
-  WS2812FX_mode_rainbow(void),
-  WS2812FX_mode_rainbow_cycle(void),
-  WS2812FX_mode_running_lights(void),
-  WS2812FX_mode_twinkle(void),
-  WS2812FX_mode_twinkle_random(void),
-  WS2812FX_mode_twinkle_fade(void),
-  WS2812FX_mode_twinkle_fade_random(void),
-  WS2812FX_mode_sparkle(void),
-  WS2812FX_mode_flash_sparkle(void),
-  WS2812FX_mode_hyper_sparkle(void),
-  WS2812FX_mode_multi_strobe(void),
-  WS2812FX_mode_chase_white(void),
-  WS2812FX_mode_chase_color(void),
-  WS2812FX_mode_chase_random(void),
-  WS2812FX_mode_chase_rainbow(void),
-  WS2812FX_mode_chase_flash(void),
-  WS2812FX_mode_chase_flash_random(void),
-  WS2812FX_mode_chase_rainbow_white(void),
-  WS2812FX_mode_chase_blackout(void),
-  WS2812FX_mode_chase_blackout_rainbow(void),
-  WS2812FX_mode_running_color(void),
-  WS2812FX_mode_running_red_blue(void),
-  WS2812FX_mode_running_random(void),
-  WS2812FX_mode_larson_scanner(void),
-  WS2812FX_mode_comet(void),
-  WS2812FX_mode_fireworks(void),
-  WS2812FX_mode_fireworks_random(void),
-  WS2812FX_mode_merry_christmas(void),
-  WS2812FX_mode_halloween(void),
-  WS2812FX_mode_fire_flicker(void),
-  WS2812FX_mode_fire_flicker_soft(void),
-  WS2812FX_mode_fire_flicker_intense(void),
-  WS2812FX_mode_circus_combustus(void),
-  WS2812FX_mode_bicolor_chase(void),
-  WS2812FX_mode_tricolor_chase(void),
-  WS2812FX_mode_twinkleFOX(void),
-  WS2812FX_mode_rain(void),
-  WS2812FX_mode_block_dissolve(void),
-  WS2812FX_mode_icu(void),
-  WS2812FX_mode_dual_larson(void),
-  WS2812FX_mode_running_random2(void),
-  WS2812FX_mode_filler_up(void),
-  WS2812FX_mode_rainbow_larson(void),
-  WS2812FX_mode_rainbow_fireworks(void),
-  WS2812FX_mode_trifade(void),
-  WS2812FX_mode_vu_meter(void),
-  WS2812FX_mode_heartbeat(void),
-  WS2812FX_mode_bits(void),
-  WS2812FX_mode_multi_comet(void),
-  WS2812FX_mode_flipbook(void),
-  WS2812FX_mode_popcorn(void),
-  WS2812FX_mode_oscillator(void),
-  WS2812FX_mode_custom_0(void),
-  WS2812FX_mode_custom_1(void),
-  WS2812FX_mode_custom_2(void),
-  WS2812FX_mode_custom_3(void),
-  WS2812FX_mode_custom_4(void),
-  WS2812FX_mode_custom_5(void),
-  WS2812FX_mode_custom_6(void),
-  WS2812FX_mode_custom_7(void);
+  WS2812FX_mode_static(WS2812FX_Ctx*),
+  WS2812FX_mode_blink(WS2812FX_Ctx*),
+  WS2812FX_mode_blink_rainbow(WS2812FX_Ctx*),
+  WS2812FX_mode_strobe(WS2812FX_Ctx*),
+  WS2812FX_mode_strobe_rainbow(WS2812FX_Ctx*),
+  WS2812FX_mode_color_wipe(WS2812FX_Ctx*),
+  WS2812FX_mode_color_wipe_inv(WS2812FX_Ctx*),
+  WS2812FX_mode_color_wipe_rev(WS2812FX_Ctx*),
+  WS2812FX_mode_color_wipe_rev_inv(WS2812FX_Ctx*),
+  WS2812FX_mode_color_wipe_random(WS2812FX_Ctx*),
+  WS2812FX_mode_color_sweep_random(WS2812FX_Ctx*),
+  WS2812FX_mode_random_color(WS2812FX_Ctx*),
+  WS2812FX_mode_single_dynamic(WS2812FX_Ctx*),
+  WS2812FX_mode_multi_dynamic(WS2812FX_Ctx*),
+  WS2812FX_mode_breath(WS2812FX_Ctx*),
+  WS2812FX_mode_fade(WS2812FX_Ctx*),
+  WS2812FX_mode_scan(WS2812FX_Ctx*),
+  WS2812FX_mode_dual_scan(WS2812FX_Ctx*),
+  WS2812FX_mode_theater_chase(WS2812FX_Ctx*),
+  WS2812FX_mode_theater_chase_rainbow(WS2812FX_Ctx*),
+  WS2812FX_mode_rainbow(WS2812FX_Ctx*),
+  WS2812FX_mode_rainbow_cycle(WS2812FX_Ctx*),
+  WS2812FX_mode_running_lights(WS2812FX_Ctx*),
+  WS2812FX_mode_twinkle(WS2812FX_Ctx*),
+  WS2812FX_mode_twinkle_random(WS2812FX_Ctx*),
+  WS2812FX_mode_twinkle_fade(WS2812FX_Ctx*),
+  WS2812FX_mode_twinkle_fade_random(WS2812FX_Ctx*),
+  WS2812FX_mode_sparkle(WS2812FX_Ctx*),
+  WS2812FX_mode_flash_sparkle(WS2812FX_Ctx*),
+  WS2812FX_mode_hyper_sparkle(WS2812FX_Ctx*),
+  WS2812FX_mode_multi_strobe(WS2812FX_Ctx*),
+  WS2812FX_mode_chase_white(WS2812FX_Ctx*),
+  WS2812FX_mode_chase_color(WS2812FX_Ctx*),
+  WS2812FX_mode_chase_random(WS2812FX_Ctx*),
+  WS2812FX_mode_chase_rainbow(WS2812FX_Ctx*),
+  WS2812FX_mode_chase_flash(WS2812FX_Ctx*),
+  WS2812FX_mode_chase_flash_random(WS2812FX_Ctx*),
+  WS2812FX_mode_chase_rainbow_white(WS2812FX_Ctx*),
+  WS2812FX_mode_chase_blackout(WS2812FX_Ctx*),
+  WS2812FX_mode_chase_blackout_rainbow(WS2812FX_Ctx*),
+  WS2812FX_mode_running_color(WS2812FX_Ctx*),
+  WS2812FX_mode_running_red_blue(WS2812FX_Ctx*),
+  WS2812FX_mode_running_random(WS2812FX_Ctx*),
+  WS2812FX_mode_larson_scanner(WS2812FX_Ctx*),
+  WS2812FX_mode_comet(WS2812FX_Ctx*),
+  WS2812FX_mode_fireworks(WS2812FX_Ctx*),
+  WS2812FX_mode_fireworks_random(WS2812FX_Ctx*),
+  WS2812FX_mode_merry_christmas(WS2812FX_Ctx*),
+  WS2812FX_mode_halloween(WS2812FX_Ctx*),
+  WS2812FX_mode_fire_flicker(WS2812FX_Ctx*),
+  WS2812FX_mode_fire_flicker_soft(WS2812FX_Ctx*),
+  WS2812FX_mode_fire_flicker_intense(WS2812FX_Ctx*),
+  WS2812FX_mode_circus_combustus(WS2812FX_Ctx*),
+  WS2812FX_mode_bicolor_chase(WS2812FX_Ctx*),
+  WS2812FX_mode_tricolor_chase(WS2812FX_Ctx*),
+  WS2812FX_mode_twinkleFOX(WS2812FX_Ctx*),
+  WS2812FX_mode_rain(WS2812FX_Ctx*),
+  WS2812FX_mode_block_dissolve(WS2812FX_Ctx*),
+  WS2812FX_mode_icu(WS2812FX_Ctx*),
+  WS2812FX_mode_dual_larson(WS2812FX_Ctx*),
+  WS2812FX_mode_running_random2(WS2812FX_Ctx*),
+  WS2812FX_mode_filler_up(WS2812FX_Ctx*),
+  WS2812FX_mode_rainbow_larson(WS2812FX_Ctx*),
+  WS2812FX_mode_rainbow_fireworks(WS2812FX_Ctx*),
+  WS2812FX_mode_trifade(WS2812FX_Ctx*),
+  WS2812FX_mode_vu_meter(WS2812FX_Ctx*),
+  WS2812FX_mode_heartbeat(WS2812FX_Ctx*),
+  WS2812FX_mode_bits(WS2812FX_Ctx*),
+  WS2812FX_mode_multi_comet(WS2812FX_Ctx*),
+  WS2812FX_mode_flipbook(WS2812FX_Ctx*),
+  WS2812FX_mode_popcorn(WS2812FX_Ctx*),
+  WS2812FX_mode_oscillator(WS2812FX_Ctx*),
+  WS2812FX_mode_custom_0(WS2812FX_Ctx*),
+  WS2812FX_mode_custom_1(WS2812FX_Ctx*),
+  WS2812FX_mode_custom_2(WS2812FX_Ctx*),
+  WS2812FX_mode_custom_3(WS2812FX_Ctx*),
+  WS2812FX_mode_custom_4(WS2812FX_Ctx*),
+  WS2812FX_mode_custom_5(WS2812FX_Ctx*),
+  WS2812FX_mode_custom_6(WS2812FX_Ctx*),
+  WS2812FX_mode_custom_7(WS2812FX_Ctx*);
+
+// the builtin modes' scratch memory sizes
+uint16_t
+  WS2812FX_scratch_twinkleFOX(const WS2812FX_Segment*, const WS2812FX_Segment_runtime*),
+  WS2812FX_scratch_vu_meter(const WS2812FX_Segment*, const WS2812FX_Segment_runtime*),
+  WS2812FX_scratch_multi_comet(const WS2812FX_Segment*, const WS2812FX_Segment_runtime*),
+  WS2812FX_scratch_popcorn(const WS2812FX_Segment*, const WS2812FX_Segment_runtime*),
+  WS2812FX_scratch_oscillator(const WS2812FX_Segment*, const WS2812FX_Segment_runtime*);
 
 // class WS2812FXT {
 //   public:
@@ -452,13 +634,6 @@ struct Flipbook {
   uint32_t* colors;
 };
 
-// data struct used by the popcorn effect
-struct Popcorn {
-  float position;
-  float velocity;
-  int32_t color;
-};
-
 // data struct used by the oscillator effect
 struct Oscillator {
   uint8_t size;
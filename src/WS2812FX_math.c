@@ -0,0 +1,180 @@
+/*
+  WS2812FX_math.c - fixed point math for the WS2812FX effects
+
+  LICENSE
+
+  The MIT License (MIT)
+
+  Copyright (c) 2016  Harm Aldick
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+
+
+  CHANGELOG
+
+  2026-10-17   Initial version, replaces the float math of the effects
+*/
+#include "WS2812FX_math.h"
+
+// log2(e) in Q32.32, ln(2) in Q1.31
+#define LOG2E_Q32 6196328019LL
+#define LN2_Q31   1488522236ULL
+
+// 2^(2^-k) in Q1.31, k = 1..16
+static const uint32_t exp2_tab[16] = {
+  3037000500U, 2553802834U, 2341847524U, 2242560872U, 2194507417U, 2170868212U, 2159144272U, 2153306067U,
+  2150392887U, 2148937775U, 2148210589U, 2147847087U, 2147665360U, 2147574502U, 2147529075U, 2147506361U
+};
+
+/*
+ * log2(x / 2^frac) in Q32.32, x > 0. The mantissa is normalised to [1, 2)
+ * and squared once per result bit: every time the square reaches 2 the bit
+ * is set and the square halved. Good to about 2^-28.
+ */
+static int64_t WS2812FX_log2_fix(uint64_t x, uint8_t frac) {
+  int8_t p = 63;
+  while(!(x >> p)) p--;
+  uint64_t m = p >= 31 ? x >> (p - 31) : x << (31 - p); // Q1.31 in [1, 2)
+  int64_t result = (int64_t)(p - frac) * 4294967296LL;
+  for(uint32_t bit = 0x80000000U; bit; bit >>= 1) {
+    m = (m * m) >> 31;
+    if(m >= 0x100000000ULL) {
+      m >>= 1;
+      result += bit;
+    }
+  }
+  return result;
+}
+
+// 2^(f / 2^32) in Q1.31: the table covers the top 16 bits of f, below that
+// 2^x = 1 + x * ln(2) is exact to 2^-33
+static uint64_t WS2812FX_exp2_frac(uint32_t f) {
+  uint64_t m = 0x80000000ULL;
+  for(uint8_t k=0; k<16; k++) {
+    if(f & (0x80000000U >> k)) m = (m * exp2_tab[k] + 0x40000000ULL) >> 31;
+  }
+  uint64_t x = ((uint64_t)(f & 0xFFFF) * LN2_Q31) >> 32; // Q1.31
+  return m + ((m * x) >> 31);
+}
+
+// round(2^(p / 2^32) * 2^frac), saturated at cap
+static uint64_t WS2812FX_exp2_fix(int64_t p, uint8_t frac, uint64_t cap) {
+  int32_t n = (int32_t)(p >> 32) + frac; // floor
+  uint64_t m = WS2812FX_exp2_frac((uint32_t)p); // the result is m * 2^(n - 31)
+  if(n >= 31) {
+    if(n - 31 >= 32) return cap;
+    m <<= n - 31;
+    return m > cap ? cap : m;
+  }
+  uint8_t shift = 31 - n > 40 ? 40 : (uint8_t)(31 - n);
+  m = (m + (1ULL << (shift - 1))) >> shift;
+  return m > cap ? cap : m;
+}
+
+// floor(sqrt(x)), one result bit per iteration
+uint32_t WS2812FX_isqrt(uint64_t x) {
+  uint64_t r = 0, bit = 1ULL << 62;
+  while(bit > x) bit >>= 2;
+  while(bit) {
+    if(x >= r + bit) {
+      x -= r + bit;
+      r = (r >> 1) + bit;
+    } else {
+      r >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)r;
+}
+
+WS2812FX_Q16 WS2812FX_q16_sqrt(WS2812FX_Q16 x) {
+  if(x <= 0) return 0;
+  uint64_t v = (uint64_t)x << 16;
+  uint64_t r = WS2812FX_isqrt(v);
+  return (WS2812FX_Q16)(r * r + r < v ? r + 1 : r); // rounded to nearest
+}
+
+// log2(x), Q16_MIN for x <= 0
+WS2812FX_Q16 WS2812FX_q16_log2(WS2812FX_Q16 x) {
+  if(x <= 0) return Q16_MIN;
+  return (WS2812FX_Q16)((WS2812FX_log2_fix((uint64_t)x, 16) + 0x8000) >> 16);
+}
+
+// 2^x, saturated at Q16_MAX
+WS2812FX_Q16 WS2812FX_q16_exp2(WS2812FX_Q16 x) {
+  return (WS2812FX_Q16)WS2812FX_exp2_fix((int64_t)x * 65536, 16, Q16_MAX);
+}
+
+// e^x, saturated at Q16_MAX
+WS2812FX_Q16 WS2812FX_q16_exp(WS2812FX_Q16 x) {
+  x = x < Q16(-12) ? Q16(-12) : x > Q16(11) ? Q16(11) : x; // beyond that it's 0 or saturated anyway
+  return (WS2812FX_Q16)WS2812FX_exp2_fix(((int64_t)x * LOG2E_Q32) >> 16, 16, Q16_MAX);
+}
+
+// base^exponent for base > 0 (0 otherwise), saturated at Q16_MAX
+WS2812FX_Q16 WS2812FX_q16_pow(WS2812FX_Q16 base, WS2812FX_Q16 exponent) {
+  if(base <= 0) return 0;
+  int64_t l = WS2812FX_log2_fix((uint64_t)base, 16);
+  // l * exponent >> 16 in two halves, the full product doesn't fit 64 bits
+  int64_t p = (l >> 16) * exponent + (((l & 0xFFFF) * exponent) >> 16);
+  return (WS2812FX_Q16)WS2812FX_exp2_fix(p, 16, Q16_MAX);
+}
+
+/*
+ * round(scale * (num / den)^(exp_num / exp_den)), saturated at 0xFFFFFFFF.
+ * Everything stays exact integers until the one log2/exp2 round trip, so this
+ * is good to a few parts in 2^28 - enough to round curves like the gamma
+ * table correctly, which a Q16 exponent such as 2.6 alone wouldn't be.
+ */
+uint32_t WS2812FX_pow_ratio(uint32_t num, uint32_t den, uint16_t exp_num, uint16_t exp_den, uint32_t scale) {
+  if(exp_num == 0 || scale == 0) return scale;
+  if(num == 0) return 0;
+  if(den == 0 || exp_den == 0) return 0xFFFFFFFF;
+  int64_t l = WS2812FX_log2_fix(num, 0) - WS2812FX_log2_fix(den, 0);
+  int64_t p = l * exp_num / exp_den + WS2812FX_log2_fix(scale, 0);
+  return (uint32_t)WS2812FX_exp2_fix(p, 0, 0xFFFFFFFF);
+}
+
+/*
+ * sin(angle) as a Q1.15, -32767 to 32767. The angle is folded into the first
+ * quarter and sin(pi/2 * t) evaluated as its Taylor series up to t^11 in
+ * Q2.30, which is well below the output's resolution.
+ */
+int16_t WS2812FX_sin16(uint16_t angle) {
+  static const int64_t c[6] = { // (pi/2)^n / n! in Q2.30, n = 1, 3 .. 11
+    1686629713LL, 693598668LL, 85569306LL, 5026995LL, 172272LL, 3864LL
+  };
+  uint16_t x = angle & 0x3FFF;
+  if(angle & 0x4000) x = 0x4000 - x;
+  int64_t t = (int64_t)x << 16; // Q2.30, 0 to 1
+  int64_t z = (t * t) >> 30;
+  int64_t p = -c[5];
+  p = c[4] + ((p * z) >> 30);
+  p = -c[3] + ((p * z) >> 30);
+  p = c[2] + ((p * z) >> 30);
+  p = -c[1] + ((p * z) >> 30);
+  p = c[0] + ((p * z) >> 30);
+  int32_t r = (int32_t)((((p * t) >> 30) + 0x4000) >> 15);
+  if(r > 32767) r = 32767;
+  return (int16_t)(angle & 0x8000 ? -r : r);
+}
+
+int16_t WS2812FX_cos16(uint16_t angle) {
+  return WS2812FX_sin16(angle + 0x4000);
+}
@@ -0,0 +1,108 @@
+/*
+  WS2812FX_math.h - fixed point math for the WS2812FX effects
+
+  LICENSE
+
+  The MIT License (MIT)
+
+  Copyright (c) 2016  Harm Aldick
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+
+
+  CHANGELOG
+
+  2026-10-17   Initial version, replaces the float math of the effects
+*/
+
+#ifndef WS2812FX_math_h
+#define WS2812FX_math_h
+
+#include "Adafruit_NeoPixel_defines.h"
+
+/*
+ * Fixed point numbers: Q8.8 in 16 bits and Q16.16 in 32 bits, both signed.
+ * None of this needs an FPU or a libm; the only floats are in the Q8()/Q16()
+ * macros, meant for constants the compiler folds.
+ */
+typedef int16_t WS2812FX_Q8;
+typedef int32_t WS2812FX_Q16;
+
+#define Q8_ONE  ((WS2812FX_Q8)256)
+#define Q16_ONE ((WS2812FX_Q16)65536)
+#define Q16_MAX ((WS2812FX_Q16)0x7FFFFFFF)
+#define Q16_MIN ((WS2812FX_Q16)(-0x7FFFFFFF - 1))
+
+#define Q8(x)  ((WS2812FX_Q8)((x) * 256.0 + ((x) < 0 ? -0.5 : 0.5)))
+#define Q16(x) ((WS2812FX_Q16)((x) * 65536.0 + ((x) < 0 ? -0.5 : 0.5)))
+
+static inline WS2812FX_Q8 WS2812FX_q8_mul(WS2812FX_Q8 a, WS2812FX_Q8 b) {
+  return (WS2812FX_Q8)(((int32_t)a * b) >> 8);
+}
+
+static inline WS2812FX_Q16 WS2812FX_q16_mul(WS2812FX_Q16 a, WS2812FX_Q16 b) {
+  return (WS2812FX_Q16)(((int64_t)a * b) >> 16);
+}
+
+static inline WS2812FX_Q16 WS2812FX_q16_div(WS2812FX_Q16 a, WS2812FX_Q16 b) {
+  return (WS2812FX_Q16)(((int64_t)a << 16) / b);
+}
+
+// a + (b - a) * t, t from 0 to Q16_ONE
+static inline WS2812FX_Q16 WS2812FX_q16_lerp(WS2812FX_Q16 a, WS2812FX_Q16 b, WS2812FX_Q16 t) {
+  return a + (WS2812FX_Q16)(((int64_t)(b - a) * t) >> 16);
+}
+
+// a + (b - a) * frac / 256
+static inline uint8_t WS2812FX_lerp8(uint8_t a, uint8_t b, uint8_t frac) {
+  return (uint8_t)(a + (((int16_t)b - a) * frac >> 8));
+}
+
+// saturating add and subtract
+static inline uint8_t WS2812FX_qadd8(uint8_t a, uint8_t b) {
+  uint16_t s = (uint16_t)a + b;
+  return s > 255 ? 255 : (uint8_t)s;
+}
+
+static inline uint8_t WS2812FX_qsub8(uint8_t a, uint8_t b) {
+  return a > b ? a - b : 0;
+}
+
+static inline WS2812FX_Q16 WS2812FX_q16_add_sat(WS2812FX_Q16 a, WS2812FX_Q16 b) {
+  int64_t s = (int64_t)a + b;
+  return s > Q16_MAX ? Q16_MAX : s < Q16_MIN ? Q16_MIN : (WS2812FX_Q16)s;
+}
+
+uint32_t WS2812FX_isqrt(uint64_t);
+
+WS2812FX_Q16
+  WS2812FX_q16_sqrt(WS2812FX_Q16),
+  WS2812FX_q16_log2(WS2812FX_Q16),
+  WS2812FX_q16_exp2(WS2812FX_Q16),
+  WS2812FX_q16_exp(WS2812FX_Q16),
+  WS2812FX_q16_pow(WS2812FX_Q16, WS2812FX_Q16);
+
+uint32_t WS2812FX_pow_ratio(uint32_t num, uint32_t den, uint16_t exp_num, uint16_t exp_den, uint32_t scale);
+
+// sine and cosine of a 16 bit angle (65536 = full turn), -32767 to 32767
+int16_t
+  WS2812FX_sin16(uint16_t),
+  WS2812FX_cos16(uint16_t);
+
+#endif
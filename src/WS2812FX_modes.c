@@ -42,136 +42,136 @@
 /*
  * No blinking. Just plain old static light.
  */
-uint16_t WS2812FX_mode_static(void) {
-  WS2812FX_fill(_seg->colors[0], _seg->start, _seg_len);
+uint16_t WS2812FX_mode_static(WS2812FX_Ctx *ctx) {
+  WS2812FX_fill(ctx, ctx->seg->colors[0], ctx->seg->start, ctx->seg_len);
   SET_CYCLE;
-  return _seg->speed;
+  return ctx->seg->speed;
 }
 
 /*
  * Normal blinking. 50% on/off time.
  */
-uint16_t WS2812FX_mode_blink(void) {
-  return WS2812FX_blink(_seg->colors[0], _seg->colors[1], false);
+uint16_t WS2812FX_mode_blink(WS2812FX_Ctx *ctx) {
+  return WS2812FX_blink(ctx, ctx->seg->colors[0], ctx->seg->colors[1], false);
 }
 
 /*
  * Classic Blink effect. Cycling through the rainbow.
  */
-uint16_t WS2812FX_mode_blink_rainbow(void) {
-  return WS2812FX_blink(WS2812FX_color_wheel((_seg_rt->counter_mode_call << 2) & 0xFF), _seg->colors[1], false);
+uint16_t WS2812FX_mode_blink_rainbow(WS2812FX_Ctx *ctx) {
+  return WS2812FX_blink(ctx, WS2812FX_paletteColor(ctx, (ctx->seg_rt->counter_mode_call << 2) & 0xFF), ctx->seg->colors[1], false);
 }
 
 /*
  * Classic Strobe effect.
  */
-uint16_t WS2812FX_mode_strobe(void) {
-  return WS2812FX_blink(_seg->colors[0], _seg->colors[1], true);
+uint16_t WS2812FX_mode_strobe(WS2812FX_Ctx *ctx) {
+  return WS2812FX_blink(ctx, ctx->seg->colors[0], ctx->seg->colors[1], true);
 }
 
 /*
  * Classic Strobe effect. Cycling through the rainbow.
  */
-uint16_t WS2812FX_mode_strobe_rainbow(void) {
-  return WS2812FX_blink(WS2812FX_color_wheel((_seg_rt->counter_mode_call << 2) & 0xFF), _seg->colors[1], true);
+uint16_t WS2812FX_mode_strobe_rainbow(WS2812FX_Ctx *ctx) {
+  return WS2812FX_blink(ctx, WS2812FX_paletteColor(ctx, (ctx->seg_rt->counter_mode_call << 2) & 0xFF), ctx->seg->colors[1], true);
 }
 
 /*
  * Lights all LEDs one after another.
  */
-uint16_t WS2812FX_mode_color_wipe(void) {
-  return WS2812FX_color_wipe(_seg->colors[0], _seg->colors[1], false);
+uint16_t WS2812FX_mode_color_wipe(WS2812FX_Ctx *ctx) {
+  return WS2812FX_color_wipe(ctx, ctx->seg->colors[0], ctx->seg->colors[1], false);
 }
 
-uint16_t WS2812FX_mode_color_wipe_inv(void) {
-  return WS2812FX_color_wipe(_seg->colors[1], _seg->colors[0], false);
+uint16_t WS2812FX_mode_color_wipe_inv(WS2812FX_Ctx *ctx) {
+  return WS2812FX_color_wipe(ctx, ctx->seg->colors[1], ctx->seg->colors[0], false);
 }
 
-uint16_t WS2812FX_mode_color_wipe_rev(void) {
-  return WS2812FX_color_wipe(_seg->colors[0], _seg->colors[1], true);
+uint16_t WS2812FX_mode_color_wipe_rev(WS2812FX_Ctx *ctx) {
+  return WS2812FX_color_wipe(ctx, ctx->seg->colors[0], ctx->seg->colors[1], true);
 }
 
-uint16_t WS2812FX_mode_color_wipe_rev_inv(void) {
-  return WS2812FX_color_wipe(_seg->colors[1], _seg->colors[0], true);
+uint16_t WS2812FX_mode_color_wipe_rev_inv(WS2812FX_Ctx *ctx) {
+  return WS2812FX_color_wipe(ctx, ctx->seg->colors[1], ctx->seg->colors[0], true);
 }
 
 /*
  * Turns all LEDs after each other to a random color.
  * Then starts over with another color.
  */
-uint16_t WS2812FX_mode_color_wipe_random(void) {
-  if(_seg_rt->counter_mode_step % _seg_len == 0) { // aux_param will store our random color wheel index
-    _seg_rt->aux_param = WS2812FX_get_random_wheel_index(_seg_rt->aux_param);
+uint16_t WS2812FX_mode_color_wipe_random(WS2812FX_Ctx *ctx) {
+  if(ctx->seg_rt->counter_mode_step % ctx->seg_len == 0) { // aux_param will store our random color wheel index
+    ctx->seg_rt->aux_param = WS2812FX_get_random_wheel_index(ctx, ctx->seg_rt->aux_param);
   }
-  uint32_t color = WS2812FX_color_wheel(_seg_rt->aux_param);
-  return WS2812FX_color_wipe(color, color, false) * 2;
+  uint32_t color = WS2812FX_paletteColor(ctx, ctx->seg_rt->aux_param);
+  return WS2812FX_color_wipe(ctx, color, color, false) * 2;
 }
 
 /*
  * Random color introduced alternating from start and end of strip.
  */
-uint16_t WS2812FX_mode_color_sweep_random(void) {
-  if(_seg_rt->counter_mode_step % _seg_len == 0) { // aux_param will store our random color wheel index
-    _seg_rt->aux_param = WS2812FX_get_random_wheel_index(_seg_rt->aux_param);
+uint16_t WS2812FX_mode_color_sweep_random(WS2812FX_Ctx *ctx) {
+  if(ctx->seg_rt->counter_mode_step % ctx->seg_len == 0) { // aux_param will store our random color wheel index
+    ctx->seg_rt->aux_param = WS2812FX_get_random_wheel_index(ctx, ctx->seg_rt->aux_param);
   }
-  uint32_t color = WS2812FX_color_wheel(_seg_rt->aux_param);
-  return WS2812FX_color_wipe(color, color, true) * 2;
+  uint32_t color = WS2812FX_paletteColor(ctx, ctx->seg_rt->aux_param);
+  return WS2812FX_color_wipe(ctx, color, color, true) * 2;
 }
 
 /*
  * Lights all LEDs in one random color up. Then switches them
  * to the next random color.
  */
-uint16_t WS2812FX_mode_random_color(void) {
-  _seg_rt->aux_param = WS2812FX_get_random_wheel_index(_seg_rt->aux_param); // aux_param will store our random color wheel index
-  uint32_t color = WS2812FX_color_wheel(_seg_rt->aux_param);
-  WS2812FX_fill(color, _seg->start, _seg_len);
+uint16_t WS2812FX_mode_random_color(WS2812FX_Ctx *ctx) {
+  ctx->seg_rt->aux_param = WS2812FX_get_random_wheel_index(ctx, ctx->seg_rt->aux_param); // aux_param will store our random color wheel index
+  uint32_t color = WS2812FX_paletteColor(ctx, ctx->seg_rt->aux_param);
+  WS2812FX_fill(ctx, color, ctx->seg->start, ctx->seg_len);
   SET_CYCLE;
-  return _seg->speed;
+  return ctx->seg->speed;
 }
 
 /*
  * Lights every LED in a random color. Changes one random LED after the other
  * to another random color.
  */
-uint16_t WS2812FX_mode_single_dynamic(void) {
+uint16_t WS2812FX_mode_single_dynamic(WS2812FX_Ctx *ctx) {
   uint8_t size = 1 << SIZE_OPTION;
-  if(_seg_rt->counter_mode_call == 0) { // initialize segment with random colors
-    for(uint16_t i=_seg->start; i <= _seg->stop; i+=size) {
-      WS2812FX_fill(WS2812FX_color_wheel(WS2812FX_random8()), i, size);
+  if(ctx->seg_rt->counter_mode_call == 0) { // initialize segment with random colors
+    for(uint16_t i=ctx->seg->start; i <= ctx->seg->stop; i+=size) {
+      WS2812FX_fill(ctx, WS2812FX_paletteColor(ctx, WS2812FX_random8(ctx)), i, size);
     }
   }
-  uint16_t first = _seg->start + (WS2812FX_random16_lim(_seg_len / size + 1) * size);
-  WS2812FX_fill(WS2812FX_color_wheel(WS2812FX_random8()), first, size);
+  uint16_t first = ctx->seg->start + (WS2812FX_random16_lim(ctx, ctx->seg_len / size + 1) * size);
+  WS2812FX_fill(ctx, WS2812FX_paletteColor(ctx, WS2812FX_random8(ctx)), first, size);
   SET_CYCLE;
-  return (_seg->speed / 16) ;
+  return (ctx->seg->speed / 16) ;
 }
 
 /*
  * Lights every LED in a random color. Changes all LED at the same time
  * to new random colors.
  */
-uint16_t WS2812FX_mode_multi_dynamic(void) {
+uint16_t WS2812FX_mode_multi_dynamic(WS2812FX_Ctx *ctx) {
   if(SIZE_OPTION) {
     uint8_t size = 1 << SIZE_OPTION;
-    for(uint16_t i=_seg->start; i <= _seg->stop; i+=size) {
-      WS2812FX_fill(WS2812FX_color_wheel(WS2812FX_random8()), i, size);
+    for(uint16_t i=ctx->seg->start; i <= ctx->seg->stop; i+=size) {
+      WS2812FX_fill(ctx, WS2812FX_paletteColor(ctx, WS2812FX_random8(ctx)), i, size);
     }
   } else {
-    for(uint16_t i=_seg->start; i <= _seg->stop; i++) {
-      WS2812FX_setPixelColor_nc(i, WS2812FX_color_wheel(WS2812FX_random8()));
+    for(uint16_t i=ctx->seg->start; i <= ctx->seg->stop; i++) {
+      WS2812FX_setPixelColor_nc(ctx, i, WS2812FX_paletteColor(ctx, WS2812FX_random8(ctx)));
     }
   }
   SET_CYCLE;
-  return (_seg->speed / 4);
+  return (ctx->seg->speed / 4);
 }
 
 /*
  * Does the "standby-breathing" of well known i-Devices. Fixed Speed.
  * Use mode "fade" if you like to have something similar with a different speed.
  */
-uint16_t WS2812FX_mode_breath(void) {
-  int lum = _seg_rt->counter_mode_step;
+uint16_t WS2812FX_mode_breath(WS2812FX_Ctx *ctx) {
+  int lum = ctx->seg_rt->counter_mode_step;
   if(lum > 255) lum = 511 - lum; // lum = 15 -> 255 -> 15
 
   uint16_t delay;
@@ -184,12 +184,12 @@ uint16_t WS2812FX_mode_breath(void) {
   else if(lum <= 150) delay = 11; // 5
   else delay = 10; // 4
 
-  uint32_t color =  WS2812FX_color_blend(_seg->colors[1], _seg->colors[0], lum);
-  WS2812FX_fill(color, _seg->start, _seg_len);
+  uint32_t color =  WS2812FX_color_blend(ctx->seg->colors[1], ctx->seg->colors[0], lum);
+  WS2812FX_fill(ctx, color, ctx->seg->start, ctx->seg_len);
 
-  _seg_rt->counter_mode_step += 2;
-  if(_seg_rt->counter_mode_step > (512-15)) {
-    _seg_rt->counter_mode_step = 15;
+  ctx->seg_rt->counter_mode_step += 2;
+  if(ctx->seg_rt->counter_mode_step > (512-15)) {
+    ctx->seg_rt->counter_mode_step = 15;
     SET_CYCLE;
   }
   return delay;
@@ -198,683 +198,686 @@ uint16_t WS2812FX_mode_breath(void) {
 /*
  * Fades the LEDs between two colors
  */
-uint16_t WS2812FX_mode_fade(void) {
-  int lum = _seg_rt->counter_mode_step;
+uint16_t WS2812FX_mode_fade(WS2812FX_Ctx *ctx) {
+  int lum = ctx->seg_rt->counter_mode_step;
   if(lum > 255) lum = 511 - lum; // lum = 0 -> 255 -> 0
 
-  uint32_t color = WS2812FX_color_blend(_seg->colors[1], _seg->colors[0], lum);
-  WS2812FX_fill(color, _seg->start, _seg_len);
+  uint32_t color = WS2812FX_color_blend(ctx->seg->colors[1], ctx->seg->colors[0], lum);
+  WS2812FX_fill(ctx, color, ctx->seg->start, ctx->seg_len);
 
-  _seg_rt->counter_mode_step += 4;
-  if(_seg_rt->counter_mode_step > 511) {
-    _seg_rt->counter_mode_step = 0;
+  ctx->seg_rt->counter_mode_step += 4;
+  if(ctx->seg_rt->counter_mode_step > 511) {
+    ctx->seg_rt->counter_mode_step = 0;
     SET_CYCLE;
   }
-  return (_seg->speed / 128);
+  return (ctx->seg->speed / 128);
 }
 
 /*
  * Runs a block of pixels back and forth.
  */
-uint16_t WS2812FX_mode_scan(void) {
-  return WS2812FX_scan(_seg->colors[0], _seg->colors[1], false);
+uint16_t WS2812FX_mode_scan(WS2812FX_Ctx *ctx) {
+  return WS2812FX_scan(ctx, ctx->seg->colors[0], ctx->seg->colors[1], false);
 }
 
 /*
  * Runs two blocks of pixels back and forth in opposite directions.
  */
-uint16_t WS2812FX_mode_dual_scan(void) {
-  return WS2812FX_scan(_seg->colors[0], _seg->colors[1], true);
+uint16_t WS2812FX_mode_dual_scan(WS2812FX_Ctx *ctx) {
+  return WS2812FX_scan(ctx, ctx->seg->colors[0], ctx->seg->colors[1], true);
 }
 
 /*
  * Cycles all LEDs at once through a rainbow.
  */
-uint16_t WS2812FX_mode_rainbow(void) {
-  uint32_t color = WS2812FX_color_wheel(_seg_rt->counter_mode_step);
-  WS2812FX_fill(color, _seg->start, _seg_len);
+uint16_t WS2812FX_mode_rainbow(WS2812FX_Ctx *ctx) {
+  uint32_t color = WS2812FX_paletteColor(ctx, ctx->seg_rt->counter_mode_step);
+  WS2812FX_fill(ctx, color, ctx->seg->start, ctx->seg_len);
 
-  _seg_rt->counter_mode_step = (_seg_rt->counter_mode_step + 1) & 0xFF;
+  ctx->seg_rt->counter_mode_step = (ctx->seg_rt->counter_mode_step + 1) & 0xFF;
 
-  if(_seg_rt->counter_mode_step == 0)  SET_CYCLE;
+  if(ctx->seg_rt->counter_mode_step == 0)  SET_CYCLE;
 
-  return (_seg->speed / 256);
+  return (ctx->seg->speed / 256);
 }
 
 /*
  * Cycles a rainbow over the entire string of LEDs.
  */
-uint16_t WS2812FX_mode_rainbow_cycle(void) {
-  uint32_t color = WS2812FX_color_wheel(_seg_rt->counter_mode_step);
+uint16_t WS2812FX_mode_rainbow_cycle(WS2812FX_Ctx *ctx) {
+  uint32_t color = WS2812FX_paletteColor(ctx, ctx->seg_rt->counter_mode_step);
   if(IS_REVERSE) {
-    WS2812FX_copyPixels(_seg->start, _seg->start + 1, _seg_len - 1);
-    WS2812FX_setPixelColor_nc(_seg->stop, color);
+    WS2812FX_scroll(ctx, -1);
+    WS2812FX_setPixelColor_nc(ctx, WS2812FX_segPixel(ctx, ctx->seg_len - 1), color);
   } else {
-    WS2812FX_copyPixels(_seg->start + 1, _seg->start, _seg_len - 1);
-    WS2812FX_setPixelColor_nc(_seg->start, color);
+    WS2812FX_scroll(ctx, 1);
+    WS2812FX_setPixelColor_nc(ctx, WS2812FX_segPixel(ctx, 0), color);
   }
 
-  uint8_t colorIndexIncr =  256 / _seg_len;
+  uint8_t colorIndexIncr =  256 / ctx->seg_len;
   if(colorIndexIncr == 0) colorIndexIncr = 1;
-  _seg_rt->counter_mode_step += colorIndexIncr;
-  if(_seg_rt->counter_mode_step > 255) {
-    _seg_rt->counter_mode_step &= 0xff;
+  ctx->seg_rt->counter_mode_step += colorIndexIncr;
+  if(ctx->seg_rt->counter_mode_step > 255) {
+    ctx->seg_rt->counter_mode_step &= 0xff;
     SET_CYCLE;
   }
 
-  return (_seg->speed / 64);
+  return (ctx->seg->speed / 64);
 }
 
 /*
  * Tricolor chase mode
  */
-uint16_t WS2812FX_mode_tricolor_chase(void) {
-  return WS2812FX_tricolor_chase(_seg->colors[0], _seg->colors[1], _seg->colors[2]);
+uint16_t WS2812FX_mode_tricolor_chase(WS2812FX_Ctx *ctx) {
+  return WS2812FX_tricolor_chase(ctx, ctx->seg->colors[0], ctx->seg->colors[1], ctx->seg->colors[2]);
 }
 
 /*
  * Alternating white/red/black pixels running.
  */
-uint16_t WS2812FX_mode_circus_combustus(void) {
-  return WS2812FX_tricolor_chase(RED, WHITE, BLACK);
+uint16_t WS2812FX_mode_circus_combustus(WS2812FX_Ctx *ctx) {
+  return WS2812FX_tricolor_chase(ctx, RED, WHITE, BLACK);
 }
 
 /*
  * Theatre-style crawling lights.
  * Inspired by the Adafruit examples.
  */
-uint16_t WS2812FX_mode_theater_chase(void) {
-  return WS2812FX_tricolor_chase(_seg->colors[0], _seg->colors[1], _seg->colors[1]);
+uint16_t WS2812FX_mode_theater_chase(WS2812FX_Ctx *ctx) {
+  return WS2812FX_tricolor_chase(ctx, ctx->seg->colors[0], ctx->seg->colors[1], ctx->seg->colors[1]);
 }
 
 /*
  * Theatre-style crawling lights with rainbow effect.
  * Inspired by the Adafruit examples.
  */
-uint16_t WS2812FX_mode_theater_chase_rainbow(void) {
-  _seg_rt->aux_param = (_seg_rt->aux_param + 1) & 0xFF;
-  uint32_t color = WS2812FX_color_wheel(_seg_rt->aux_param);
-  return WS2812FX_tricolor_chase(color, _seg->colors[1], _seg->colors[1]);
+uint16_t WS2812FX_mode_theater_chase_rainbow(WS2812FX_Ctx *ctx) {
+  ctx->seg_rt->aux_param = (ctx->seg_rt->aux_param + 1) & 0xFF;
+  uint32_t color = WS2812FX_paletteColor(ctx, ctx->seg_rt->aux_param);
+  return WS2812FX_tricolor_chase(ctx, color, ctx->seg->colors[1], ctx->seg->colors[1]);
 }
 
 /*
  * Running lights effect with smooth sine transition.
  */
-uint16_t WS2812FX_mode_running_lights(void) {
+uint16_t WS2812FX_mode_running_lights(WS2812FX_Ctx *ctx) {
   uint8_t size = 1 << SIZE_OPTION;
-  uint8_t sineIncr = max(1, (256 / _seg_len) * size);
-  for(uint16_t i=0; i < _seg_len; i++) {
-    int lum = (int)Adafruit_NeoPixel_sine8(((i + _seg_rt->counter_mode_step) * sineIncr));
-    uint32_t color = WS2812FX_color_blend(_seg->colors[0], _seg->colors[1], lum);
+  uint8_t sineIncr = max(1, (256 / ctx->seg_len) * size);
+  for(uint16_t i=0; i < ctx->seg_len; i++) {
+    int lum = (int)Adafruit_NeoPixel_sine8(((i + ctx->seg_rt->counter_mode_step) * sineIncr));
+    uint32_t color = WS2812FX_color_blend(ctx->seg->colors[0], ctx->seg->colors[1], lum);
     if(IS_REVERSE) {
-      WS2812FX_setPixelColor_nc(_seg->start + i, color);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->start + i, color);
     } else {
-      WS2812FX_setPixelColor_nc(_seg->stop - i,  color);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->stop - i,  color);
     }
   }
-  _seg_rt->counter_mode_step = (_seg_rt->counter_mode_step + 1) % 256;
-  if(_seg_rt->counter_mode_step == 0) SET_CYCLE;
-  return (_seg->speed / _seg_len);
+  ctx->seg_rt->counter_mode_step = (ctx->seg_rt->counter_mode_step + 1) % 256;
+  if(ctx->seg_rt->counter_mode_step == 0) SET_CYCLE;
+  return (ctx->seg->speed / ctx->seg_len);
 }
 
 /*
  * Blink several LEDs on, reset, repeat.
  * Inspired by www.tweaking4all.com/hardware/arduino/arduino-led-strip-effects/
  */
-uint16_t WS2812FX_mode_twinkle(void) {
-  return WS2812FX_twinkle(_seg->colors[0], _seg->colors[1]);
+uint16_t WS2812FX_mode_twinkle(WS2812FX_Ctx *ctx) {
+  return WS2812FX_twinkle(ctx, ctx->seg->colors[0], ctx->seg->colors[1]);
 }
 
 /*
  * Blink several LEDs in random colors on, reset, repeat.
  * Inspired by www.tweaking4all.com/hardware/arduino/arduino-led-strip-effects/
  */
-uint16_t WS2812FX_mode_twinkle_random(void) {
-  return WS2812FX_twinkle(WS2812FX_color_wheel(WS2812FX_random8()), _seg->colors[1]);
+uint16_t WS2812FX_mode_twinkle_random(WS2812FX_Ctx *ctx) {
+  return WS2812FX_twinkle(ctx, WS2812FX_paletteColor(ctx, WS2812FX_random8(ctx)), ctx->seg->colors[1]);
 }
 
 /*
  * Blink several LEDs on, fading out.
  */
-uint16_t WS2812FX_mode_twinkle_fade(void) {
-  return WS2812FX_twinkle_fade(_seg->colors[0]);
+uint16_t WS2812FX_mode_twinkle_fade(WS2812FX_Ctx *ctx) {
+  return WS2812FX_twinkle_fade(ctx, ctx->seg->colors[0]);
 }
 
 /*
  * Blink several LEDs in random colors on, fading out.
  */
-uint16_t WS2812FX_mode_twinkle_fade_random(void) {
-  return WS2812FX_twinkle_fade(WS2812FX_color_wheel(WS2812FX_random8()));
+uint16_t WS2812FX_mode_twinkle_fade_random(WS2812FX_Ctx *ctx) {
+  return WS2812FX_twinkle_fade(ctx, WS2812FX_paletteColor(ctx, WS2812FX_random8(ctx)));
 }
 
 /*
  * Blinks one LED at a time.
  * Inspired by www.tweaking4all.com/hardware/arduino/arduino-led-strip-effects/
  */
-uint16_t WS2812FX_mode_sparkle(void) {
-  return WS2812FX_sparkle(_seg->colors[1], _seg->colors[0]);
+uint16_t WS2812FX_mode_sparkle(WS2812FX_Ctx *ctx) {
+  return WS2812FX_sparkle(ctx, ctx->seg->colors[1], ctx->seg->colors[0]);
 }
 
 /*
  * Lights all LEDs in the color. Flashes white pixels randomly.
  * Inspired by www.tweaking4all.com/hardware/arduino/arduino-led-strip-effects/
  */
-uint16_t WS2812FX_mode_flash_sparkle(void) {
-  return WS2812FX_sparkle(_seg->colors[0], WHITE);
+uint16_t WS2812FX_mode_flash_sparkle(WS2812FX_Ctx *ctx) {
+  return WS2812FX_sparkle(ctx, ctx->seg->colors[0], WHITE);
 }
 
 /*
  * Like flash sparkle. With more flash.
  * Inspired by www.tweaking4all.com/hardware/arduino/arduino-led-strip-effects/
  */
-uint16_t WS2812FX_mode_hyper_sparkle(void) {
-  WS2812FX_fill(_seg->colors[0], _seg->start, _seg_len);
+uint16_t WS2812FX_mode_hyper_sparkle(WS2812FX_Ctx *ctx) {
+  WS2812FX_fill(ctx, ctx->seg->colors[0], ctx->seg->start, ctx->seg_len);
 
   uint8_t size = 1 << SIZE_OPTION;
   for(uint8_t i=0; i<8; i++) {
-    WS2812FX_fill(WHITE, _seg->start + WS2812FX_random16_lim(_seg_len - size + 1), size);
+    WS2812FX_fill(ctx, WHITE, ctx->seg->start + WS2812FX_random16_lim(ctx, ctx->seg_len - size + 1), size);
   }
 
   SET_CYCLE;
-  return (_seg->speed / 32);
+  return (ctx->seg->speed / 32);
 }
 
 /*
  * Strobe effect with different strobe count and pause, controlled by speed.
  */
-uint16_t WS2812FX_mode_multi_strobe(void) {
-  WS2812FX_fill(_seg->colors[1], _seg->start, _seg_len);
-
-  uint16_t delay = 200 + ((9 - (_seg->speed % 10)) * 100);
-  uint16_t count = 2 * ((_seg->speed / 100) + 1);
-  if(_seg_rt->counter_mode_step < count) {
-    if((_seg_rt->counter_mode_step & 1) == 0) {
-      WS2812FX_fill(_seg->colors[0], _seg->start, _seg_len);
+uint16_t WS2812FX_mode_multi_strobe(WS2812FX_Ctx *ctx) {
+  WS2812FX_fill(ctx, ctx->seg->colors[1], ctx->seg->start, ctx->seg_len);
+
+  uint16_t delay = 200 + ((9 - (ctx->seg->speed % 10)) * 100);
+  uint16_t count = 2 * ((ctx->seg->speed / 100) + 1);
+  if(ctx->seg_rt->counter_mode_step < count) {
+    if((ctx->seg_rt->counter_mode_step & 1) == 0) {
+      WS2812FX_fill(ctx, ctx->seg->colors[0], ctx->seg->start, ctx->seg_len);
       delay = 20;
     } else {
       delay = 50;
     }
   }
 
-  _seg_rt->counter_mode_step = (_seg_rt->counter_mode_step + 1) % (count + 1);
-  if(_seg_rt->counter_mode_step == 0) SET_CYCLE;
+  ctx->seg_rt->counter_mode_step = (ctx->seg_rt->counter_mode_step + 1) % (count + 1);
+  if(ctx->seg_rt->counter_mode_step == 0) SET_CYCLE;
   return delay;
 }
 
 /*
  * Bicolor chase mode
  */
-uint16_t WS2812FX_mode_bicolor_chase(void) {
-  return WS2812FX_chase(_seg->colors[0], _seg->colors[1], _seg->colors[2]);
+uint16_t WS2812FX_mode_bicolor_chase(WS2812FX_Ctx *ctx) {
+  return WS2812FX_chase(ctx, ctx->seg->colors[0], ctx->seg->colors[1], ctx->seg->colors[2]);
 }
 
 /*
  * White running on _color.
  */
-uint16_t WS2812FX_mode_chase_color(void) {
-  return WS2812FX_chase(_seg->colors[0], WHITE, WHITE);
+uint16_t WS2812FX_mode_chase_color(WS2812FX_Ctx *ctx) {
+  return WS2812FX_chase(ctx, ctx->seg->colors[0], WHITE, WHITE);
 }
 
 /*
  * Black running on _color.
  */
-uint16_t WS2812FX_mode_chase_blackout(void) {
-  return WS2812FX_chase(_seg->colors[0], BLACK, BLACK);
+uint16_t WS2812FX_mode_chase_blackout(WS2812FX_Ctx *ctx) {
+  return WS2812FX_chase(ctx, ctx->seg->colors[0], BLACK, BLACK);
 }
 
 /*
  * _color running on white.
  */
-uint16_t WS2812FX_mode_chase_white(void) {
-  return WS2812FX_chase(WHITE, _seg->colors[0], _seg->colors[0]);
+uint16_t WS2812FX_mode_chase_white(WS2812FX_Ctx *ctx) {
+  return WS2812FX_chase(ctx, WHITE, ctx->seg->colors[0], ctx->seg->colors[0]);
 }
 
 /*
  * White running followed by random color.
  */
-uint16_t WS2812FX_mode_chase_random(void) {
-  if(_seg_rt->counter_mode_step == 0) {
-    _seg_rt->aux_param = WS2812FX_get_random_wheel_index(_seg_rt->aux_param);
+uint16_t WS2812FX_mode_chase_random(WS2812FX_Ctx *ctx) {
+  if(ctx->seg_rt->counter_mode_step == 0) {
+    ctx->seg_rt->aux_param = WS2812FX_get_random_wheel_index(ctx, ctx->seg_rt->aux_param);
   }
-  return WS2812FX_chase(WS2812FX_color_wheel(_seg_rt->aux_param), WHITE, WHITE);
+  return WS2812FX_chase(ctx, WS2812FX_paletteColor(ctx, ctx->seg_rt->aux_param), WHITE, WHITE);
 }
 
 /*
  * Rainbow running on white.
  */
-uint16_t WS2812FX_mode_chase_rainbow_white(void) {
-  uint16_t n = _seg_rt->counter_mode_step;
-  uint16_t m = (_seg_rt->counter_mode_step + 1) % _seg_len;
-  uint32_t color2 = WS2812FX_color_wheel(((n * 256 / _seg_len) + (_seg_rt->counter_mode_call & 0xFF)) & 0xFF);
-  uint32_t color3 = WS2812FX_color_wheel(((m * 256 / _seg_len) + (_seg_rt->counter_mode_call & 0xFF)) & 0xFF);
+uint16_t WS2812FX_mode_chase_rainbow_white(WS2812FX_Ctx *ctx) {
+  uint16_t n = ctx->seg_rt->counter_mode_step;
+  uint16_t m = (ctx->seg_rt->counter_mode_step + 1) % ctx->seg_len;
+  uint32_t color2 = WS2812FX_paletteColor(ctx, ((n * 256 / ctx->seg_len) + (ctx->seg_rt->counter_mode_call & 0xFF)) & 0xFF);
+  uint32_t color3 = WS2812FX_paletteColor(ctx, ((m * 256 / ctx->seg_len) + (ctx->seg_rt->counter_mode_call & 0xFF)) & 0xFF);
 
-  return WS2812FX_chase(WHITE, color2, color3);
+  return WS2812FX_chase(ctx, WHITE, color2, color3);
 }
 
 /*
  * White running on rainbow.
  */
-uint16_t WS2812FX_mode_chase_rainbow(void) {
-  uint8_t color_sep = 256 / _seg_len;
-  uint8_t color_index = _seg_rt->counter_mode_call & 0xFF;
-  uint32_t color = WS2812FX_color_wheel(((_seg_rt->counter_mode_step * color_sep) + color_index) & 0xFF);
+uint16_t WS2812FX_mode_chase_rainbow(WS2812FX_Ctx *ctx) {
+  uint8_t color_sep = 256 / ctx->seg_len;
+  uint8_t color_index = ctx->seg_rt->counter_mode_call & 0xFF;
+  uint32_t color = WS2812FX_paletteColor(ctx, ((ctx->seg_rt->counter_mode_step * color_sep) + color_index) & 0xFF);
 
-  return WS2812FX_chase(color, WHITE, WHITE);
+  return WS2812FX_chase(ctx, color, WHITE, WHITE);
 }
 
 /*
  * Black running on rainbow.
  */
-uint16_t WS2812FX_mode_chase_blackout_rainbow(void) {
-  uint8_t color_sep = 256 / _seg_len;
-  uint8_t color_index = _seg_rt->counter_mode_call & 0xFF;
-  uint32_t color = WS2812FX_color_wheel(((_seg_rt->counter_mode_step * color_sep) + color_index) & 0xFF);
+uint16_t WS2812FX_mode_chase_blackout_rainbow(WS2812FX_Ctx *ctx) {
+  uint8_t color_sep = 256 / ctx->seg_len;
+  uint8_t color_index = ctx->seg_rt->counter_mode_call & 0xFF;
+  uint32_t color = WS2812FX_paletteColor(ctx, ((ctx->seg_rt->counter_mode_step * color_sep) + color_index) & 0xFF);
 
-  return WS2812FX_chase(color, BLACK, BLACK);
+  return WS2812FX_chase(ctx, color, BLACK, BLACK);
 }
 
 /*
  * White flashes running on _color.
  */
-uint16_t WS2812FX_mode_chase_flash(void) {
-  return WS2812FX_chase_flash(_seg->colors[0], WHITE);
+uint16_t WS2812FX_mode_chase_flash(WS2812FX_Ctx *ctx) {
+  return WS2812FX_chase_flash(ctx, ctx->seg->colors[0], WHITE);
 }
 
 /*
  * White flashes running, followed by random color.
  */
-uint16_t WS2812FX_mode_chase_flash_random(void) {
-  return WS2812FX_chase_flash(WS2812FX_color_wheel(_seg_rt->aux_param), WHITE);
+uint16_t WS2812FX_mode_chase_flash_random(WS2812FX_Ctx *ctx) {
+  return WS2812FX_chase_flash(ctx, WS2812FX_paletteColor(ctx, ctx->seg_rt->aux_param), WHITE);
 }
 
 /*
  * Alternating color/white pixels running.
  */
-uint16_t WS2812FX_mode_running_color(void) {
-  return WS2812FX_running(_seg->colors[0], _seg->colors[1]);
+uint16_t WS2812FX_mode_running_color(WS2812FX_Ctx *ctx) {
+  return WS2812FX_running(ctx, ctx->seg->colors[0], ctx->seg->colors[1]);
 }
 
 /*
  * Alternating red/blue pixels running.
  */
-uint16_t WS2812FX_mode_running_red_blue(void) {
-  return WS2812FX_running(RED, BLUE);
+uint16_t WS2812FX_mode_running_red_blue(WS2812FX_Ctx *ctx) {
+  return WS2812FX_running(ctx, RED, BLUE);
 }
 
 /*
  * Alternating red/green pixels running.
  */
-uint16_t WS2812FX_mode_merry_christmas(void) {
-  return WS2812FX_running(RED, GREEN);
+uint16_t WS2812FX_mode_merry_christmas(WS2812FX_Ctx *ctx) {
+  return WS2812FX_running(ctx, RED, GREEN);
 }
 
 /*
  * Alternating orange/purple pixels running.
  */
-uint16_t WS2812FX_mode_halloween(void) {
-  return WS2812FX_running(PURPLE, ORANGE);
+uint16_t WS2812FX_mode_halloween(WS2812FX_Ctx *ctx) {
+  return WS2812FX_running(ctx, PURPLE, ORANGE);
 }
 
 /*
  * Random colored pixels running.
  */
-uint16_t WS2812FX_mode_running_random(void) {
+uint16_t WS2812FX_mode_running_random(WS2812FX_Ctx *ctx) {
   uint8_t size = 2 << SIZE_OPTION;
-  if((_seg_rt->counter_mode_step) % size == 0) {
-    _seg_rt->aux_param = WS2812FX_get_random_wheel_index(_seg_rt->aux_param);
+  if((ctx->seg_rt->counter_mode_step) % size == 0) {
+    ctx->seg_rt->aux_param = WS2812FX_get_random_wheel_index(ctx, ctx->seg_rt->aux_param);
   }
 
-  uint32_t color = WS2812FX_color_wheel(_seg_rt->aux_param);
+  uint32_t color = WS2812FX_paletteColor(ctx, ctx->seg_rt->aux_param);
 
-  return WS2812FX_running(color, color);
+  return WS2812FX_running(ctx, color, color);
 }
 
 /*
  * K.I.T.T.
  */
-uint16_t WS2812FX_mode_larson_scanner(void) {
-  WS2812FX_fade_out();
+uint16_t WS2812FX_mode_larson_scanner(WS2812FX_Ctx *ctx) {
+  WS2812FX_fade_out(ctx);
 
-  if(_seg_rt->counter_mode_step < _seg_len) {
+  if(ctx->seg_rt->counter_mode_step < ctx->seg_len) {
     if(IS_REVERSE) {
-      WS2812FX_setPixelColor_nc(_seg->stop - _seg_rt->counter_mode_step, _seg->colors[0]);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->stop - ctx->seg_rt->counter_mode_step, ctx->seg->colors[0]);
     } else {
-      WS2812FX_setPixelColor_nc(_seg->start + _seg_rt->counter_mode_step, _seg->colors[0]);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->start + ctx->seg_rt->counter_mode_step, ctx->seg->colors[0]);
     }
   } else {
-    uint16_t index = (_seg_len * 2) - _seg_rt->counter_mode_step - 2;
+    uint16_t index = (ctx->seg_len * 2) - ctx->seg_rt->counter_mode_step - 2;
     if(IS_REVERSE) {
-      WS2812FX_setPixelColor_nc(_seg->stop - index, _seg->colors[0]);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->stop - index, ctx->seg->colors[0]);
     } else {
-      WS2812FX_setPixelColor_nc(_seg->start + index, _seg->colors[0]);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->start + index, ctx->seg->colors[0]);
     }
   }
 
-  _seg_rt->counter_mode_step++;
-  if(_seg_rt->counter_mode_step >= (uint16_t)((_seg_len * 2) - 2)) {
-    _seg_rt->counter_mode_step = 0;
+  ctx->seg_rt->counter_mode_step++;
+  if(ctx->seg_rt->counter_mode_step >= (uint16_t)((ctx->seg_len * 2) - 2)) {
+    ctx->seg_rt->counter_mode_step = 0;
     SET_CYCLE;
   }
 
-  return (_seg->speed / (_seg_len * 2));
+  return (ctx->seg->speed / (ctx->seg_len * 2));
 }
 
 /*
  * Firing comets from one end.
  */
-uint16_t WS2812FX_mode_comet(void) {
-  WS2812FX_fade_out();
+uint16_t WS2812FX_mode_comet(WS2812FX_Ctx *ctx) {
+  WS2812FX_fade_out(ctx);
 
   if(IS_REVERSE) {
-    WS2812FX_setPixelColor_nc(_seg->stop - _seg_rt->counter_mode_step, _seg->colors[0]);
+    WS2812FX_setPixelColor_nc(ctx, ctx->seg->stop - ctx->seg_rt->counter_mode_step, ctx->seg->colors[0]);
   } else {
-    WS2812FX_setPixelColor_nc(_seg->start + _seg_rt->counter_mode_step, _seg->colors[0]);
+    WS2812FX_setPixelColor_nc(ctx, ctx->seg->start + ctx->seg_rt->counter_mode_step, ctx->seg->colors[0]);
   }
 
-  _seg_rt->counter_mode_step = (_seg_rt->counter_mode_step + 1) % _seg_len;
-  if(_seg_rt->counter_mode_step == 0) SET_CYCLE;
+  ctx->seg_rt->counter_mode_step = (ctx->seg_rt->counter_mode_step + 1) % ctx->seg_len;
+  if(ctx->seg_rt->counter_mode_step == 0) SET_CYCLE;
 
-  return (_seg->speed / _seg_len);
+  return (ctx->seg->speed / ctx->seg_len);
 }
 
 /*
  * Firework sparks.
  */
-uint16_t WS2812FX_mode_fireworks(void) {
+uint16_t WS2812FX_mode_fireworks(WS2812FX_Ctx *ctx) {
   uint32_t color = BLACK;
   do { // randomly choose a non-BLACK color from the colors array
-    color = _seg->colors[WS2812FX_random8_lim(MAX_NUM_COLORS)];
+    color = ctx->seg->colors[WS2812FX_random8_lim(ctx, MAX_NUM_COLORS)];
   } while (color == BLACK);
-  return WS2812FX_fireworks(color);
+  return WS2812FX_fireworks(ctx, color);
 }
 
 /*
  * Random colored firework sparks.
  */
-uint16_t WS2812FX_mode_fireworks_random(void) {
-  return WS2812FX_fireworks(WS2812FX_color_wheel(WS2812FX_random8()));
+uint16_t WS2812FX_mode_fireworks_random(WS2812FX_Ctx *ctx) {
+  return WS2812FX_fireworks(ctx, WS2812FX_paletteColor(ctx, WS2812FX_random8(ctx)));
 }
 
 /*
  * Random flickering.
  */
-uint16_t WS2812FX_mode_fire_flicker(void) {
-  return WS2812FX_fire_flicker(3);
+uint16_t WS2812FX_mode_fire_flicker(WS2812FX_Ctx *ctx) {
+  return WS2812FX_fire_flicker(ctx, 3);
 }
 
 /*
 * Random flickering, less intensity.
 */
-uint16_t WS2812FX_mode_fire_flicker_soft(void) {
-  return WS2812FX_fire_flicker(6);
+uint16_t WS2812FX_mode_fire_flicker_soft(WS2812FX_Ctx *ctx) {
+  return WS2812FX_fire_flicker(ctx, 6);
 }
 
 /*
 * Random flickering, more intensity.
 */
-uint16_t WS2812FX_mode_fire_flicker_intense(void) {
-  return WS2812FX_fire_flicker(1);
+uint16_t WS2812FX_mode_fire_flicker_intense(WS2812FX_Ctx *ctx) {
+  return WS2812FX_fire_flicker(ctx, 1);
 }
 
 // An adaptation of Mark Kriegsman's FastLED twinkleFOX effect
 // https://gist.github.com/kriegsman/756ea6dcae8e30845b5a
-uint16_t WS2812FX_mode_twinkleFOX(void) {
-  uint16_t mySeed = 0; // reset the random number generator seed
+uint16_t WS2812FX_scratch_twinkleFOX(const WS2812FX_Segment *seg, const WS2812FX_Segment_runtime *rt) {
+  (void)rt;
+  uint8_t size = 1 << ((seg->options >> 1) & 0x03);
+  return ((seg->stop - seg->start + 1) + size - 1) / size * 2;
+}
 
+uint16_t WS2812FX_mode_twinkleFOX(WS2812FX_Ctx *ctx) {
   // Get and translate the segment's size option
-  uint8_t size = 1 << ((_seg->options >> 1) & 0x03); // 1,2,4,8
-
-  // Get the segment's colors array values
-  uint32_t color0 = _seg->colors[0];
-  uint32_t color1 = _seg->colors[1];
-  uint32_t color2 = _seg->colors[2];
-  uint32_t blendedColor;
-
-  for (uint16_t i = _seg->start; i <= _seg->stop; i+=size) {
-    // Use Mark Kriegsman's clever idea of using pseudo-random numbers to determine
-    // each LED's initial and increment blend values
-    mySeed = (mySeed * 2053) + 13849; // a random, but deterministic, number
-    uint16_t initValue = (mySeed + (mySeed >> 8)) & 0xff; // the LED's initial blend index (0-255)
-    mySeed = (mySeed * 2053) + 13849; // another random, but deterministic, number
-    uint16_t incrValue = (((mySeed + (mySeed >> 8)) & 0x07) + 1) * 2; // blend index increment (2,4,6,8,10,12,14,16)
+  uint8_t size = 1 << ((ctx->seg->options >> 1) & 0x03); // 1,2,4,8
+  uint16_t groups = (ctx->seg_len + size - 1) / size;
+
+  // Every LED group's initial blend index and blend index increment only
+  // depend on its position, so they're worked out once and kept in the
+  // segment's scratch memory: groups bytes of initial values followed by
+  // groups bytes of increments. Built on the first call, into the block
+  // carved when the mode was selected, and rebuilt if the segment's size
+  // changes.
+  uint8_t *params = ctx->seg_rt->scratch;
+  bool build = ctx->seg_rt->counter_mode_call == 0;
+  if(params == NULL || ctx->seg_rt->scratch_len != groups * 2) {
+    params = WS2812FX_allocScratch(ctx, groups * 2);
+    if(params == NULL) return ctx->seg->speed / 32; // out of scratch memory
+    build = true;
+  }
+  if(build) {
+    uint16_t mySeed = 0; // reset the random number generator seed
+    for(uint16_t g = 0; g < groups; g++) {
+      // Use Mark Kriegsman's clever idea of using pseudo-random numbers to determine
+      // each LED's initial and increment blend values
+      mySeed = (mySeed * 2053) + 13849; // a random, but deterministic, number
+      params[g] = (mySeed + (mySeed >> 8)) & 0xff; // the LED's initial blend index (0-255)
+      mySeed = (mySeed * 2053) + 13849; // another random, but deterministic, number
+      params[groups + g] = (((mySeed + (mySeed >> 8)) & 0x07) + 1) * 2; // blend index increment (2,4,6,8,10,12,14,16)
+    }
+  }
+  const uint8_t *initValues = params, *incrValues = params + groups;
+
+  // Resolve the blend endpoints once per frame. If colors[2] isn't BLACK, the
+  // LEDs with an initial blend index >= 128 blend colors[2]/colors[1], the
+  // others colors[0]/colors[1]. If colors[0] is BLACK, blend random colors.
+  uint32_t color1 = ctx->seg->colors[1];
+  uint32_t pair[2] = {ctx->seg->colors[0], ctx->seg->colors[2] != BLACK ? ctx->seg->colors[2] : ctx->seg->colors[0]};
+  bool randomColors = ctx->seg->colors[0] == BLACK;
+
+  // Use the counter_mode_call var as a clock "tick" counter, only its low
+  // byte matters as the blend index wraps at 256
+  uint8_t tick = (uint8_t)ctx->seg_rt->counter_mode_call;
+  uint16_t i = ctx->seg->start;
+  for (uint16_t g = 0; g < groups; g++, i += size) {
+    uint8_t initValue = initValues[g];
+    uint8_t blendIndex = initValue + tick * incrValues[g]; // 0-255
 
     // We're going to use a sine function to blend colors, instead of Mark's triangle
     // function, simply because a sine lookup table is already built into the
     // Adafruit_NeoPixel lib. Yes, I'm lazy.
-    // Use the counter_mode_call var as a clock "tick" counter and calc the blend index
-    uint8_t blendIndex = (initValue + (_seg_rt->counter_mode_call * incrValue)) & 0xff; // 0-255
-    // Index into the built-in Adafruit_NeoPixel sine table to lookup the blend amount
     uint8_t blendAmt = Adafruit_NeoPixel_sine8(blendIndex); // 0-255
-
-    // If colors[0] is BLACK, blend random colors
-    if(color0 == BLACK) {
-      blendedColor = WS2812FX_color_blend(WS2812FX_color_wheel(initValue), color1, blendAmt);
-    // If colors[2] isn't BLACK, choose to blend colors[0]/colors[1] or colors[1]/colors[2]
-    // (which color pair to blend is picked randomly)
-    } else if((color2 != BLACK) && (initValue < 128) == 0) {
-      blendedColor = WS2812FX_color_blend(color2, color1, blendAmt);
-    // Otherwise always blend colors[0]/colors[1]
-    } else {
-      blendedColor = WS2812FX_color_blend(color0, color1, blendAmt);
-    }
+    uint32_t color0 = randomColors ? WS2812FX_paletteColor(ctx, initValue) : pair[initValue >> 7];
+    uint32_t blendedColor = WS2812FX_color_blend(color0, color1, blendAmt);
 
     // Assign the new color to the number of LEDs specified by the SIZE option
-    for(uint8_t j=0; j<size; j++) {
-      if((i + j) <= _seg->stop) {
-        WS2812FX_setPixelColor_nc(i + j, blendedColor);
-      }
+    if(size == 1) {
+      WS2812FX_setPixelColor_nc(ctx, i, blendedColor);
+    } else {
+      WS2812FX_fill(ctx, blendedColor, i, size);
     }
   }
   SET_CYCLE;
-  return _seg->speed / 32;
+  return ctx->seg->speed / 32;
 }
 
 // A combination of the Fireworks effect and the running effect
 // to create an effect that looks like rain.
-uint16_t WS2812FX_mode_rain(void) {
+uint16_t WS2812FX_mode_rain(WS2812FX_Ctx *ctx) {
   // randomly choose colors[0] or colors[2]
-  uint32_t rainColor = (WS2812FX_random8() & 1) == 0 ? _seg->colors[0] : _seg->colors[2];
+  uint32_t rainColor = (WS2812FX_random8(ctx) & 1) == 0 ? ctx->seg->colors[0] : ctx->seg->colors[2];
   // if colors[0] == colors[1], choose a random color
-  if(_seg->colors[0] == _seg->colors[1]) rainColor = WS2812FX_color_wheel(WS2812FX_random8());
+  if(ctx->seg->colors[0] == ctx->seg->colors[1]) rainColor = WS2812FX_paletteColor(ctx, WS2812FX_random8(ctx));
 
   // run the fireworks effect to create a "raindrop"
-  WS2812FX_fireworks(rainColor);
+  WS2812FX_fireworks(ctx, rainColor);
 
   // shift everything two pixels
-  if(IS_REVERSE) {
-    WS2812FX_copyPixels(_seg->start, _seg->start + 2, _seg_len - 2);
-  } else {
-    WS2812FX_copyPixels(_seg->start + 2, _seg->start, _seg_len - 2);
-  }
+  WS2812FX_scroll(ctx, IS_REVERSE ? -2 : 2);
 
-  return (_seg->speed / 16);
+  return (ctx->seg->speed / 16);
 }
 
 // block dissolve effect
-uint16_t WS2812FX_mode_block_dissolve(void) {
-  uint32_t color = _seg->colors[_seg_rt->aux_param]; // get the target color
-
-  // get the decimated color after setPixelColor() has mangled it
-  // in accordance to the brightness setting
-  WS2812FX_setPixelColor_nc(_seg->start, color);
-  uint32_t desColor = Adafruit_NeoPixel_getPixelColor(_seg->start);
-
-  // find a random pixel that isn't the target color and update it
-  for(uint16_t i=0; i<_seg_len; i++) {
-    int index = _seg->start + WS2812FX_random16_lim(_seg_len);
-    if(Adafruit_NeoPixel_getPixelColor(index) != desColor) {
-      WS2812FX_setPixelColor_nc(index, color);
-      return _seg->speed / 64;
-    }
-  }
+uint16_t WS2812FX_mode_block_dissolve(WS2812FX_Ctx *ctx) {
+  uint32_t color = ctx->seg->colors[ctx->seg_rt->aux_param]; // get the target color
 
-  // if didn't find a random pixel that wasn't the target color,
-  // then set the entire segment to the target color
-  WS2812FX_fill(color, _seg->start, _seg_len);
+  // every pixel is set exactly once, so the dissolve is done in seg_len steps
+  WS2812FX_setPixelColor_nc(ctx, WS2812FX_dissolve(ctx), color);
 
-  // choose a new target color
-  _seg_rt->aux_param = (_seg_rt->aux_param + 1) % MAX_NUM_COLORS;
-  if(_seg_rt->aux_param == 0) SET_CYCLE;
-  return _seg->speed / 64;
+  if(ctx->seg_rt->counter_mode_step >= ctx->seg_len) {
+    ctx->seg_rt->counter_mode_step = 0;
+    // choose a new target color
+    ctx->seg_rt->aux_param = (ctx->seg_rt->aux_param + 1) % MAX_NUM_COLORS;
+    if(ctx->seg_rt->aux_param == 0) SET_CYCLE;
+  }
+  return ctx->seg->speed / 64;
 }
 
 // ICU effect
-uint16_t WS2812FX_mode_icu(void) {
-  uint16_t pos = _seg_rt->counter_mode_step; // current eye position
-  uint16_t dest = _seg_rt->aux_param3;       // eye destination
-  uint16_t index = _seg->start + pos;        // index of the first eye
-  uint16_t index2 = index + _seg_len/2;      // index of the second eye
+uint16_t WS2812FX_mode_icu(WS2812FX_Ctx *ctx) {
+  uint16_t pos = ctx->seg_rt->counter_mode_step; // current eye position
+  uint16_t dest = ctx->seg_rt->aux_param3;       // eye destination
+  uint16_t index = ctx->seg->start + pos;        // index of the first eye
+  uint16_t index2 = index + ctx->seg_len/2;      // index of the second eye
 
-  WS2812FX_setPixelColor_nc(index, BLACK); // erase the current eyes
-  WS2812FX_setPixelColor_nc(index2, BLACK);
+  WS2812FX_setPixelColor_nc(ctx, index, BLACK); // erase the current eyes
+  WS2812FX_setPixelColor_nc(ctx, index2, BLACK);
 
   // if the eyes have not reached their destination
   if(pos != dest) {
     // move the eyes right or left depending on position relative to destination
     int dir = dest > pos ? 1 : -1;
-    WS2812FX_setPixelColor_nc(index + dir, _seg->colors[0]); // paint two eyes
-    WS2812FX_setPixelColor_nc(index2 + dir, _seg->colors[0]);
-    _seg_rt->counter_mode_step += dir; // update the eye position
-    return (_seg->speed / _seg_len);
+    WS2812FX_setPixelColor_nc(ctx, index + dir, ctx->seg->colors[0]); // paint two eyes
+    WS2812FX_setPixelColor_nc(ctx, index2 + dir, ctx->seg->colors[0]);
+    ctx->seg_rt->counter_mode_step += dir; // update the eye position
+    return (ctx->seg->speed / ctx->seg_len);
   } else { // the eyes have reached their destination
-    if(WS2812FX_random8_lim(6) == 0) {  // blink the eyes once in a while
+    if(WS2812FX_random8_lim(ctx, 6) == 0) {  // blink the eyes once in a while
       return 200;
     } else {
-      WS2812FX_setPixelColor_nc(index, _seg->colors[0]);
-      WS2812FX_setPixelColor_nc(index2, _seg->colors[0]);
-      _seg_rt->aux_param3 = WS2812FX_random16_lim(_seg_len/2); // set a new destination
+      WS2812FX_setPixelColor_nc(ctx, index, ctx->seg->colors[0]);
+      WS2812FX_setPixelColor_nc(ctx, index2, ctx->seg->colors[0]);
+      ctx->seg_rt->aux_param3 = WS2812FX_random16_lim(ctx, ctx->seg_len/2); // set a new destination
       SET_CYCLE;
-      return 1000 + WS2812FX_random16_lim(2000); // pause a second or two
+      return 1000 + WS2812FX_random16_lim(ctx, 2000); // pause a second or two
     }
   }
 }
 
 // Dual Larson effect
-uint16_t WS2812FX_mode_dual_larson(void) {
-  WS2812FX_fade_out();
+uint16_t WS2812FX_mode_dual_larson(WS2812FX_Ctx *ctx) {
+  WS2812FX_fade_out(ctx);
 
-  _seg_rt->aux_param3 += _seg_rt->aux_param ? -1 : 1; // update the LED index
+  ctx->seg_rt->aux_param3 += ctx->seg_rt->aux_param ? -1 : 1; // update the LED index
 
-  WS2812FX_setPixelColor_nc(_seg->start + _seg_rt->aux_param3, _seg->colors[0]);
-  WS2812FX_setPixelColor_nc(_seg->stop  - _seg_rt->aux_param3, _seg->colors[2] ? _seg->colors[2] : _seg->colors[0]);
+  WS2812FX_setPixelColor_nc(ctx, ctx->seg->start + ctx->seg_rt->aux_param3, ctx->seg->colors[0]);
+  WS2812FX_setPixelColor_nc(ctx, ctx->seg->stop  - ctx->seg_rt->aux_param3, ctx->seg->colors[2] ? ctx->seg->colors[2] : ctx->seg->colors[0]);
 
-  if(_seg_rt->aux_param3 == 0 || _seg_rt->aux_param3 >= _seg_len - 1) {
-    _seg_rt->aux_param = !_seg_rt->aux_param; // change direction
+  if(ctx->seg_rt->aux_param3 == 0 || ctx->seg_rt->aux_param3 >= ctx->seg_len - 1) {
+    ctx->seg_rt->aux_param = !ctx->seg_rt->aux_param; // change direction
     SET_CYCLE;
   }
 
-  return (_seg->speed / (_seg_len * 2));
+  return (ctx->seg->speed / (ctx->seg_len * 2));
 }
 
 // Running random2 effect (simplified version of the custom RandomChase effect)
-uint16_t WS2812FX_mode_running_random2(void) {
+uint16_t WS2812FX_mode_running_random2(WS2812FX_Ctx *ctx) {
   uint8_t size = 2 << SIZE_OPTION;
-  uint32_t color = IS_REVERSE ? Adafruit_NeoPixel_getPixelColor(_seg->stop): Adafruit_NeoPixel_getPixelColor(_seg->start);
+  uint32_t color = Adafruit_NeoPixel_getPixelColor(&ctx->strip, WS2812FX_segPixel(ctx, IS_REVERSE ? ctx->seg_len - 1 : 0));
 
   // periodically change the color
-  if((_seg_rt->counter_mode_step) % size == 0) {
-    color = ((uint32_t)WS2812FX_random8() << 16) | WS2812FX_random16();
+  if((ctx->seg_rt->counter_mode_step) % size == 0) {
+    color = ((uint32_t)WS2812FX_random8(ctx) << 16) | WS2812FX_random16(ctx);
   }
 
-  return WS2812FX_running(color, color);
+  return WS2812FX_running(ctx, color, color);
 }
 
 // simplified version of the custom filler up mode
-uint16_t WS2812FX_mode_filler_up(void) {
+uint16_t WS2812FX_mode_filler_up(WS2812FX_Ctx *ctx) {
   uint8_t size = 1 << SIZE_OPTION;
 
-  if(_seg_rt->aux_param3 >= _seg_len) { // if glass is full, reset
-    _seg_rt->aux_param3 = 0; // empty the glass
-    _seg_rt->aux_param = !_seg_rt->aux_param; // swap fg and bg colors
+  if(ctx->seg_rt->aux_param3 >= ctx->seg_len) { // if glass is full, reset
+    ctx->seg_rt->aux_param3 = 0; // empty the glass
+    ctx->seg_rt->aux_param = !ctx->seg_rt->aux_param; // swap fg and bg colors
     SET_CYCLE;
   }
 
-  uint32_t fgColor = _seg_rt->aux_param ? _seg->colors[0] : _seg->colors[1];
-  uint32_t bgColor = _seg_rt->aux_param ? _seg->colors[1] : _seg->colors[0];
+  uint32_t fgColor = ctx->seg_rt->aux_param ? ctx->seg->colors[0] : ctx->seg->colors[1];
+  uint32_t bgColor = ctx->seg_rt->aux_param ? ctx->seg->colors[1] : ctx->seg->colors[0];
 
   if(IS_REVERSE) {
-    WS2812FX_fill(bgColor, _seg->start, _seg_len); // fill with bg color
-    WS2812FX_fill(fgColor, _seg->stop - _seg_rt->counter_mode_step, size); // drop
-    if(_seg_rt->aux_param3) WS2812FX_fill(fgColor, _seg->start, _seg_rt->aux_param3);
+    WS2812FX_fill(ctx, bgColor, ctx->seg->start, ctx->seg_len); // fill with bg color
+    WS2812FX_fill(ctx, fgColor, ctx->seg->stop - ctx->seg_rt->counter_mode_step, size); // drop
+    if(ctx->seg_rt->aux_param3) WS2812FX_fill(ctx, fgColor, ctx->seg->start, ctx->seg_rt->aux_param3);
   } else {
-    WS2812FX_fill(bgColor, _seg->start, _seg_len); // fill with bg color
-    WS2812FX_fill(fgColor, _seg->start + _seg_rt->counter_mode_step, size); // drop
-    if(_seg_rt->aux_param3) WS2812FX_fill(fgColor, _seg->start + _seg_len - _seg_rt->aux_param3, _seg_rt->aux_param3);
+    WS2812FX_fill(ctx, bgColor, ctx->seg->start, ctx->seg_len); // fill with bg color
+    WS2812FX_fill(ctx, fgColor, ctx->seg->start + ctx->seg_rt->counter_mode_step, size); // drop
+    if(ctx->seg_rt->aux_param3) WS2812FX_fill(ctx, fgColor, ctx->seg->start + ctx->seg_len - ctx->seg_rt->aux_param3, ctx->seg_rt->aux_param3);
   }
 
-  _seg_rt->counter_mode_step++; // move the drop
+  ctx->seg_rt->counter_mode_step++; // move the drop
 
   // when drop reaches the fill line, incr the fill line
-  if(_seg_rt->counter_mode_step >= _seg_len - _seg_rt->aux_param3) {
-    _seg_rt->aux_param3++;
-    _seg_rt->counter_mode_step = 0;
+  if(ctx->seg_rt->counter_mode_step >= ctx->seg_len - ctx->seg_rt->aux_param3) {
+    ctx->seg_rt->aux_param3++;
+    ctx->seg_rt->counter_mode_step = 0;
   }
 
-  return (_seg->speed / _seg_len);
+  return (ctx->seg->speed / ctx->seg_len);
 }
 
 // Rainbow Larson effect
-uint16_t WS2812FX_mode_rainbow_larson(void) {
-  WS2812FX_fade_out();
+uint16_t WS2812FX_mode_rainbow_larson(WS2812FX_Ctx *ctx) {
+  WS2812FX_fade_out(ctx);
 
-  _seg_rt->aux_param3 += _seg_rt->aux_param ? -1 : 1; // update the LED index
+  ctx->seg_rt->aux_param3 += ctx->seg_rt->aux_param ? -1 : 1; // update the LED index
 
   if(IS_REVERSE) {
-    WS2812FX_setPixelColor_nc(_seg->stop - _seg_rt->aux_param3, WS2812FX_color_wheel(_seg_rt->counter_mode_call << 4));
-    //setPixelColor(_seg->stop - _seg_rt->aux_param3, color_wheel((_seg_rt->aux_param3 << 8) / _seg_len));
+    WS2812FX_setPixelColor_nc(ctx, ctx->seg->stop - ctx->seg_rt->aux_param3, WS2812FX_paletteColor(ctx, ctx->seg_rt->counter_mode_call << 4));
+    //setPixelColor(ctx->seg->stop - ctx->seg_rt->aux_param3, color_wheel((ctx->seg_rt->aux_param3 << 8) / ctx->seg_len));
   } else {
-    WS2812FX_setPixelColor_nc(_seg->start + _seg_rt->aux_param3, WS2812FX_color_wheel(_seg_rt->counter_mode_call << 4));
-    //setPixelColor(_seg->start + _seg_rt->aux_param3, color_wheel((_seg_rt->aux_param3 << 8) / _seg_len));
+    WS2812FX_setPixelColor_nc(ctx, ctx->seg->start + ctx->seg_rt->aux_param3, WS2812FX_paletteColor(ctx, ctx->seg_rt->counter_mode_call << 4));
+    //setPixelColor(ctx->seg->start + ctx->seg_rt->aux_param3, color_wheel((ctx->seg_rt->aux_param3 << 8) / ctx->seg_len));
   }
 
-  if(_seg_rt->aux_param3 == 0 || _seg_rt->aux_param3 >= _seg_len - 1) {
-    _seg_rt->aux_param = !_seg_rt->aux_param; // change direction
+  if(ctx->seg_rt->aux_param3 == 0 || ctx->seg_rt->aux_param3 >= ctx->seg_len - 1) {
+    ctx->seg_rt->aux_param = !ctx->seg_rt->aux_param; // change direction
     SET_CYCLE;
   }
 
-  return (_seg->speed / (_seg_len * 2));
+  return (ctx->seg->speed / (ctx->seg_len * 2));
 }
 
-uint16_t WS2812FX_mode_rainbow_fireworks(void) {
-  for(uint16_t i=_seg->start; i <= _seg->stop; i++) {
-    uint32_t color = WS2812FX_getRawPixelColor(i); // get the raw pixel color (ignore global brightness)
+uint16_t WS2812FX_mode_rainbow_fireworks(WS2812FX_Ctx *ctx) {
+  for(uint16_t i=ctx->seg->start; i <= ctx->seg->stop; i++) {
+    uint32_t color = WS2812FX_getRawPixelColor(ctx, i); // get the raw pixel color (ignore global brightness)
     color = (color >> 1) & 0x7F7F7F7F;    // fade all pixels
-    WS2812FX_setRawPixelColor(i, color);
+    WS2812FX_setRawPixelColor(ctx, i, color);
 
     // search for the fading red pixels, and create the appropriate neighboring pixels
     if(color == 0x7F0000) {
-      WS2812FX_setPixelColor_nc(i-1, 0xFF7F00); // orange
-      WS2812FX_setPixelColor_nc(i+1, 0xFF7F00);
+      WS2812FX_setPixelColor_nc(ctx, i-1, 0xFF7F00); // orange
+      WS2812FX_setPixelColor_nc(ctx, i+1, 0xFF7F00);
     } else if(color == 0x3F0000) {
-      WS2812FX_setPixelColor_nc(i-2, 0xFFFF00); // yellow
-      WS2812FX_setPixelColor_nc(i+2, 0xFFFF00);
+      WS2812FX_setPixelColor_nc(ctx, i-2, 0xFFFF00); // yellow
+      WS2812FX_setPixelColor_nc(ctx, i+2, 0xFFFF00);
     } else if(color == 0x1F0000) {
-      WS2812FX_setPixelColor_nc(i-3, 0x00FF00); // green
-      WS2812FX_setPixelColor_nc(i+3, 0x00FF00);
+      WS2812FX_setPixelColor_nc(ctx, i-3, 0x00FF00); // green
+      WS2812FX_setPixelColor_nc(ctx, i+3, 0x00FF00);
     } else if(color == 0x0F0000) {
-      WS2812FX_setPixelColor_nc(i-4, 0x0000FF); // blue
-      WS2812FX_setPixelColor_nc(i+4, 0x0000FF);
+      WS2812FX_setPixelColor_nc(ctx, i-4, 0x0000FF); // blue
+      WS2812FX_setPixelColor_nc(ctx, i+4, 0x0000FF);
     } else if(color == 0x070000) {
-      WS2812FX_setPixelColor_nc(i-5, 0x4B0082); // indigo
-      WS2812FX_setPixelColor_nc(i+5, 0x4B0082);
+      WS2812FX_setPixelColor_nc(ctx, i-5, 0x4B0082); // indigo
+      WS2812FX_setPixelColor_nc(ctx, i+5, 0x4B0082);
     } else if(color == 0x030000) {
-      WS2812FX_setPixelColor_nc(i-6, 0x9400D3); // violet
-      WS2812FX_setPixelColor_nc(i+6, 0x9400D3);
+      WS2812FX_setPixelColor_nc(ctx, i-6, 0x9400D3); // violet
+      WS2812FX_setPixelColor_nc(ctx, i+6, 0x9400D3);
     }
   }
 
   // occasionally create a random red pixel
-  if(WS2812FX_random8_lim(4) == 0) {
-    uint16_t index = _seg->start + 6 + WS2812FX_random16_lim(max(1, _seg_len - 12));
-    WS2812FX_setRawPixelColor(index, RED); // set the raw pixel color (ignore global brightness)
+  if(WS2812FX_random8_lim(ctx, 4) == 0) {
+    uint16_t index = ctx->seg->start + 6 + WS2812FX_random16_lim(ctx, max(1, ctx->seg_len - 12));
+    WS2812FX_setRawPixelColor(ctx, index, RED); // set the raw pixel color (ignore global brightness)
     SET_CYCLE;
   }
-  return(_seg->speed / _seg_len);
+  return(ctx->seg->speed / ctx->seg_len);
 }
 
-uint16_t WS2812FX_mode_trifade(void) {
-  uint32_t colorsMain[] = { _seg->colors[0], _seg->colors[1], _seg->colors[2] };
-  uint32_t colorsAlt[]  = { _seg->colors[0], BLACK, _seg->colors[1], BLACK, _seg->colors[2], BLACK };
+uint16_t WS2812FX_mode_trifade(WS2812FX_Ctx *ctx) {
+  uint32_t colorsMain[] = { ctx->seg->colors[0], ctx->seg->colors[1], ctx->seg->colors[2] };
+  uint32_t colorsAlt[]  = { ctx->seg->colors[0], BLACK, ctx->seg->colors[1], BLACK, ctx->seg->colors[2], BLACK };
 
   uint32_t* colors = colorsMain;
   uint8_t numColors = sizeof(colorsMain) / sizeof(uint32_t);
@@ -883,149 +886,166 @@ uint16_t WS2812FX_mode_trifade(void) {
       numColors = sizeof(colorsAlt) / sizeof(uint32_t);
   }
 
-  uint32_t color1 = colors[_seg_rt->aux_param];
-  uint32_t color2 = colors[(_seg_rt->aux_param + 1) % numColors];
+  uint32_t color1 = colors[ctx->seg_rt->aux_param];
+  uint32_t color2 = colors[(ctx->seg_rt->aux_param + 1) % numColors];
 
-  uint32_t color = WS2812FX_color_blend(color1, color2, _seg_rt->aux_param3);
-  WS2812FX_fill(color, _seg->start, _seg_len);
+  uint32_t color = WS2812FX_color_blend(color1, color2, ctx->seg_rt->aux_param3);
+  WS2812FX_fill(ctx, color, ctx->seg->start, ctx->seg_len);
 
-  _seg_rt->aux_param3 = (_seg_rt->aux_param3 + 4) % 256;
-  if(_seg_rt->aux_param3 == 0) {
-    _seg_rt->aux_param = (_seg_rt->aux_param + 1) % numColors;
+  ctx->seg_rt->aux_param3 = (ctx->seg_rt->aux_param3 + 4) % 256;
+  if(ctx->seg_rt->aux_param3 == 0) {
+    ctx->seg_rt->aux_param = (ctx->seg_rt->aux_param + 1) % numColors;
     SET_CYCLE;
   }
 
-  return (_seg->speed / 128);
+  return (ctx->seg->speed / 128);
 }
 
 // create pulses that start in the middle of the segment and move toward it's edges
 // time two pulses to mimic a heartbeat
-uint16_t WS2812FX_mode_heartbeat(void) {
-  static unsigned long then = 0;
-  unsigned long now = millis();
+uint16_t WS2812FX_mode_heartbeat(WS2812FX_Ctx *ctx) {
+  uint32_t now = ctx->micros != NULL ? (uint32_t)(ctx->micros() / 1000) : 0;
+  uint32_t then = ctx->seg_rt->counter_mode_step; // millis of the last first beat
 
   // Get and translate the segment's size option
-  uint8_t size = 2 << ((_seg->options >> 1) & 0x03); // 2,4,8,16
+  uint8_t size = 2 << ((ctx->seg->options >> 1) & 0x03); // 2,4,8,16
 
   // copy pixels from the middle of the segment to the edges
-  uint16_t bytesPerPixelBlock = size * WS2812FX_getNumBytesPerPixel();
-  uint16_t centerOffset = (_seg_len / 2) * WS2812FX_getNumBytesPerPixel();
+  uint16_t bytesPerPixelBlock = size * NEO_BYTES_PER_PIXEL(&ctx->strip);
+  uint16_t centerOffset = (ctx->seg_len / 2) * NEO_BYTES_PER_PIXEL(&ctx->strip);
   uint16_t byteCount = centerOffset - bytesPerPixelBlock;
-  Adafruit_NeoPixel_memmove(Adafruit_NeoPixel_getPixels(), Adafruit_NeoPixel_getPixels() + bytesPerPixelBlock, byteCount);
-  Adafruit_NeoPixel_memmove(Adafruit_NeoPixel_getPixels() + centerOffset + bytesPerPixelBlock, getPixels() + centerOffset, byteCount);
-
-  WS2812FX_fade_out();
-
-  int beatTimer = now - then;
-  if((beatTimer > 400) && !_seg_rt->aux_param) { // time for the second beat? (400ms after the first beat)
-    uint16_t startLed = _seg->start + (_seg_len / 2) - size;
-    WS2812FX_fill(_seg->colors[0], startLed, size * 2); // create the second beat
+  uint8_t *pixels = Adafruit_NeoPixel_getPixels(&ctx->strip) + ctx->seg->start * NEO_BYTES_PER_PIXEL(&ctx->strip);
+  Adafruit_NeoPixel_subSums(&ctx->strip, ctx->seg->start, ctx->seg->stop);
+  Adafruit_NeoPixel_memmove(pixels, pixels + bytesPerPixelBlock, byteCount);
+  Adafruit_NeoPixel_memmove(pixels + centerOffset + bytesPerPixelBlock, pixels + centerOffset, byteCount);
+  Adafruit_NeoPixel_addSums(&ctx->strip, ctx->seg->start, ctx->seg->stop);
+  Adafruit_NeoPixel_markDirty(&ctx->strip, ctx->seg->start, ctx->seg->stop);
+
+  WS2812FX_fade_out(ctx);
+
+  int32_t beatTimer = (int32_t)(now - then);
+  if((beatTimer > 400) && !ctx->seg_rt->aux_param) { // time for the second beat? (400ms after the first beat)
+    uint16_t startLed = ctx->seg->start + (ctx->seg_len / 2) - size;
+    WS2812FX_fill(ctx, ctx->seg->colors[0], startLed, size * 2); // create the second beat
     
-    _seg_rt->aux_param = true; // is second beat
+    ctx->seg_rt->aux_param = true; // is second beat
   }
   if(beatTimer > 1200) { // time for the first beat? (1200ms)
-    uint16_t startLed = _seg->start + (_seg_len / 2) - size;
-    WS2812FX_fill(_seg->colors[0], startLed, size * 2); // create the first beat
+    uint16_t startLed = ctx->seg->start + (ctx->seg_len / 2) - size;
+    WS2812FX_fill(ctx, ctx->seg->colors[0], startLed, size * 2); // create the first beat
 
-    _seg_rt->aux_param = false; // is first beat
-    then = now; // reset the beat timer
+    ctx->seg_rt->aux_param = false; // is first beat
+    ctx->seg_rt->counter_mode_step = now; // reset the beat timer
     SET_CYCLE;
   }
 
-  return(_seg->speed / 32);
+  return(ctx->seg->speed / 32);
 }
 
-uint16_t WS2812FX_mode_vu_meter(void) {
-  static uint8_t randomData[1]; // default: one channel of random data
+// the random data, one byte per channel, if there's no external data source
+uint16_t WS2812FX_scratch_vu_meter(const WS2812FX_Segment *seg, const WS2812FX_Segment_runtime *rt) {
+  (void)seg;
+  return rt->extDataSrc != NULL ? 0 : rt->extDataCnt != 0 ? rt->extDataCnt : 1;
+}
 
+uint16_t WS2812FX_mode_vu_meter(WS2812FX_Ctx *ctx) {
   // if external data source not set, config for one channel of random data
-  uint8_t* src = _seg_rt->extDataSrc != NULL ? _seg_rt->extDataSrc : randomData;
-  uint16_t cnt = _seg_rt->extDataCnt != 0    ? _seg_rt->extDataCnt : 1;
+  uint8_t* src = ctx->seg_rt->extDataSrc;
+  uint16_t cnt = ctx->seg_rt->extDataCnt != 0 ? ctx->seg_rt->extDataCnt : 1;
 
-  if(src == randomData) { // if using random data, generate some
+  if(src == NULL) { // if using random data, generate some
+    src = ctx->seg_rt->scratch;
+    if(src == NULL || ctx->seg_rt->scratch_len != cnt) src = WS2812FX_allocScratch(ctx, cnt);
+    if(src == NULL) return(ctx->seg->speed / 64); // out of scratch memory
     for(uint8_t i=0; i<cnt; i++) {
-      int randomData = src[i] + WS2812FX_random8_lim(32) - WS2812FX_random8_lim(32);
+      int randomData = src[i] + WS2812FX_random8_lim(ctx, 32) - WS2812FX_random8_lim(ctx, 32);
       src[i] = (randomData < 0 || randomData > 255) ? 128 : randomData;
     }
   }
 
-  uint16_t channelSize = _seg_len / cnt; // num LEDs in each channel
+  uint16_t channelSize = ctx->seg_len / cnt; // num LEDs in each channel
 
   for(uint8_t i=0; i<cnt; i++) {  // for each channel
     uint8_t scaledLevel = (src[i] * channelSize) / 256;
     for(uint16_t j=0; j<channelSize; j++) {
-      uint16_t index = _seg->start + (i * channelSize) + j;
+      uint16_t index = ctx->seg->start + (i * channelSize) + j;
       if(j <= scaledLevel) {
-        if(j < channelSize - 4)      WS2812FX_setPixelColor_nc(index, _seg->colors[0]); // green
-        else if(j < channelSize - 2) WS2812FX_setPixelColor_nc(index, _seg->colors[1]); // yellow
-        else                         WS2812FX_setPixelColor_nc(index, _seg->colors[2]); // red
+        if(j < channelSize - 4)      WS2812FX_setPixelColor_nc(ctx, index, ctx->seg->colors[0]); // green
+        else if(j < channelSize - 2) WS2812FX_setPixelColor_nc(ctx, index, ctx->seg->colors[1]); // yellow
+        else                         WS2812FX_setPixelColor_nc(ctx, index, ctx->seg->colors[2]); // red
       } else {
-        WS2812FX_setPixelColor_nc(index, BLACK);
+        WS2812FX_setPixelColor_nc(ctx, index, BLACK);
       }
     }
   }
   SET_CYCLE;
 
-  return(_seg->speed / 64);
+  return(ctx->seg->speed / 64);
 }
 
-uint16_t WS2812FX_mode_bits(void) {
-  static uint8_t bitsData[] = {1,1,1,0,1,0,1,1,1,1}; // pi=3.14
+uint16_t WS2812FX_mode_bits(WS2812FX_Ctx *ctx) {
+  static const uint8_t bitsData[] = {1,1,1,0,1,0,1,1,1,1}; // pi=3.14
 
   // if external data source not set, config for pi
-  uint8_t* src = _seg_rt->extDataSrc != NULL ? _seg_rt->extDataSrc : bitsData;
-  uint16_t cnt = _seg_rt->extDataCnt != 0    ? _seg_rt->extDataCnt : 10;
+  const uint8_t* src = ctx->seg_rt->extDataSrc != NULL ? ctx->seg_rt->extDataSrc : bitsData;
+  uint16_t cnt = ctx->seg_rt->extDataCnt != 0    ? ctx->seg_rt->extDataCnt : 10;
 
   // segment length must be at least twice the number of bits
-  uint8_t ledsPerBit = _seg_len / (cnt * 2);
+  uint8_t ledsPerBit = ctx->seg_len / (cnt * 2);
   if(ledsPerBit) {
-    uint32_t color = WS2812FX_color_wheel(_seg_rt->aux_param++); // rainbow of colors
+    uint32_t color = WS2812FX_paletteColor(ctx, ctx->seg_rt->aux_param++); // rainbow of colors
 
     for(uint8_t i=0; i < cnt; i++) {
-      uint16_t index = _seg->start + (i * ledsPerBit * 2);
+      uint16_t index = ctx->seg->start + (i * ledsPerBit * 2);
       if(src[i]) {
-        WS2812FX_fill(color, index, ledsPerBit);              // bit == 1
-        WS2812FX_fill(BLACK, index + ledsPerBit, ledsPerBit); // space
+        WS2812FX_fill(ctx, color, index, ledsPerBit);              // bit == 1
+        WS2812FX_fill(ctx, BLACK, index + ledsPerBit, ledsPerBit); // space
       } else {
-        WS2812FX_fill(BLACK, index, ledsPerBit * 2); // bit == 0 + space
+        WS2812FX_fill(ctx, BLACK, index, ledsPerBit * 2); // bit == 0 + space
       }
     }
-    if(_seg_rt->aux_param == 0) SET_CYCLE;
+    if(ctx->seg_rt->aux_param == 0) SET_CYCLE;
   }
-  return(_seg->speed / 32);
+  return(ctx->seg->speed / 32);
 }
 
-uint16_t WS2812FX_mode_multi_comet(void) {
-  static uint16_t comets[6];
+uint16_t WS2812FX_scratch_multi_comet(const WS2812FX_Segment *seg, const WS2812FX_Segment_runtime *rt) {
+  (void)seg;
+  uint16_t cnt = rt->extDataCnt != 0 ? rt->extDataCnt : 6;
+  return (cnt < 0xFFFF / PARTICLE_BYTES ? cnt : 0xFFFF / PARTICLE_BYTES) * PARTICLE_BYTES;
+}
 
-  // if external data source not set, config for two comets.
-  // note: the multi_comet data array is data type uint16_t, but extDataSrc
-  // is uint8_t, so be careful when you cast and count an external data source.
+uint16_t WS2812FX_mode_multi_comet(WS2812FX_Ctx *ctx) {
+  // if external data source not set, config for six comets.
+  // note: only the external data source's element count is used, the comets
+  // themselves live in the segment's scratch memory.
   // i.e. uint16_t cometData[4]; // four comets
   //      setExtDataSrc(0, (uint8_t*)cometData, sizeof(cometData) / sizeof(cometData[0]));
-  uint16_t* src = _seg_rt->extDataSrc != NULL ? (uint16_t*)_seg_rt->extDataSrc : comets;
-  uint16_t  cnt = _seg_rt->extDataCnt != 0    ? _seg_rt->extDataCnt            : 6;
+  uint16_t cnt = ctx->seg_rt->extDataCnt != 0 ? ctx->seg_rt->extDataCnt : 6;
 
-  WS2812FX_fade_out();
+  WS2812FX_fade_out(ctx);
 
-  for(uint8_t i=0; i < cnt; i++) {
-    if(src[i] < _seg_len) { // if comet is active, move it one pixel
-      uint32_t color = i % 2 ? _seg->colors[2] : _seg->colors[0]; // alternate between color[0] and color[2]
-      if(IS_REVERSE) {
-        WS2812FX_setPixelColor_nc(_seg->stop - src[i],  color);
-      } else {
-        WS2812FX_setPixelColor_nc(_seg->start + src[i], color);
-      }
-      src[i]++;
-    } else {
-      if(WS2812FX_random8_lim(_seg_len) == 0) {
-        src[i] = 0; // randomly start a comet
-        SET_CYCLE;
-      }
+  WS2812FX_Particles comets;
+  if(!WS2812FX_particles(ctx, &comets, cnt)) return(ctx->seg->speed / ctx->seg_len);
+
+  if(ctx->seg_rt->counter_mode_call == 0) { // all comets start at the first pixel
+    for(uint16_t i=0; i < cnt; i++) {
+      WS2812FX_particles_emitAt(&comets, i, 0, PARTICLE_ONE, i % 2 ? ctx->seg->colors[2] : ctx->seg->colors[0], 1);
     }
   }
 
-  return(_seg->speed / _seg_len);
+  WS2812FX_particles_render(ctx, &comets);  // draws the active comets, drops the ones past the end
+  WS2812FX_particles_update(&comets, 0, 0); // and moves them one pixel
+
+  for(uint16_t i=0; i < cnt; i++) {
+    if(comets.life[i] == 0 && WS2812FX_random8_lim(ctx, ctx->seg_len) == 0) {
+      uint32_t color = i % 2 ? ctx->seg->colors[2] : ctx->seg->colors[0]; // alternate between color[0] and color[2]
+      WS2812FX_particles_emitAt(&comets, i, 0, PARTICLE_ONE, color, 1); // randomly start a comet
+      SET_CYCLE;
+    }
+  }
+
+  return(ctx->seg->speed / ctx->seg_len);
 }
 
 /*
@@ -1052,107 +1072,136 @@ uint16_t WS2812FX_mode_multi_comet(void) {
   Then tell the flipbook effect about your flipbook struct:
   ws2812fx.setExtDataSrc(0, (uint8_t*)&flipbook, 1);
 */
-uint16_t WS2812FX_mode_flipbook(void) {
+uint16_t WS2812FX_mode_flipbook(WS2812FX_Ctx *ctx) {
   // An external data source is required for the flipbook effect, so bale if none has been setup
-  if(_seg_rt->extDataSrc) {
+  if(ctx->seg_rt->extDataSrc) {
     // cast external data array to Flipbook struct
-    struct Flipbook* _flipbook = (struct Flipbook*) _seg_rt->extDataSrc;
+    struct Flipbook* _flipbook = (struct Flipbook*) ctx->seg_rt->extDataSrc;
 
-    uint16_t segIndex = _seg->start;
-    uint8_t pageIndex = _seg_rt->aux_param * _flipbook->numRows * _flipbook->numCols; // aux_param will store the page index
+    uint16_t segIndex = ctx->seg->start;
+    uint8_t pageIndex = ctx->seg_rt->aux_param * _flipbook->numRows * _flipbook->numCols; // aux_param will store the page index
 
     for(int rowIndex=0; rowIndex < _flipbook->numRows; rowIndex++) {
       uint16_t pageRowIndex = pageIndex + (rowIndex * _flipbook->numCols);
       for(int colIndex=0; colIndex < _flipbook->numCols; colIndex++) {
-        if(segIndex <= _seg->stop) {
-          WS2812FX_setPixelColor_nc(segIndex, _flipbook->colors[pageRowIndex + colIndex]);
+        if(segIndex <= ctx->seg->stop) {
+          WS2812FX_setPixelColor_nc(ctx, segIndex, _flipbook->colors[pageRowIndex + colIndex]);
           segIndex++;
         }
       }
     }
 
     // increment to the next page
-    _seg_rt->aux_param = (_seg_rt->aux_param + 1) % _flipbook->numPages;
-    if(_seg_rt->aux_param == 0) SET_CYCLE;
+    ctx->seg_rt->aux_param = (ctx->seg_rt->aux_param + 1) % _flipbook->numPages;
+    if(ctx->seg_rt->aux_param == 0) SET_CYCLE;
   }
-  return _seg->speed;
+  return ctx->seg->speed;
 }
 
-uint16_t WS2812FX_mode_popcorn(void) {
-  static struct Popcorn popcorn[5]; // allocate space for 5 kernels of popcorn
+uint16_t WS2812FX_scratch_popcorn(const WS2812FX_Segment *seg, const WS2812FX_Segment_runtime *rt) {
+  (void)seg;
+  uint16_t cnt = rt->extDataCnt != 0 ? rt->extDataCnt : 5;
+  return (cnt < 0xFFFF / PARTICLE_BYTES ? cnt : 0xFFFF / PARTICLE_BYTES) * PARTICLE_BYTES;
+}
 
-  // if external data source not set, config for five popcorn kernels
-  struct Popcorn* src = _seg_rt->extDataSrc != NULL ? (struct Popcorn*)_seg_rt->extDataSrc : popcorn;
-  uint16_t cnt = _seg_rt->extDataCnt != 0    ? _seg_rt->extDataCnt           : 5;
+uint16_t WS2812FX_mode_popcorn(WS2812FX_Ctx *ctx) {
+  // if external data source not set, config for five popcorn kernels.
+  // note: only the external data source's element count is used, the
+  // kernels themselves live in the segment's scratch memory.
+  uint16_t cnt = ctx->seg_rt->extDataCnt != 0 ? ctx->seg_rt->extDataCnt : 5;
 
-  static float coeff = 0.0f;
-  if(coeff == 0.0f) { // calculate the velocity coeff once (the secret sauce)
-    // coeff = pow((float)_seg_len, 0.5223324f) * 0.3944296f; TODO
-  }
+  uint32_t bgColor = ctx->seg->colors[1];
+  WS2812FX_fill(ctx, bgColor, ctx->seg->start, ctx->seg_len); // reset all LEDs to the background color
 
-  uint32_t bgColor = _seg->colors[1];
-  WS2812FX_fill(bgColor, _seg->start, _seg_len); // reset all LEDs to the background color
-
-  uint32_t popcornColor = (_seg->colors[0] == bgColor) ? WS2812FX_color_wheel(WS2812FX_random8()) : _seg->colors[0];
-
-  for(int8_t i=0; i < cnt; i++) { // for each kernel
-    if(src[i].position >= 0.0f) { // if kernel is active, update its position and slow it down
-      src[i].position += src[i].velocity;
-      src[i].velocity -= 0.1f; // gravity = -0.1
-    } else { // if kernel is inactive, randomly pop it (make it active)
-      if(WS2812FX_random8() < 2) { // POP!!!
-        src[i].position = 0.0f;
-        src[i].velocity = coeff * ((66 + WS2812FX_random8_lim(34)) / 100.0f); // initial fast velocity
-        src[i].color = popcornColor;
-        SET_CYCLE;
-      }
-    }
+  WS2812FX_Particles kernels;
+  if(!WS2812FX_particles(ctx, &kernels, cnt)) return(ctx->seg->speed / ctx->seg_len);
 
-    // if kernel is active, turn on the appropriate LED
-    if(src[i].position >= 0.0f) {
-      uint16_t ledIndex = IS_REVERSE ? _seg->stop - src[i].position : _seg->start + src[i].position;
-      if(ledIndex >= _seg->start && ledIndex <= _seg->stop) WS2812FX_setPixelColor_nc(ledIndex, src[i].color);
+  uint32_t popcornColor = (ctx->seg->colors[0] == bgColor) ? WS2812FX_paletteColor(ctx, WS2812FX_random8(ctx)) : ctx->seg->colors[0];
+
+  WS2812FX_particles_update(&kernels, -PARTICLE_ONE / 10, 0); // gravity = -0.1
+
+  for(uint16_t i=0; i < cnt; i++) { // randomly pop the inactive kernels
+    if(kernels.life[i] == 0 && WS2812FX_random8(ctx) < 2) { // POP!!!
+      // the velocity coeff (the secret sauce): 0.3944296 * seg_len^0.5223324 pixels per frame
+      int32_t coeff = (int32_t)WS2812FX_pow_ratio(ctx->seg_len, 1, 5223, 10000, Q16(0.3944296));
+      int32_t velocity = (int32_t)(((int64_t)coeff * (66 + WS2812FX_random8_lim(ctx, 34))) / 100); // initial fast velocity
+      WS2812FX_particles_emitAt(&kernels, i, 0, velocity, popcornColor, 1);
+      SET_CYCLE;
     }
   }
-  return(_seg->speed / _seg_len);
+
+  WS2812FX_particles_render(ctx, &kernels); // turn on the active kernels' LEDs, drop the ones that fell back
+  return(ctx->seg->speed / ctx->seg_len);
 }
 
-uint16_t WS2812FX_mode_oscillator(void) {
-  static struct Oscillator oscillators[] = { // 2 default oscillators
-    {(uint8_t)(_seg_len/4),                        0,  1}, // size, pos, speed
-    {(uint8_t)(_seg_len/4),  (int16_t)(_seg_len - 1), -2}
-  };
+// the 2 default oscillators, if there's no external data source
+uint16_t WS2812FX_scratch_oscillator(const WS2812FX_Segment *seg, const WS2812FX_Segment_runtime *rt) {
+  (void)seg;
+  return rt->extDataSrc != NULL ? 0 : 2 * sizeof(struct Oscillator);
+}
 
+uint16_t WS2812FX_mode_oscillator(WS2812FX_Ctx *ctx) {
   // if external data source not set, config for two oscillators.
-  struct Oscillator* src = _seg_rt->extDataSrc != NULL ? (struct Oscillator*)_seg_rt->extDataSrc : oscillators;
-  uint16_t cnt    = _seg_rt->extDataCnt != 0    ? _seg_rt->extDataCnt              : 2;
+  struct Oscillator* src = (struct Oscillator*)ctx->seg_rt->extDataSrc;
+  uint16_t cnt    = ctx->seg_rt->extDataCnt != 0    ? ctx->seg_rt->extDataCnt              : 2;
+
+  if(src == NULL) { // the default oscillators live in the segment's scratch memory
+    cnt = 2;
+    src = (struct Oscillator*)ctx->seg_rt->scratch;
+    bool init = ctx->seg_rt->counter_mode_call == 0;
+    if(src == NULL || ctx->seg_rt->scratch_len != 2 * sizeof(struct Oscillator)) {
+      src = (struct Oscillator*)WS2812FX_allocScratch(ctx, 2 * sizeof(struct Oscillator));
+      if(src == NULL) return(ctx->seg->speed / 8); // out of scratch memory
+      init = true;
+    }
+    if(init) {
+      src[0].size = (uint8_t)(ctx->seg_len/4); src[0].pos = 0;                           src[0].speed =  1; // size, pos, speed
+      src[1].size = (uint8_t)(ctx->seg_len/4); src[1].pos = (int16_t)(ctx->seg_len - 1); src[1].speed = -2;
+    }
+  }
 
   for(int8_t i=0; i < cnt; i++) {
     struct Oscillator* osc = &src[i];
     if(osc->size == 0) osc->size = 1; // make sure the size is at least one
     osc->pos += osc->speed; // update the osc position
     // check if the new position is within the segment bounds, and reset if not
-    if((osc->pos <= 0) || osc->pos >= (_seg_len - 1)) {
-      int8_t newSpeed = 1 + WS2812FX_random8_lim(2);
-      osc->pos   = (osc->speed <= 0) ? 0        : _seg_len - 1; // reset position
+    if((osc->pos <= 0) || osc->pos >= (ctx->seg_len - 1)) {
+      int8_t newSpeed = 1 + WS2812FX_random8_lim(ctx, 2);
+      osc->pos   = (osc->speed <= 0) ? 0        : ctx->seg_len - 1; // reset position
       osc->speed = (osc->speed <= 0) ? newSpeed : -newSpeed;    // change direction
       SET_CYCLE;
     }
   }
 
   // update LEDs based on new positions
-  for(int16_t i=0; i < _seg_len; i++) {
+  for(int16_t i=0; i < ctx->seg_len; i++) {
     // if the oscillators overlap, blend their colors
     uint32_t blendedcolor = BLACK;
     for(int8_t j=0; j < cnt; j++) {
       struct Oscillator* osc = &src[j];
-      uint32_t oscColor = _seg->colors[j % MAX_NUM_COLORS];
+      uint32_t oscColor = ctx->seg->colors[j % MAX_NUM_COLORS];
       if(i >= osc->pos && i < osc->pos + osc->size) {
         blendedcolor = (blendedcolor == BLACK) ? oscColor : WS2812FX_color_blend(blendedcolor, oscColor, 128);
       }
     }
-    WS2812FX_setPixelColor_nc(_seg->start + i, blendedcolor);
+    WS2812FX_setPixelColor_nc(ctx, ctx->seg->start + i, blendedcolor);
   }
-  return(_seg->speed / 8);
+  return(ctx->seg->speed / 8);
 }
 
+/*
+ * Custom modes
+ */
+static uint16_t WS2812FX_mode_custom(WS2812FX_Ctx *ctx, uint8_t index) {
+  if(ctx->customModes[index] == NULL) return WS2812FX_mode_static(ctx);
+  return ctx->customModes[index](ctx);
+}
+
+uint16_t WS2812FX_mode_custom_0(WS2812FX_Ctx *ctx) { return WS2812FX_mode_custom(ctx, 0); }
+uint16_t WS2812FX_mode_custom_1(WS2812FX_Ctx *ctx) { return WS2812FX_mode_custom(ctx, 1); }
+uint16_t WS2812FX_mode_custom_2(WS2812FX_Ctx *ctx) { return WS2812FX_mode_custom(ctx, 2); }
+uint16_t WS2812FX_mode_custom_3(WS2812FX_Ctx *ctx) { return WS2812FX_mode_custom(ctx, 3); }
+uint16_t WS2812FX_mode_custom_4(WS2812FX_Ctx *ctx) { return WS2812FX_mode_custom(ctx, 4); }
+uint16_t WS2812FX_mode_custom_5(WS2812FX_Ctx *ctx) { return WS2812FX_mode_custom(ctx, 5); }
+uint16_t WS2812FX_mode_custom_6(WS2812FX_Ctx *ctx) { return WS2812FX_mode_custom(ctx, 6); }
+uint16_t WS2812FX_mode_custom_7(WS2812FX_Ctx *ctx) { return WS2812FX_mode_custom(ctx, 7); }
@@ -213,7 +213,7 @@ const char name_79[] = "Custom 7";
 
 // define static array of member function pointers.
 // make sure the order of the _modes array elements matches the FX_MODE_* values
-static uint16_t (*_modes[])() = {
+static WS2812FX_mode_ptr _modes[] = {
   WS2812FX_mode_static,
   WS2812FX_mode_blink,
   WS2812FX_mode_breath,
@@ -295,4 +295,15 @@ static uint16_t (*_modes[])() = {
   WS2812FX_mode_custom_6,
   WS2812FX_mode_custom_7
 };
+
+// scratch memory declared by the modes that keep per segment state, indexed
+// like _modes. The engine carves it from the pool when the mode is selected;
+// modes without an entry can still call WS2812FX_allocScratch() themselves.
+static const WS2812FX_scratch_ptr _mode_scratch[MODE_COUNT] = {
+  [FX_MODE_TWINKLEFOX]  = WS2812FX_scratch_twinkleFOX,
+  [FX_MODE_VU_METER]    = WS2812FX_scratch_vu_meter,
+  [FX_MODE_MULTI_COMET] = WS2812FX_scratch_multi_comet,
+  [FX_MODE_POPCORN]     = WS2812FX_scratch_popcorn,
+  [FX_MODE_OSCILLATOR]  = WS2812FX_scratch_oscillator
+};
 #endif
@@ -30,32 +30,38 @@
 
   2022-03-23   Separated from the original WS2812FX.cpp file
 */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 #include "WS2812FX.h"
 
 /*
   overload Adafruit_NeoPixel fill() function to respect segment boundaries
 */
-void WS2812FX_fill(uint32_t c, uint16_t first, uint16_t count) {
-  uint16_t i, end;
+void WS2812FX_fill(WS2812FX_Ctx *ctx, uint32_t c, uint16_t first, uint16_t count) {
+  uint16_t end;
 
   // If first LED is past end of strip or outside segment boundaries, nothing to do
-  if (first >= Adafruit_NeoPixel_numLEDs || first < _seg->start || first > _seg->stop) {
+  if (first >= ctx->strip.numLEDs || first < ctx->seg->start || first > ctx->seg->stop) {
     return;
   }
 
   // Calculate the index ONE AFTER the last pixel to fill
   if (count == 0) {
-    end = _seg->stop + 1; // Fill to end of segment
+    end = ctx->seg->stop + 1; // Fill to end of segment
   } else {
     end = first + count;
-    if(end > (_seg->stop + 1)) end = _seg->stop + 1;
+    if(end > (ctx->seg->stop + 1)) end = ctx->seg->stop + 1;
   }
 
-  if (end > Adafruit_NeoPixel_numLEDs) end = Adafruit_NeoPixel_numLEDs;
+  if (end > ctx->strip.numLEDs) end = ctx->strip.numLEDs;
 
-  for (i = first; i < end; i++) {
-    WS2812FX_setPixelColor_nc(i, c);
-  }
+  // encode the pixel once, then replicate it over the span
+  uint8_t pixel[4];
+  WS2812FX_encodePixel(ctx, c, pixel);
+  Adafruit_NeoPixel_fillSpan(&ctx->strip, pixel, first, end - first);
 }
 
 /*
@@ -63,16 +69,16 @@ void WS2812FX_fill(uint32_t c, uint16_t first, uint16_t count) {
  * Alternate between color1 and color2
  * if(strobe == true) then create a strobe effect
  */
-uint16_t WS2812FX_blink(uint32_t color1, uint32_t color2, bool strobe) {
-  if(_seg_rt->counter_mode_call & 1) {
+uint16_t WS2812FX_blink(WS2812FX_Ctx *ctx, uint32_t color1, uint32_t color2, bool strobe) {
+  if(ctx->seg_rt->counter_mode_call & 1) {
     uint32_t color = (IS_REVERSE) ? color1 : color2; // off
-    WS2812FX_fill(color, _seg->start, _seg_len);
+    WS2812FX_fill(ctx, color, ctx->seg->start, ctx->seg_len);
     SET_CYCLE;
-    return strobe ? _seg->speed - 20 : (_seg->speed / 2);
+    return strobe ? ctx->seg->speed - 20 : (ctx->seg->speed / 2);
   } else {
     uint32_t color = (IS_REVERSE) ? color2 : color1; // on
-    WS2812FX_fill(color, _seg->start, _seg_len);
-    return strobe ? 20 : (_seg->speed / 2);
+    WS2812FX_fill(ctx, color, ctx->seg->start, ctx->seg_len);
+    return strobe ? 20 : (ctx->seg->speed / 2);
   }
 }
 
@@ -81,68 +87,68 @@ uint16_t WS2812FX_blink(uint32_t color1, uint32_t color2, bool strobe) {
  * LEDs are turned on (color1) in sequence, then turned off (color2) in sequence.
  * if (bool rev == true) then LEDs are turned off in reverse order
  */
-uint16_t WS2812FX_color_wipe(uint32_t color1, uint32_t color2, bool rev) {
-  if(_seg_rt->counter_mode_step < _seg_len) {
-    uint32_t led_offset = _seg_rt->counter_mode_step;
+uint16_t WS2812FX_color_wipe(WS2812FX_Ctx *ctx, uint32_t color1, uint32_t color2, bool rev) {
+  if(ctx->seg_rt->counter_mode_step < ctx->seg_len) {
+    uint32_t led_offset = ctx->seg_rt->counter_mode_step;
     if(IS_REVERSE) {
-      WS2812FX_setPixelColor_nc(_seg->stop - led_offset, color1);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->stop - led_offset, color1);
     } else {
-      WS2812FX_setPixelColor_nc(_seg->start + led_offset, color1);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->start + led_offset, color1);
     }
   } else {
-    uint32_t led_offset = _seg_rt->counter_mode_step - _seg_len;
+    uint32_t led_offset = ctx->seg_rt->counter_mode_step - ctx->seg_len;
     if((IS_REVERSE && !rev) || (!IS_REVERSE && rev)) {
-      WS2812FX_setPixelColor_nc(_seg->stop - led_offset, color2);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->stop - led_offset, color2);
     } else {
-      WS2812FX_setPixelColor_nc(_seg->start + led_offset, color2);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->start + led_offset, color2);
     }
   }
 
-  _seg_rt->counter_mode_step = (_seg_rt->counter_mode_step + 1) % (_seg_len * 2);
+  ctx->seg_rt->counter_mode_step = (ctx->seg_rt->counter_mode_step + 1) % (ctx->seg_len * 2);
 
-  if(_seg_rt->counter_mode_step == 0) SET_CYCLE;
+  if(ctx->seg_rt->counter_mode_step == 0) SET_CYCLE;
 
-  return (_seg->speed / (_seg_len * 2));
+  return (ctx->seg->speed / (ctx->seg_len * 2));
 }
 
 
 /*
  * scan function - runs a block of pixels back and forth.
  */
-uint16_t WS2812FX_scan(uint32_t color1, uint32_t color2, bool dual) {
-  int8_t dir = _seg_rt->aux_param ? -1 : 1;
+uint16_t WS2812FX_scan(WS2812FX_Ctx *ctx, uint32_t color1, uint32_t color2, bool dual) {
+  int8_t dir = ctx->seg_rt->aux_param ? -1 : 1;
   uint8_t size = 1 << SIZE_OPTION;
 
-  WS2812FX_fill(color2, _seg->start, _seg_len);
+  WS2812FX_fill(ctx, color2, ctx->seg->start, ctx->seg_len);
 
   for(uint8_t i = 0; i < size; i++) {
     if(IS_REVERSE || dual) {
-      WS2812FX_setPixelColor_nc(_seg->stop - _seg_rt->counter_mode_step - i, color1);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->stop - ctx->seg_rt->counter_mode_step - i, color1);
     }
     if(!IS_REVERSE || dual) {
-      WS2812FX_setPixelColor_nc(_seg->start + _seg_rt->counter_mode_step + i, color1);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->start + ctx->seg_rt->counter_mode_step + i, color1);
     }
   }
 
-  _seg_rt->counter_mode_step += dir;
-  if(_seg_rt->counter_mode_step == 0) {
-    _seg_rt->aux_param = 0;
+  ctx->seg_rt->counter_mode_step += dir;
+  if(ctx->seg_rt->counter_mode_step == 0) {
+    ctx->seg_rt->aux_param = 0;
     SET_CYCLE;
   }
-  if(_seg_rt->counter_mode_step >= (uint16_t)(_seg_len - size)) _seg_rt->aux_param = 1;
+  if(ctx->seg_rt->counter_mode_step >= (uint16_t)(ctx->seg_len - size)) ctx->seg_rt->aux_param = 1;
 
-  return (_seg->speed / (_seg_len * 2));
+  return (ctx->seg->speed / (ctx->seg_len * 2));
 }
 
 /*
  * Tricolor chase function
  */
-uint16_t WS2812FX_tricolor_chase(uint32_t color1, uint32_t color2, uint32_t color3) {
+uint16_t WS2812FX_tricolor_chase(WS2812FX_Ctx *ctx, uint32_t color1, uint32_t color2, uint32_t color3) {
   uint8_t sizeCnt = 1 << SIZE_OPTION;
   uint8_t sizeCnt2 = sizeCnt + sizeCnt;
   uint8_t sizeCnt3 = sizeCnt2 + sizeCnt;
-  uint16_t index = _seg_rt->counter_mode_step % sizeCnt3;
-  for(uint16_t i=0; i < _seg_len; i++, index++) {
+  uint16_t index = ctx->seg_rt->counter_mode_step % sizeCnt3;
+  for(uint16_t i=0; i < ctx->seg_len; i++, index++) {
     index = index % sizeCnt3;
 
     uint32_t color = color3;
@@ -150,103 +156,222 @@ uint16_t WS2812FX_tricolor_chase(uint32_t color1, uint32_t color2, uint32_t colo
     else if(index < sizeCnt2) color = color2;
 
     if(IS_REVERSE) {
-      WS2812FX_setPixelColor_nc(_seg->start + i, color);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->start + i, color);
     } else {
-      WS2812FX_setPixelColor_nc(_seg->stop - i, color);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->stop - i, color);
     }
   }
 
-  _seg_rt->counter_mode_step++;
-  if(_seg_rt->counter_mode_step % _seg_len == 0) SET_CYCLE;
+  ctx->seg_rt->counter_mode_step++;
+  if(ctx->seg_rt->counter_mode_step % ctx->seg_len == 0) SET_CYCLE;
 
-  return (_seg->speed / 16);
+  return (ctx->seg->speed / 16);
 }
 
 /*
  * twinkle function
  */
-uint16_t WS2812FX_twinkle(uint32_t color1, uint32_t color2) {
-  if(_seg_rt->counter_mode_step == 0) {
-    WS2812FX_fill(color2, _seg->start, _seg_len);
-    uint16_t min_leds = (_seg_len / 4) + 1; // make sure, at least one LED is on
-    _seg_rt->counter_mode_step = WS2812FX_random(min_leds, min_leds * 2);
+uint16_t WS2812FX_twinkle(WS2812FX_Ctx *ctx, uint32_t color1, uint32_t color2) {
+  if(ctx->seg_rt->counter_mode_step == 0) {
+    WS2812FX_fill(ctx, color2, ctx->seg->start, ctx->seg_len);
+    uint16_t min_leds = (ctx->seg_len / 4) + 1; // make sure, at least one LED is on
+    ctx->seg_rt->counter_mode_step = WS2812FX_random(ctx, min_leds, min_leds * 2);
     SET_CYCLE;
   }
 
-  WS2812FX_setPixelColor_nc(_seg->start + WS2812FX_random16_lim(_seg_len), color1);
+  WS2812FX_setPixelColor_nc(ctx, ctx->seg->start + WS2812FX_random16_lim(ctx, ctx->seg_len), color1);
 
-  _seg_rt->counter_mode_step--;
-  return (_seg->speed / _seg_len);
+  ctx->seg_rt->counter_mode_step--;
+  return (ctx->seg->speed / ctx->seg_len);
 }
 
 /*
  * fade out functions
  */
-void WS2812FX_fade_out() {
-  return WS2812FX_fade_out_targetColor(_seg->colors[1]);
+void WS2812FX_fade_out(WS2812FX_Ctx *ctx) {
+  return WS2812FX_fade_out_targetColor(ctx, ctx->seg->colors[1]);
 }
 
-void WS2812FX_fade_out_targetColor(uint32_t targetColor) {
+void WS2812FX_fade_out_targetColor(WS2812FX_Ctx *ctx, uint32_t targetColor) {
+  uint8_t bytesPerPixel = NEO_BYTES_PER_PIXEL(&ctx->strip);
+  uint16_t stop = min(ctx->seg->stop, ctx->strip.numLEDs - 1);
+  if(ctx->seg->start > stop) return;
+
+  // work on the stored bytes: bring the target into the same domain (gamma,
+  // brightness) once instead of converting every pixel back and forth
+  uint8_t target[4];
+  WS2812FX_encodePixel(ctx, targetColor, target);
+
+  uint8_t *p = Adafruit_NeoPixel_getPixels(&ctx->strip) + ctx->seg->start * bytesPerPixel;
+  Adafruit_NeoPixel_subSums(&ctx->strip, ctx->seg->start, stop);
+  if(WS2812FX_fadeSpan(p, (stop - ctx->seg->start + 1) * bytesPerPixel, target, bytesPerPixel, FADE_RATE)) {
+    Adafruit_NeoPixel_markDirty(&ctx->strip, ctx->seg->start, stop);
+  }
+  Adafruit_NeoPixel_addSums(&ctx->strip, ctx->seg->start, stop);
+}
+
+/*
+ * Move cnt bytes of raw pixel data towards the target pixel (bytesPerPixel
+ * bytes, repeated). Each step covers delta >> rateMapH[rate] + delta >> rateMapL[rate]
+ * of the distance, and deltas under 3 snap to the target. Rate 0 is the old
+ * fade-to-black, halving every byte. Returns true if any byte changed.
+ */
+bool WS2812FX_fadeSpan(uint8_t *pixels, uint16_t cnt, const uint8_t *target, uint8_t bytesPerPixel, uint8_t rate) {
   static const uint8_t rateMapH[] = {0, 1, 1, 1, 2, 3, 4, 6};
   static const uint8_t rateMapL[] = {0, 2, 3, 8, 8, 8, 8, 8};
+  uint16_t i = 0;
+
+  if(rate == 0) { // old fade-to-black algorithm
+    uint32_t changed = 0;
+    for(; i + 4 <= cnt; i += 4) {
+      uint32_t v = (uint32_t)pixels[i] | ((uint32_t)pixels[i + 1] << 8) | ((uint32_t)pixels[i + 2] << 16) | ((uint32_t)pixels[i + 3] << 24);
+      uint32_t n = (v >> 1) & 0x7F7F7F7F;
+      changed |= v ^ n;
+      pixels[i]     = (uint8_t)n;
+      pixels[i + 1] = (uint8_t)(n >> 8);
+      pixels[i + 2] = (uint8_t)(n >> 16);
+      pixels[i + 3] = (uint8_t)(n >> 24);
+    }
+    for(; i < cnt; i++) {
+      changed |= pixels[i] & 0xFE;
+      pixels[i] >>= 1;
+    }
+    return changed != 0;
+  }
 
-  uint8_t rate  = FADE_RATE;
-  uint8_t rateH = rateMapH[rate];
-  uint8_t rateL = rateMapL[rate];
-
-  uint32_t color = targetColor;
-  int w2 = (color >> 24) & 0xff;
-  int r2 = (color >> 16) & 0xff;
-  int g2 = (color >>  8) & 0xff;
-  int b2 =  color        & 0xff;
-
-  for(uint16_t i=_seg->start; i <= _seg->stop; i++) {
-    color = Adafruit_NeoPixel_getPixelColor(i); // current color
-    if(rate == 0) { // old fade-to-black algorithm
-      WS2812FX_setPixelColor_nc(i, (color >> 1) & 0x7F7F7F7F);
-    } else { // new fade-to-color algorithm
-      int w1 = (color >> 24) & 0xff;
-      int r1 = (color >> 16) & 0xff;
-      int g1 = (color >>  8) & 0xff;
-      int b1 =  color        & 0xff;
-
-      // calculate the color differences between the current and target colors
-      int wdelta = w2 - w1;
-      int rdelta = r2 - r1;
-      int gdelta = g2 - g1;
-      int bdelta = b2 - b1;
-
-      // if the current and target colors are almost the same, jump right to the target
-      // color, otherwise calculate an intermediate color. (fixes rounding issues)
-      wdelta = abs(wdelta) < 3 ? wdelta : (wdelta >> rateH) + (wdelta >> rateL);
-      rdelta = abs(rdelta) < 3 ? rdelta : (rdelta >> rateH) + (rdelta >> rateL);
-      gdelta = abs(gdelta) < 3 ? gdelta : (gdelta >> rateH) + (gdelta >> rateL);
-      bdelta = abs(bdelta) < 3 ? bdelta : (bdelta >> rateH) + (bdelta >> rateL);
-
-      WS2812FX_setPixelColor_nrgbw(i, r1 + rdelta, g1 + gdelta, b1 + bdelta, w1 + wdelta);
+  uint8_t rateH = rateMapH[rate & 0x07];
+  uint8_t rateL = rateMapL[rate & 0x07];
+  uint8_t changed = 0;
+
+#if defined(__SSE2__) || defined(__ARM_NEON)
+  // the target repeats every 3 or 4 bytes, 48 bytes hold a whole number of
+  // pixels and of 16 byte vectors either way
+  uint8_t targets[48];
+  for(uint8_t k=0; k<48; k++) targets[k] = target[k % bytesPerPixel];
+  uint8_t toff = 0;
+#endif
+#if defined(__SSE2__)
+  __m128i zero = _mm_setzero_si128(), three = _mm_set1_epi16(3), diff = zero;
+  __m128i shH = _mm_cvtsi32_si128(rateH), shL = _mm_cvtsi32_si128(rateL);
+  for(; i + 16 <= cnt; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(pixels + i));
+    __m128i t = _mm_loadu_si128((const __m128i*)(targets + toff));
+    __m128i res[2];
+    for(uint8_t h=0; h<2; h++) {
+      __m128i v16 = h ? _mm_unpackhi_epi8(v, zero) : _mm_unpacklo_epi8(v, zero);
+      __m128i t16 = h ? _mm_unpackhi_epi8(t, zero) : _mm_unpacklo_epi8(t, zero);
+      __m128i d = _mm_sub_epi16(t16, v16);
+      __m128i ad = _mm_max_epi16(d, _mm_sub_epi16(zero, d));
+      __m128i step = _mm_add_epi16(_mm_sra_epi16(d, shH), _mm_sra_epi16(d, shL));
+      __m128i snap = _mm_cmpgt_epi16(three, ad);
+      res[h] = _mm_add_epi16(v16, _mm_or_si128(_mm_and_si128(snap, d), _mm_andnot_si128(snap, step)));
+    }
+    __m128i n = _mm_packus_epi16(res[0], res[1]);
+    diff = _mm_or_si128(diff, _mm_xor_si128(v, n));
+    _mm_storeu_si128((__m128i*)(pixels + i), n);
+    toff = toff == 32 ? 0 : toff + 16;
+  }
+  changed = _mm_movemask_epi8(_mm_cmpeq_epi8(diff, zero)) != 0xFFFF;
+#elif defined(__ARM_NEON)
+  int16x8_t shH = vdupq_n_s16(-rateH), shL = vdupq_n_s16(-rateL), three = vdupq_n_s16(3);
+  uint8x16_t diff = vdupq_n_u8(0);
+  for(; i + 16 <= cnt; i += 16) {
+    uint8x16_t v = vld1q_u8(pixels + i), t = vld1q_u8(targets + toff);
+    int16x8_t res[2];
+    for(uint8_t h=0; h<2; h++) {
+      int16x8_t v16 = vreinterpretq_s16_u16(vmovl_u8(h ? vget_high_u8(v) : vget_low_u8(v)));
+      int16x8_t t16 = vreinterpretq_s16_u16(vmovl_u8(h ? vget_high_u8(t) : vget_low_u8(t)));
+      int16x8_t d = vsubq_s16(t16, v16);
+      int16x8_t step = vaddq_s16(vshlq_s16(d, shH), vshlq_s16(d, shL));
+      res[h] = vaddq_s16(v16, vbslq_s16(vcltq_s16(vabsq_s16(d), three), d, step));
     }
+    uint8x16_t n = vcombine_u8(vqmovun_s16(res[0]), vqmovun_s16(res[1]));
+    diff = vorrq_u8(diff, veorq_u8(v, n));
+    vst1q_u8(pixels + i, n);
+    toff = toff == 32 ? 0 : toff + 16;
   }
+  uint8x8_t diff8 = vorr_u8(vget_low_u8(diff), vget_high_u8(diff));
+  changed = vget_lane_u64(vreinterpret_u64_u8(diff8), 0) != 0;
+#endif
+  // branch-free scalar path for the tail (or everything, without SIMD)
+  uint8_t k = i % bytesPerPixel;
+  for(; i < cnt; i++) {
+    int v = pixels[i];
+    int d = target[k] - v;
+    k = (k + 1 == bytesPerPixel) ? 0 : k + 1;
+    int ad = d < 0 ? -d : d;
+    int snap = -(ad < 3); // all ones if the target is close enough
+    int n = v + ((d & snap) | (((d >> rateH) + (d >> rateL)) & ~snap));
+    changed |= (uint8_t)(v ^ n);
+    pixels[i] = (uint8_t)n;
+  }
+  return changed != 0;
 }
 
 /*
  * color blend function
  */
+// all four channels at once: the even and odd bytes are spread into 16-bit
+// lanes, which hold (c1 * (256 - blendAmt) + c2 * blendAmt) without overflow
+static inline uint32_t WS2812FX_blend32(uint32_t color1, uint32_t color2, uint16_t amt1, uint16_t amt2) {
+  uint32_t rb = (((color1 & 0x00FF00FF) * amt1 + (color2 & 0x00FF00FF) * amt2) >> 8) & 0x00FF00FF;
+  uint32_t wg = (((color1 >> 8) & 0x00FF00FF) * amt1 + ((color2 >> 8) & 0x00FF00FF) * amt2) & 0xFF00FF00;
+  return rb | wg;
+}
+
 uint32_t WS2812FX_color_blend(uint32_t color1, uint32_t color2, uint8_t blendAmt) {
-  uint32_t blendedColor;
-  blend((uint8_t*)&blendedColor, (uint8_t*)&color1, (uint8_t*)&color2, sizeof(uint32_t), blendAmt);
-  return blendedColor;
+  if(blendAmt == 0) return color1;
+  if(blendAmt == 255) return color2;
+  return WS2812FX_blend32(color1, color2, 256 - blendAmt, blendAmt);
 }
 
 uint8_t* WS2812FX_blend(uint8_t *dest, uint8_t *src1, uint8_t *src2, uint16_t cnt, uint8_t blendAmt) {
+  return WS2812FX_blendSpan(dest, src1, src2, cnt, blendAmt);
+}
+
+/*
+ * Blend cnt bytes: dest = src1 + (src2 - src1) * blendAmt / 256, rounded
+ * down. dest may be the same as src1 or src2.
+ */
+uint8_t* WS2812FX_blendSpan(uint8_t *dest, const uint8_t *src1, const uint8_t *src2, uint16_t cnt, uint8_t blendAmt) {
   if(blendAmt == 0) {
     Adafruit_NeoPixel_memmove(dest, src1, cnt);
+    return dest;
   } else if(blendAmt == 255) {
     Adafruit_NeoPixel_memmove(dest, src2, cnt);
-  } else {
-    for(uint16_t i=0; i<cnt; i++) {
-//    dest[i] = map(blendAmt, 0, 255, src1[i], src2[i]);
-      dest[i] =  blendAmt * ((int)src2[i] - (int)src1[i]) / 256 + src1[i]; // map() function
-    }
+    return dest;
+  }
+
+  uint16_t amt1 = 256 - blendAmt, amt2 = blendAmt, i = 0;
+#if defined(__SSE2__)
+  __m128i zero = _mm_setzero_si128(), va1 = _mm_set1_epi16(amt1), va2 = _mm_set1_epi16(amt2);
+  for(; i + 16 <= cnt; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(src1 + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(src2 + i));
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), va1), _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), va2));
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), va1), _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), va2));
+    _mm_storeu_si128((__m128i*)(dest + i), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+  }
+#elif defined(__ARM_NEON)
+  uint8x8_t va1 = vdup_n_u8((uint8_t)amt1), va2 = vdup_n_u8((uint8_t)amt2); // amt1 < 256 here
+  for(; i + 16 <= cnt; i += 16) {
+    uint8x16_t a = vld1q_u8(src1 + i), b = vld1q_u8(src2 + i);
+    uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(a), va1), vget_low_u8(b), va2);
+    uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(a), va1), vget_high_u8(b), va2);
+    vst1q_u8(dest + i, vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+  }
+#endif
+  for(; i + 4 <= cnt; i += 4) {
+    uint32_t a = (uint32_t)src1[i] | ((uint32_t)src1[i + 1] << 8) | ((uint32_t)src1[i + 2] << 16) | ((uint32_t)src1[i + 3] << 24);
+    uint32_t b = (uint32_t)src2[i] | ((uint32_t)src2[i + 1] << 8) | ((uint32_t)src2[i + 2] << 16) | ((uint32_t)src2[i + 3] << 24);
+    uint32_t c = WS2812FX_blend32(a, b, amt1, amt2);
+    dest[i]     = (uint8_t)c;
+    dest[i + 1] = (uint8_t)(c >> 8);
+    dest[i + 2] = (uint8_t)(c >> 16);
+    dest[i + 3] = (uint8_t)(c >> 24);
+  }
+  for(; i < cnt; i++) {
+    dest[i] = (uint8_t)((src1[i] * amt1 + src2[i] * amt2) >> 8);
   }
   return dest;
 }
@@ -254,16 +379,16 @@ uint8_t* WS2812FX_blend(uint8_t *dest, uint8_t *src1, uint8_t *src2, uint16_t cn
 /*
  * twinkle_fade function
  */
-uint16_t WS2812FX_twinkle_fade(uint32_t color) {
-  WS2812FX_fade_out();
+uint16_t WS2812FX_twinkle_fade(WS2812FX_Ctx *ctx, uint32_t color) {
+  WS2812FX_fade_out(ctx);
 
-  if(WS2812FX_random8_lim(3) == 0) {
+  if(WS2812FX_random8_lim(ctx, 3) == 0) {
     uint8_t size = 1 << SIZE_OPTION;
-    uint16_t index = _seg->start + WS2812FX_random16_lim(_seg_len - size + 1);
-    WS2812FX_fill(color, index, size);
+    uint16_t index = ctx->seg->start + WS2812FX_random16_lim(ctx, ctx->seg_len - size + 1);
+    WS2812FX_fill(ctx, color, index, size);
     SET_CYCLE;
   }
-  return (_seg->speed / 16);
+  return (ctx->seg->speed / 16);
 }
 
 /*
@@ -271,19 +396,51 @@ uint16_t WS2812FX_twinkle_fade(uint32_t color) {
  * color1 = background color
  * color2 = sparkle color
  */
-uint16_t WS2812FX_sparkle(uint32_t color1, uint32_t color2) {
-  if(_seg_rt->counter_mode_step == 0) {
-    WS2812FX_fill(color1, _seg->start, _seg_len);
+uint16_t WS2812FX_sparkle(WS2812FX_Ctx *ctx, uint32_t color1, uint32_t color2) {
+  if(ctx->seg_rt->counter_mode_step == 0) {
+    WS2812FX_fill(ctx, color1, ctx->seg->start, ctx->seg_len);
   }
 
   uint8_t size = 1 << SIZE_OPTION;
-  WS2812FX_fill(color1, _seg->start + _seg_rt->aux_param3, size);
+  WS2812FX_fill(ctx, color1, ctx->seg->start + ctx->seg_rt->aux_param3, size);
 
-  _seg_rt->aux_param3 = WS2812FX_random16_lim(_seg_len - size + 1); // aux_param3 stores the random led index
-  WS2812FX_fill(color2, _seg->start + _seg_rt->aux_param3, size);
+  ctx->seg_rt->aux_param3 = WS2812FX_random16_lim(ctx, ctx->seg_len - size + 1); // aux_param3 stores the random led index
+  WS2812FX_fill(ctx, color2, ctx->seg->start + ctx->seg_rt->aux_param3, size);
 
   SET_CYCLE;
-  return (_seg->speed / 32);
+  return (ctx->seg->speed / 32);
+}
+
+/*
+ * Dissolve function: returns the next pixel of the segment in a random looking
+ * order that visits every pixel exactly once per pass, without reading any
+ * pixel back. A maximal length Galois LFSR steps through the smallest range
+ * 1..2^bits-1 that covers the segment and skips the states past its end.
+ * aux_param3 holds the LFSR state, counter_mode_step the pixels done in the
+ * current pass; a new pass (with a new random starting point) begins once
+ * counter_mode_step has been reset to 0 by the caller.
+ */
+uint16_t WS2812FX_dissolve(WS2812FX_Ctx *ctx) {
+  // feedback taps of maximal length LFSRs, by register width
+  static const uint16_t taps[17] = {
+    0, 0, 0x3, 0x6, 0xC, 0x14, 0x30, 0x60, 0xB8,
+    0x110, 0x240, 0x500, 0xE08, 0x1C80, 0x3802, 0x6000, 0xD008
+  };
+  uint16_t len = ctx->seg_len;
+  uint8_t bits = 2;
+  while(bits < 16 && ((1U << bits) - 1) < len) bits++;
+
+  uint16_t state = ctx->seg_rt->aux_param3;
+  if(ctx->seg_rt->counter_mode_step == 0) { // start anywhere in the sequence
+    state = 1 + WS2812FX_random16_lim(ctx, (uint16_t)((1U << bits) - 1));
+  }
+  do {
+    state = (state >> 1) ^ ((state & 1) ? taps[bits] : 0);
+  } while(state > len);
+
+  ctx->seg_rt->aux_param3 = state;
+  ctx->seg_rt->counter_mode_step++;
+  return ctx->seg->start + state - 1;
 }
 
 /*
@@ -291,27 +448,27 @@ uint16_t WS2812FX_sparkle(uint32_t color1, uint32_t color2) {
  * color1 = background color
  * color2 and color3 = colors of two adjacent leds
  */
-uint16_t WS2812FX_chase(uint32_t color1, uint32_t color2, uint32_t color3) {
+uint16_t WS2812FX_chase(WS2812FX_Ctx *ctx, uint32_t color1, uint32_t color2, uint32_t color3) {
   uint8_t size = 1 << SIZE_OPTION;
   for(uint8_t i=0; i<size; i++) {
-    uint16_t a = (_seg_rt->counter_mode_step + i) % _seg_len;
-    uint16_t b = (a + size) % _seg_len;
-    uint16_t c = (b + size) % _seg_len;
+    uint16_t a = (ctx->seg_rt->counter_mode_step + i) % ctx->seg_len;
+    uint16_t b = (a + size) % ctx->seg_len;
+    uint16_t c = (b + size) % ctx->seg_len;
     if(IS_REVERSE) {
-      WS2812FX_setPixelColor_nc(_seg->stop - a, color1);
-      WS2812FX_setPixelColor_nc(_seg->stop - b, color2);
-      WS2812FX_setPixelColor_nc(_seg->stop - c, color3);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->stop - a, color1);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->stop - b, color2);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->stop - c, color3);
     } else {
-      WS2812FX_setPixelColor_nc(_seg->start + a, color1);
-      WS2812FX_setPixelColor_nc(_seg->start + b, color2);
-      WS2812FX_setPixelColor_nc(_seg->start + c, color3);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->start + a, color1);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->start + b, color2);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->start + c, color3);
     }
   }
 
-  if(_seg_rt->counter_mode_step + (size * 3) == _seg_len) SET_CYCLE;
+  if(ctx->seg_rt->counter_mode_step + (size * 3) == ctx->seg_len) SET_CYCLE;
 
-  _seg_rt->counter_mode_step = (_seg_rt->counter_mode_step + 1) % _seg_len;
-  return (_seg->speed / _seg_len);
+  ctx->seg_rt->counter_mode_step = (ctx->seg_rt->counter_mode_step + 1) % ctx->seg_len;
+  return (ctx->seg->speed / ctx->seg_len);
 }
 
 /*
@@ -319,105 +476,107 @@ uint16_t WS2812FX_chase(uint32_t color1, uint32_t color2, uint32_t color3) {
  * color1 = background color
  * color2 = flash color
  */
-uint16_t WS2812FX_chase_flash(uint32_t color1, uint32_t color2) {
+uint16_t WS2812FX_chase_flash(WS2812FX_Ctx *ctx, uint32_t color1, uint32_t color2) {
   const static uint8_t flash_count = 4;
-  uint8_t flash_step = _seg_rt->counter_mode_call % ((flash_count * 2) + 1);
+  uint8_t flash_step = ctx->seg_rt->counter_mode_call % ((flash_count * 2) + 1);
 
   if(flash_step < (flash_count * 2)) {
     uint32_t color = (flash_step % 2 == 0) ? color2 : color1;
-    uint16_t n = _seg_rt->counter_mode_step;
-    uint16_t m = (_seg_rt->counter_mode_step + 1) % _seg_len;
+    uint16_t n = ctx->seg_rt->counter_mode_step;
+    uint16_t m = (ctx->seg_rt->counter_mode_step + 1) % ctx->seg_len;
     if(IS_REVERSE) {
-      WS2812FX_setPixelColor_nc(_seg->stop - n, color);
-      WS2812FX_setPixelColor_nc(_seg->stop - m, color);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->stop - n, color);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->stop - m, color);
     } else {
-      WS2812FX_setPixelColor_nc(_seg->start + n, color);
-      WS2812FX_setPixelColor_nc(_seg->start + m, color);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->start + n, color);
+      WS2812FX_setPixelColor_nc(ctx, ctx->seg->start + m, color);
     }
     return 30;
   } else {
-    _seg_rt->counter_mode_step = (_seg_rt->counter_mode_step + 1) % _seg_len;
-    if(_seg_rt->counter_mode_step == 0) {
+    ctx->seg_rt->counter_mode_step = (ctx->seg_rt->counter_mode_step + 1) % ctx->seg_len;
+    if(ctx->seg_rt->counter_mode_step == 0) {
       // update aux_param so mode_chase_flash_random() will select the next color
-      _seg_rt->aux_param = WS2812FX_get_random_wheel_index(_seg_rt->aux_param);
+      ctx->seg_rt->aux_param = WS2812FX_get_random_wheel_index(ctx, ctx->seg_rt->aux_param);
       SET_CYCLE;
     }
   }
-  return (_seg->speed / _seg_len);
+  return (ctx->seg->speed / ctx->seg_len);
 }
 
 /*
  * Alternating pixels running function.
  */
-uint16_t WS2812FX_running(uint32_t color1, uint32_t color2) {
+uint16_t WS2812FX_running(WS2812FX_Ctx *ctx, uint32_t color1, uint32_t color2) {
   uint8_t size = 2 << SIZE_OPTION;
-  uint32_t color = (_seg_rt->counter_mode_step & size) ? color1 : color2;
+  uint32_t color = (ctx->seg_rt->counter_mode_step & size) ? color1 : color2;
 
   if(IS_REVERSE) {
-    WS2812FX_copyPixels(_seg->start, _seg->start + 1, _seg_len - 1);
-    WS2812FX_setPixelColor_nc(_seg->stop, color);
+    WS2812FX_scroll(ctx, -1);
+    WS2812FX_setPixelColor_nc(ctx, WS2812FX_segPixel(ctx, ctx->seg_len - 1), color);
   } else {
-    WS2812FX_copyPixels(_seg->start + 1, _seg->start, _seg_len - 1);
-    WS2812FX_setPixelColor_nc(_seg->start, color);
+    WS2812FX_scroll(ctx, 1);
+    WS2812FX_setPixelColor_nc(ctx, WS2812FX_segPixel(ctx, 0), color);
   }
 
-  _seg_rt->counter_mode_step++;
-  if((_seg_rt->counter_mode_step % _seg_len) == 0) SET_CYCLE;
-  return (_seg->speed / 16);
+  ctx->seg_rt->counter_mode_step++;
+  if((ctx->seg_rt->counter_mode_step % ctx->seg_len) == 0) SET_CYCLE;
+  return (ctx->seg->speed / 16);
 }
 
 /*
  * Fireworks function.
  */
-uint16_t WS2812FX_fireworks(uint32_t color) {
-  WS2812FX_fade_out();
+uint16_t WS2812FX_fireworks(WS2812FX_Ctx *ctx, uint32_t color) {
+  WS2812FX_fade_out(ctx);
 
 // for better performance, manipulate the Adafruit_NeoPixels pixels[] array directly
-  uint8_t *pixels = Adafruit_NeoPixel_getPixels();
-  uint8_t bytesPerPixel = WS2812FX_getNumBytesPerPixel(); // 3=RGB, 4=RGBW
-  uint16_t startPixel = _seg->start * bytesPerPixel + bytesPerPixel;
-  uint16_t stopPixel = _seg->stop * bytesPerPixel;
+  uint8_t *pixels = Adafruit_NeoPixel_getPixels(&ctx->strip);
+  uint8_t bytesPerPixel = NEO_BYTES_PER_PIXEL(&ctx->strip); // 3=RGB, 4=RGBW
+  uint16_t startPixel = ctx->seg->start * bytesPerPixel + bytesPerPixel;
+  uint16_t stopPixel = ctx->seg->stop * bytesPerPixel;
+  if(ctx->seg_len > 2) Adafruit_NeoPixel_subSums(&ctx->strip, ctx->seg->start + 1, ctx->seg->stop - 1);
   for(uint16_t i=startPixel; i <stopPixel; i++) {
-    uint16_t tmpPixel = (pixels[i - bytesPerPixel] >> 2) +
-      pixels[i] +
-      (pixels[i + bytesPerPixel] >> 2);
-    pixels[i] =  tmpPixel > 255 ? 255 : tmpPixel;
+    pixels[i] = WS2812FX_qadd8(pixels[i], (pixels[i - bytesPerPixel] >> 2) + (pixels[i + bytesPerPixel] >> 2));
+  }
+  if(ctx->seg_len > 2) {
+    Adafruit_NeoPixel_addSums(&ctx->strip, ctx->seg->start + 1, ctx->seg->stop - 1);
+    Adafruit_NeoPixel_markDirty(&ctx->strip, ctx->seg->start + 1, ctx->seg->stop - 1);
   }
 
   uint8_t size = 2 << SIZE_OPTION;
-  if(!_triggered) {
-    for(uint16_t i=0; i<max(1, _seg_len/20); i++) {
-      if(WS2812FX_random8_lim(10) == 0) {
-        uint16_t index = _seg->start + WS2812FX_random16_lim(_seg_len - size + 1);
-        WS2812FX_fill(color, index, size);
+  if(!ctx->triggered) {
+    for(uint16_t i=0; i<max(1, ctx->seg_len/20); i++) {
+      if(WS2812FX_random8_lim(ctx, 10) == 0) {
+        uint16_t index = ctx->seg->start + WS2812FX_random16_lim(ctx, ctx->seg_len - size + 1);
+        WS2812FX_fill(ctx, color, index, size);
         SET_CYCLE;
       }
     }
   } else {
-    for(uint16_t i=0; i<max(1, _seg_len/10); i++) {
-      uint16_t index = _seg->start + WS2812FX_random16_lim(_seg_len - size + 1);
-      WS2812FX_fill(color, index, size);
+    for(uint16_t i=0; i<max(1, ctx->seg_len/10); i++) {
+      uint16_t index = ctx->seg->start + WS2812FX_random16_lim(ctx, ctx->seg_len - size + 1);
+      WS2812FX_fill(ctx, color, index, size);
       SET_CYCLE;
     }
   }
 
-  return (_seg->speed / 16);
+  return (ctx->seg->speed / 16);
 }
 
 /*
  * Fire flicker function
  */
-uint16_t WS2812FX_fire_flicker(int rev_intensity) {
-  uint8_t w = (_seg->colors[0] >> 24) & 0xFF;
-  uint8_t r = (_seg->colors[0] >> 16) & 0xFF;
-  uint8_t g = (_seg->colors[0] >>  8) & 0xFF;
-  uint8_t b = (_seg->colors[0]        & 0xFF);
+uint16_t WS2812FX_fire_flicker(WS2812FX_Ctx *ctx, int rev_intensity) {
+  uint8_t w = (ctx->seg->colors[0] >> 24) & 0xFF;
+  uint8_t r = (ctx->seg->colors[0] >> 16) & 0xFF;
+  uint8_t g = (ctx->seg->colors[0] >>  8) & 0xFF;
+  uint8_t b = (ctx->seg->colors[0]        & 0xFF);
   uint8_t lum = max(w, max(r, max(g, b))) / rev_intensity;
-  for(uint16_t i=_seg->start; i <= _seg->stop; i++) {
-    int flicker = WS2812FX_random8_lim(lum);
-    WS2812FX_setPixelColor_nrgbw(i, max(r - flicker, 0), max(g - flicker, 0), max(b - flicker, 0), max(w - flicker, 0));
+  for(uint16_t i=ctx->seg->start; i <= ctx->seg->stop; i++) {
+    int flicker = WS2812FX_random8_lim(ctx, lum);
+    WS2812FX_setPixelColor_nrgbw(ctx, i, max(r - flicker, 0), max(g - flicker, 0), max(b - flicker, 0), max(w - flicker, 0));
   }
 
   SET_CYCLE;
-  return (_seg->speed / _seg_len);
+  return (ctx->seg->speed / ctx->seg_len);
 }
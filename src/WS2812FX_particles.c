@@ -0,0 +1,146 @@
+/*
+  WS2812FX_particles.c - particle system for the WS2812FX effects
+
+  LICENSE
+
+  The MIT License (MIT)
+
+  Copyright (c) 2016  Harm Aldick
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+
+
+  CHANGELOG
+
+  2026-10-17   Particle state moved out of the effects' static variables
+*/
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "WS2812FX.h"
+
+/*
+ * Particles of the segment currently being serviced. The particles live in
+ * the segment's scratch memory as separate arrays of positions, velocities,
+ * colors and lifetimes, so the update phase runs over plain arrays. The
+ * scratch memory can move between calls, so modes must call this every time
+ * rather than keep the pointers. (Re)allocating, e.g. when count changes,
+ * starts over with all slots free. Returns false if the scratch pool can't
+ * hold count particles.
+ */
+bool WS2812FX_particles(WS2812FX_Ctx *ctx, WS2812FX_Particles *p, uint16_t count) {
+  if(count > 0xFFFF / PARTICLE_BYTES) count = 0xFFFF / PARTICLE_BYTES;
+  uint16_t size = count * PARTICLE_BYTES;
+  uint8_t *mem = ctx->seg_rt->scratch;
+  if(mem == NULL || ctx->seg_rt->scratch_len != size) {
+    mem = WS2812FX_allocScratch(ctx, size);
+  }
+  if(mem == NULL) {
+    p->count = 0;
+    return false;
+  }
+  p->count = count;
+  p->pos   = (int32_t*)mem;
+  p->vel   = (int32_t*)(mem + count * 4);
+  p->color = (uint32_t*)(mem + count * 8);
+  p->life  = (uint16_t*)(mem + count * 12);
+  return true;
+}
+
+/*
+ * Emit phase: put a particle in the first free slot. life is the number of
+ * update() calls it lives through (see decay), at least 1. Returns the slot
+ * or -1 if they're all taken.
+ */
+int16_t WS2812FX_particles_emit(WS2812FX_Particles *p, int32_t pos, int32_t vel, uint32_t color, uint16_t life) {
+  for(uint16_t i=0; i<p->count; i++) {
+    if(p->life[i] == 0) {
+      WS2812FX_particles_emitAt(p, i, pos, vel, color, life);
+      return (int16_t)i;
+    }
+  }
+  return -1;
+}
+
+// emit into the given slot, for modes whose particles have fixed roles
+void WS2812FX_particles_emitAt(WS2812FX_Particles *p, uint16_t slot, int32_t pos, int32_t vel, uint32_t color, uint16_t life) {
+  p->pos[slot] = pos;
+  p->vel[slot] = vel;
+  p->color[slot] = color;
+  p->life[slot] = life ? life : 1;
+}
+
+/*
+ * Update phase: accelerate and move every particle, and take decay off its
+ * lifetime (0 for particles that only die by leaving the segment). Free
+ * slots are run through the same arithmetic, so there are no branches; the
+ * wrap-around arithmetic keeps that harmless.
+ */
+void WS2812FX_particles_update(WS2812FX_Particles *p, int32_t accel, uint16_t decay) {
+  uint16_t i = 0, n = p->count;
+#if defined(__SSE2__)
+  __m128i va = _mm_set1_epi32(accel), vd = _mm_set1_epi16((int16_t)decay);
+  for(; i + 8 <= n; i += 8) {
+    for(uint8_t k=0; k<8; k+=4) {
+      __m128i v = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(p->vel + i + k)), va);
+      _mm_storeu_si128((__m128i*)(p->vel + i + k), v);
+      _mm_storeu_si128((__m128i*)(p->pos + i + k), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(p->pos + i + k)), v));
+    }
+    _mm_storeu_si128((__m128i*)(p->life + i), _mm_subs_epu16(_mm_loadu_si128((const __m128i*)(p->life + i)), vd));
+  }
+#elif defined(__ARM_NEON)
+  int32x4_t va = vdupq_n_s32(accel);
+  uint16x8_t vd = vdupq_n_u16(decay);
+  for(; i + 8 <= n; i += 8) {
+    for(uint8_t k=0; k<8; k+=4) {
+      int32x4_t v = vaddq_s32(vld1q_s32(p->vel + i + k), va);
+      vst1q_s32(p->vel + i + k, v);
+      vst1q_s32(p->pos + i + k, vaddq_s32(vld1q_s32(p->pos + i + k), v));
+    }
+    vst1q_u16(p->life + i, vqsubq_u16(vld1q_u16(p->life + i), vd));
+  }
+#endif
+  for(; i < n; i++) {
+    uint32_t v = (uint32_t)p->vel[i] + (uint32_t)accel;
+    p->vel[i] = (int32_t)v;
+    p->pos[i] = (int32_t)((uint32_t)p->pos[i] + v);
+    p->life[i] = p->life[i] > decay ? p->life[i] - decay : 0;
+  }
+}
+
+/*
+ * Render phase: draw every live particle on the pixel its position falls in,
+ * counted from the segment's start (from its stop if REVERSE). Particles
+ * that have left the segment are freed. Later slots are drawn over earlier
+ * ones.
+ */
+void WS2812FX_particles_render(WS2812FX_Ctx *ctx, WS2812FX_Particles *p) {
+  for(uint16_t i=0; i<p->count; i++) {
+    if(p->life[i] == 0) continue;
+    int32_t pos = p->pos[i];
+    if(pos < 0 || (pos >> PARTICLE_SHIFT) >= ctx->seg_len) {
+      p->life[i] = 0;
+      continue;
+    }
+    uint16_t px = (uint16_t)(pos >> PARTICLE_SHIFT);
+    WS2812FX_setPixelColor_nc(ctx, IS_REVERSE ? ctx->seg->stop - px : ctx->seg->start + px, p->color[i]);
+  }
+}
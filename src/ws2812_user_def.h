@@ -1,13 +1,44 @@
 #ifndef _WX2812_USER_DEF_H_
 #define _WX2812_USER_DEF_H_
 
+#include "Adafruit_NeoPixel_defines.h"
+
 #define DEFAULT_BRIGHTNESS (uint8_t)50
 #define DEFAULT_MODE       (uint8_t)0
 #define DEFAULT_SPEED      (uint16_t)1000
 
+// allow WS2812FX_new()/WS2812FX_delete() to allocate a context from the heap
+// #define SUPPORT_MALLOC     1
+
+// use the platform's memmove()/memset()/memchr() instead of the built-in ones.
+// Defaults to 1 for hosted builds that have a C library, 0 otherwise
+// #define USE_LIBC_MEM       0
+
+// keep the pixel buffer at full scale and apply the global and per segment
+// brightness once per frame while copying it into a transmit buffer (costs a
+// second pixel buffer in the arena)
+// #define DEFERRED_BRIGHTNESS 1
+
+// send frames from a second transmit buffer, so a frame can be rendered while
+// the previous one is still going out (see WS2812FX_showAsync() and
+// Adafruit_NeoPixel_setTransport()). Costs one or two pixel buffers in the arena
+// #define DOUBLE_BUFFER      1
+
+// reserve a transmit buffer so WS2812FX_setPowerBudget() can scale the output
+// (DEFERRED_BRIGHTNESS and DOUBLE_BUFFER already have one; without any the
+// power limiter has no effect)
+// #define POWER_LIMIT        1
+
+// fix the pixel type at build time (the type passed to init() is ignored), so
+// pixel accesses use constant channel offsets
+// #define NEO_FIXED_TYPE     NEO_GRB
+
+// shortest interval between two frames of a segment, in microseconds
+// #define MIN_FRAME_US       (uint32_t)2000
+
 typedef struct _WS2812_User_Ctl_Hdl
 {
-    uint32_t (*user_millis)(void);
+    uint64_t (*user_micros)(void); // monotonic microsecond clock, must not wrap
 }WS2812_User_Ctl_Hdl;
 
 